@@ -0,0 +1,36 @@
+// allow_threads.h
+// Scoped release of the GIL for the phases that touch no Python objects:
+// compression, hashing, base64, JSON and file I/O.
+//
+// Notes:
+// - Equivalent to Py_BEGIN_ALLOW_THREADS / Py_END_ALLOW_THREADS, except that
+//   the thread state is also restored when the phase throws.
+// - Nothing inside the scope may use the Python C API, Py_DECREF and
+//   PyErr_* included; errors are reported once the scope has ended.
+// - Short phases keep the GIL (ALLOW_THREADS_MIN_SIZE): taking it back can
+//   mean waiting out another thread's switch interval, which would cost far
+//   more than the work itself.
+
+#pragma once
+#include <Python.h>
+#include <cstddef>
+
+namespace pyser {
+    constexpr size_t ALLOW_THREADS_MIN_SIZE = 64 * 1024;
+
+    class AllowThreads {
+    public:
+        explicit AllowThreads(bool release = true) : state_(release ? PyEval_SaveThread() : nullptr) {}
+
+        AllowThreads(const AllowThreads &) = delete;
+
+        AllowThreads &operator=(const AllowThreads &) = delete;
+
+        ~AllowThreads() {
+            if (state_) PyEval_RestoreThread(state_);
+        }
+
+    private:
+        PyThreadState *state_;
+    };
+} // namespace pyser
@@ -0,0 +1,301 @@
+// base64.cpp
+// Scalar and SIMD kernels of the base64 codec and their selection at run time
+// (see base64.h).
+//
+// Notes:
+// - The SIMD encoder follows Wojciech Mula's method: a byte shuffle spreads
+//   each 3-byte group over a 32-bit lane, two multiplies move the four 6-bit
+//   fields into separate bytes, and a 16-entry shuffle table adds the offset
+//   of each field's alphabet range.
+// - The SIMD decoder (after Alfred Klomp's library) classifies characters by
+//   their high and low nibbles, so one AND of two table lookups flags every
+//   byte outside the alphabet; a block holding one is left to the scalar
+//   loop, which handles whitespace and padding and reports the error.
+// - Kernels only take whole blocks they can load and store within the
+//   buffers; the scalar loop finishes the rest.
+
+#include "base64.h"
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#if defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64)
+#include <immintrin.h>
+#define PYSER_BASE64_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define PYSER_TARGET(isa)
+#else
+#define PYSER_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace base64 {
+    namespace {
+        constexpr char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        // Decode table: 6-bit value, or one of these (all with the top bit set).
+        constexpr uint8_t INVALID = 0xFF;
+        constexpr uint8_t SKIP = 0xFE;      // whitespace
+        constexpr uint8_t PAD = 0xFD;       // '='
+
+        constexpr std::array<uint8_t, 256> DECODE = [] {
+            std::array<uint8_t, 256> table{};
+            for (auto &entry: table) entry = INVALID;
+            for (uint8_t i = 0; i < 64; i++) table[static_cast<uint8_t>(ALPHABET[i])] = i;
+            for (char c: {' ', '\t', '\n', '\v', '\f', '\r'}) table[static_cast<uint8_t>(c)] = SKIP;
+            table['='] = PAD;
+            return table;
+        }();
+
+        // The two characters of every 12-bit value.
+        constexpr std::array<char, 8192> PAIRS = [] {
+            std::array<char, 8192> table{};
+            for (size_t i = 0; i < 4096; i++) {
+                table[2 * i] = ALPHABET[i >> 6];
+                table[2 * i + 1] = ALPHABET[i & 63];
+            }
+            return table;
+        }();
+
+        void encode_scalar(char *out, const uint8_t *data, size_t size) {
+            size_t i = 0;
+            for (; i + 3 <= size; i += 3) {
+                uint32_t value = static_cast<uint32_t>(data[i]) << 16 | static_cast<uint32_t>(data[i + 1]) << 8 |
+                                 data[i + 2];
+                std::memcpy(out, &PAIRS[2 * (value >> 12)], 2);
+                std::memcpy(out + 2, &PAIRS[2 * (value & 0xFFF)], 2);
+                out += 4;
+            }
+            if (i == size) return;
+            uint32_t value = static_cast<uint32_t>(data[i]) << 16;
+            if (i + 1 < size) value |= static_cast<uint32_t>(data[i + 1]) << 8;
+            out[0] = ALPHABET[value >> 18];
+            out[1] = ALPHABET[(value >> 12) & 63];
+            out[2] = i + 1 < size ? ALPHABET[(value >> 6) & 63] : '=';
+            out[3] = '=';
+        }
+
+        // Everything the SIMD kernels left over: whole quads straight through
+        // the table while they are clean, otherwise one character at a time.
+        size_t decode_scalar(uint8_t *out, const char *text, size_t size) {
+            const auto *in = reinterpret_cast<const uint8_t *>(text);
+            size_t o = 0;
+            uint32_t value = 0;
+            int bits = 0;
+            for (size_t i = 0; i < size;) {
+                if (bits == 0 && i + 4 <= size) {
+                    uint32_t a = DECODE[in[i]], b = DECODE[in[i + 1]], c = DECODE[in[i + 2]], d = DECODE[in[i + 3]];
+                    if (!((a | b | c | d) & 0x80)) {
+                        uint32_t quad = a << 18 | b << 12 | c << 6 | d;
+                        out[o] = static_cast<uint8_t>(quad >> 16);
+                        out[o + 1] = static_cast<uint8_t>(quad >> 8);
+                        out[o + 2] = static_cast<uint8_t>(quad);
+                        o += 3;
+                        i += 4;
+                        continue;
+                    }
+                }
+                uint8_t digit = DECODE[in[i++]];
+                if (digit == SKIP) continue;
+                if (digit == PAD) break;
+                if (digit == INVALID) throw std::invalid_argument("Invalid Base64 character");
+                value = value << 6 | digit;
+                bits += 6;
+                if (bits >= 8) {
+                    bits -= 8;
+                    out[o++] = static_cast<uint8_t>(value >> bits);
+                    if (bits == 0) value = 0;
+                }
+            }
+            return o;
+        }
+
+        // Bytes consumed (whole 3-byte groups) from `data`.
+        using EncodeKernel = size_t (*)(char *out, const uint8_t *data, size_t size);
+        // Bytes written; `used` is set to the characters consumed.
+        using DecodeKernel = size_t (*)(uint8_t *out, const char *text, size_t size, size_t &used);
+
+#ifdef PYSER_BASE64_X86
+        // Character codes of the 6-bit values in `indices`.
+        PYSER_TARGET("ssse3") inline __m128i encode_lookup(__m128i indices) {
+            const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                  '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                                  '/' - 63, 'A', 0, 0);
+            __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+            __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+            range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+            return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+        }
+
+        PYSER_TARGET("ssse3") size_t encode_ssse3(char *out, const uint8_t *data, size_t size) {
+            const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+            size_t i = 0;
+            for (; i + 16 <= size; i += 12) {
+                __m128i in = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)), spread);
+                __m128i high = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00)),
+                                               _mm_set1_epi32(0x04000040));
+                __m128i low = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003F03F0)),
+                                              _mm_set1_epi32(0x01000010));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i / 3 * 4), encode_lookup(_mm_or_si128(high, low)));
+            }
+            return i;
+        }
+
+        PYSER_TARGET("avx2") inline __m256i encode_lookup(__m256i indices) {
+            const __m256i offsets = _mm256_broadcastsi128_si256(
+                _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                              '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0));
+            __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+            __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+            range = _mm256_or_si256(range, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+            return _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, range));
+        }
+
+        PYSER_TARGET("avx2") size_t encode_avx2(char *out, const uint8_t *data, size_t size) {
+            const __m256i spread = _mm256_broadcastsi128_si256(
+                _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+            size_t i = 0;
+            for (; i + 28 <= size; i += 24) {
+                __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+                __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 12));
+                __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(first), second, 1);
+                in = _mm256_shuffle_epi8(in, spread);
+                __m256i high = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00)),
+                                                  _mm256_set1_epi32(0x04000040));
+                __m256i low = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0)),
+                                                 _mm256_set1_epi32(0x01000010));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i / 3 * 4),
+                                    encode_lookup(_mm256_or_si256(high, low)));
+            }
+            return i;
+        }
+
+        // 16 characters to their 6-bit values in place; false if any is not in
+        // the alphabet.
+        PYSER_TARGET("ssse3") inline bool decode_lookup(__m128i &chars) {
+            const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                                 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+            const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                                 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+            const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+            const __m128i mask_2f = _mm_set1_epi8(0x2F);
+            __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(chars, 4), mask_2f);
+            __m128i lo_nibbles = _mm_and_si128(chars, mask_2f);
+            __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+            __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+            if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128()))) return false;
+            __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(chars, mask_2f), hi_nibbles));
+            chars = _mm_add_epi8(chars, roll);
+            return true;
+        }
+
+        // Four 6-bit values per lane to three bytes, packed into the low 12
+        // bytes.
+        PYSER_TARGET("ssse3") inline __m128i decode_pack(__m128i values) {
+            __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+            __m128i triples = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+            return _mm_shuffle_epi8(triples, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        }
+
+        PYSER_TARGET("ssse3") size_t decode_ssse3(uint8_t *out, const char *text, size_t size, size_t &used) {
+            size_t i = 0, o = 0;
+            // 32 characters left keep the 16-byte store within the output.
+            for (; i + 32 <= size; i += 16, o += 12) {
+                __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i));
+                if (!decode_lookup(chars)) break;
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + o), decode_pack(chars));
+            }
+            used = i;
+            return o;
+        }
+
+        PYSER_TARGET("avx2") size_t decode_avx2(uint8_t *out, const char *text, size_t size, size_t &used) {
+            const __m256i lut_lo = _mm256_broadcastsi128_si256(
+                _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                              0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A));
+            const __m256i lut_hi = _mm256_broadcastsi128_si256(
+                _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                              0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10));
+            const __m256i lut_roll = _mm256_broadcastsi128_si256(
+                _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0));
+            const __m256i pack = _mm256_broadcastsi128_si256(
+                _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+            const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+            const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+            size_t i = 0, o = 0;
+            // 64 characters left keep the 32-byte store within the output.
+            for (; i + 64 <= size; i += 32, o += 24) {
+                __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i));
+                __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(chars, 4), mask_2f);
+                __m256i lo_nibbles = _mm256_and_si256(chars, mask_2f);
+                __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+                __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+                if (_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256()))) break;
+                __m256i roll = _mm256_shuffle_epi8(lut_roll,
+                                                   _mm256_add_epi8(_mm256_cmpeq_epi8(chars, mask_2f), hi_nibbles));
+                chars = _mm256_add_epi8(chars, roll);
+                __m256i pairs = _mm256_maddubs_epi16(chars, _mm256_set1_epi32(0x01400140));
+                __m256i triples = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+                __m256i bytes = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(triples, pack), join);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + o), bytes);
+            }
+            used = i;
+            return o;
+        }
+
+        bool cpu_has(bool avx2) {
+#if defined(_MSC_VER) && !defined(__clang__)
+            int regs[4];
+            __cpuid(regs, 1);
+            bool ssse3 = regs[2] & (1 << 9);
+            if (!avx2) return ssse3;
+            bool os_avx = (regs[2] & (1 << 27)) && (regs[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+            __cpuidex(regs, 7, 0);
+            return os_avx && (regs[1] & (1 << 5));
+#else
+            return avx2 ? __builtin_cpu_supports("avx2") : __builtin_cpu_supports("ssse3");
+#endif
+        }
+#endif
+
+        size_t no_encode_kernel(char *, const uint8_t *, size_t) { return 0; }
+
+        size_t no_decode_kernel(uint8_t *, const char *, size_t, size_t &used) {
+            used = 0;
+            return 0;
+        }
+
+        struct Kernels {
+            EncodeKernel encode = no_encode_kernel;
+            DecodeKernel decode = no_decode_kernel;
+        };
+
+        const Kernels &kernels() {
+            static const Kernels selected = [] {
+                Kernels k;
+#ifdef PYSER_BASE64_X86
+                if (cpu_has(true)) {
+                    k.encode = encode_avx2;
+                    k.decode = decode_avx2;
+                } else if (cpu_has(false)) {
+                    k.encode = encode_ssse3;
+                    k.decode = decode_ssse3;
+                }
+#endif
+                return k;
+            }();
+            return selected;
+        }
+    } // namespace
+
+    void encode(char *out, const uint8_t *data, size_t size) {
+        size_t done = kernels().encode(out, data, size);
+        encode_scalar(out + done / 3 * 4, data + done, size - done);
+    }
+
+    size_t decode(uint8_t *out, const char *text, size_t size) {
+        size_t used;
+        size_t written = kernels().decode(out, text, size, used);
+        return written + decode_scalar(out + written, text + used, size - used);
+    }
+} // namespace base64
@@ -0,0 +1,151 @@
+// chunk_encoder.cpp
+// Parallel base64/SHA-256 stage of the graph format (see chunk_encoder.h).
+#include "chunk_encoder.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <semaphore>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <openssl/sha.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#include "allow_threads.h"
+#include "base64.h"
+#include "pyser.hpp"
+
+namespace pyser {
+    namespace {
+        void encode_chunk(DataChunk &chunk) {
+            std::span<const uint8_t> bytes = chunk.bytes();
+            base64::encode(chunk.base64_data.data(), bytes.data(), bytes.size());
+            sha256_hex(bytes.data(), bytes.size(), chunk.sha256_hash.data());
+        }
+
+        // Helper threads kept for the life of the process. A call lends the
+        // pool to one encode_chunks() at a time; concurrent calls that find
+        // it busy encode on their own thread instead of waiting.
+        class WorkerPool {
+        public:
+            // Run `work` on the calling thread and on up to `helpers` pool
+            // threads, returning once every one of them is done with it.
+            void run(unsigned helpers, const std::function<void()> &work) {
+                std::unique_lock<std::mutex> owner(mutex_, std::try_to_lock);
+                if (!owner.owns_lock()) {
+                    // The pool's state belongs to the call holding it.
+                    work();
+                    return;
+                }
+                while (started_ < helpers) {
+                    try {
+                        std::thread([this] { loop(); }).detach();
+                    } catch (const std::system_error &) {
+                        break;  // encode on the threads already started
+                    }
+                    started_++;
+                }
+                helpers = std::min(helpers, started_);
+                job_ = &work;
+                busy_ = helpers;
+                wake_.release(helpers);
+                work();
+                for (unsigned busy; (busy = busy_.load()) != 0;) busy_.wait(busy);
+                job_ = nullptr;
+            }
+
+        private:
+            void loop() {
+                while (true) {
+                    wake_.acquire();
+                    (*job_)();
+                    if (busy_.fetch_sub(1) == 1) busy_.notify_one();
+                }
+            }
+
+            std::mutex mutex_;          // held by the call using the pool; guards all below
+            std::counting_semaphore<> wake_{0};
+            const std::function<void()> *job_ = nullptr;
+            unsigned started_ = 0;      // threads running loop()
+            std::atomic<unsigned> busy_{0};  // helpers not done with job_ yet
+        };
+
+        // Never destroyed: its threads block in loop() until the process
+        // exits. Created with the GIL held.
+        WorkerPool *pool = nullptr;
+
+        WorkerPool &worker_pool() {
+            if (!pool) {
+#ifndef _WIN32
+                static bool registered = false;
+                if (!registered) {
+                    // The threads do not survive fork(); the child starts a
+                    // pool of its own (the parent's is leaked, its locks may
+                    // be held).
+                    pthread_atfork(nullptr, nullptr, [] { pool = nullptr; });
+                    registered = true;
+                }
+#endif
+                pool = new WorkerPool;
+            }
+            return *pool;
+        }
+
+        // Threads to encode `total` bytes in `count` chunks on.
+        unsigned encode_threads(size_t count, size_t total) {
+            // PYSER_ENCODE_THREADS overrides the number of cores, e.g. to
+            // compare against a single-threaded encode.
+            const char *setting = std::getenv("PYSER_ENCODE_THREADS");
+            unsigned cores = setting ? static_cast<unsigned>(std::strtoul(setting, nullptr, 10))
+                                     : std::thread::hardware_concurrency();
+            return std::min({
+                std::max(cores, 1u), ENCODE_MAX_THREADS,
+                static_cast<unsigned>(std::min<size_t>(count, total / ENCODE_BYTES_PER_THREAD + 1))
+            });
+        }
+    } // namespace
+
+    void sha256_hex(const uint8_t *data, size_t size, char *out) {
+        static constexpr char digits[] = "0123456789abcdef";
+        unsigned char hash[SHA256_DIGEST_LENGTH];
+        SHA256(data, size, hash);
+        for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+            out[i * 2] = digits[hash[i] >> 4];
+            out[i * 2 + 1] = digits[hash[i] & 0xf];
+        }
+    }
+
+    void encode_chunks(SerializedGraph &graph) {
+        std::vector<DataChunk *> chunks;
+        size_t total = 0;
+        for (SerializedNode &node: graph.nodes) {
+            for (DataChunk &chunk: node.chunks) {
+                chunk.base64_data.resize(base64::encoded_size(chunk.original_size));
+                chunk.sha256_hash.resize(SHA256_HEX_SIZE);
+                if (chunk.writable) {
+                    // Another thread could write to it once the GIL is gone.
+                    encode_chunk(chunk);
+                    continue;
+                }
+                chunks.push_back(&chunk);
+                total += chunk.original_size;
+            }
+        }
+
+        unsigned threads = encode_threads(chunks.size(), total);
+        WorkerPool *workers = threads > 1 ? &worker_pool() : nullptr;
+        AllowThreads nogil(total >= ALLOW_THREADS_MIN_SIZE);
+        std::atomic<size_t> next{0};
+        std::function<void()> work = [&] {
+            for (size_t i = next++; i < chunks.size(); i = next++) encode_chunk(*chunks[i]);
+        };
+        if (workers) {
+            workers->run(threads - 1, work);
+        } else {
+            work();
+        }
+    }
+} // namespace pyser
@@ -0,0 +1,40 @@
+// chunk_encoder.h
+// The encode stage of the graph format: base64 and SHA-256 of every chunk,
+// run once the walk has finished.
+//
+// Notes:
+// - The walk (PyObjectSerializer::serialize) only captures each chunk's bytes,
+//   as a copy or as a view of a buffer the graph holds; encode_chunks() then
+//   fills base64_data and sha256_hash without the GIL. Views of writable
+//   buffers (bytearray, writable memoryviews and arrays) are the exception:
+//   they are encoded first, on the calling thread, while the GIL still keeps
+//   other threads from changing them.
+// - Large graphs are encoded on up to ENCODE_MAX_THREADS threads, each taking
+//   the next chunk in turn: the calling thread plus helpers from a pool that
+//   is started on first use and kept for the life of the process. Every chunk
+//   is encoded on its own, so the output is the same whatever the number of
+//   threads. The PYSER_ENCODE_THREADS environment variable, if set, replaces
+//   the number of cores in that count.
+// - The graph arena is not thread-safe: all strings are sized up front on the
+//   calling thread, and workers only write into them.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace pyser {
+    struct SerializedGraph;
+
+    constexpr size_t SHA256_HEX_SIZE = 64;
+    // Chunk bytes below which another thread is not worth starting.
+    constexpr size_t ENCODE_BYTES_PER_THREAD = 1024 * 1024;
+    constexpr unsigned ENCODE_MAX_THREADS = 8;
+
+    // Lowercase hex SHA-256 of `data` into `out` (SHA256_HEX_SIZE chars, not
+    // terminated).
+    void sha256_hex(const uint8_t *data, size_t size, char *out);
+
+    // Fill base64_data and sha256_hash of every chunk of `graph`. Must be
+    // called with the GIL held; it is released while large graphs are encoded.
+    void encode_chunks(SerializedGraph &graph);
+} // namespace pyser
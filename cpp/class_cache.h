@@ -0,0 +1,174 @@
+// class_cache.h
+// Resolves (module, type name) pairs to classes, (module, qualified name)
+// pairs to globals and module names to modules once instead of once per
+// CUSTOM/GLOBAL/MODULE record.
+//
+// Notes:
+// - Entries hold strong references and are keyed by "module\0type" (classes)
+//   or "module\1qualname" (globals).
+// - A cached entry is trusted for the rest of the current epoch only. The
+//   first hit in a new epoch (new_epoch() is called once per load) checks that
+//   sys.modules still holds the same module and that the module attribute is
+//   still the same class, so importlib.reload() or a replaced sys.modules entry
+//   is picked up on the next load rather than returning a stale class.
+// - Failed lookups are cached too (cls == nullptr), so unimportable local
+//   classes do not retry the import for every instance.
+
+#pragma once
+#include <Python.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace pyser {
+    // Follow a dotted attribute path ("Outer.Inner.method") from `root`.
+    // Returns a new reference, or nullptr with the error set.
+    inline PyObject *get_dotted(PyObject *root, std::string_view path) {
+        Py_INCREF(root);
+        PyObject *current = root;
+        while (current) {
+            size_t dot = path.find('.');
+            std::string part(path.substr(0, dot));
+            PyObject *next = PyObject_GetAttrString(current, part.c_str());
+            Py_DECREF(current);
+            current = next;
+            if (dot == std::string_view::npos) break;
+            path.remove_prefix(dot + 1);
+        }
+        return current;
+    }
+
+    class ClassCache {
+    public:
+        ClassCache() = default;
+
+        ClassCache(const ClassCache &) = delete;
+
+        ClassCache &operator=(const ClassCache &) = delete;
+
+        ~ClassCache() { clear(); }
+
+        void new_epoch() { epoch_++; }
+
+        void clear() {
+            for (auto &[key, entry]: entries_) {
+                Py_XDECREF(entry.module);
+                Py_XDECREF(entry.cls);
+            }
+            entries_.clear();
+        }
+
+        // Class named `type_name` in `module_name`, falling back to builtins when
+        // the module cannot be imported. Returns a borrowed reference, or
+        // nullptr (no error set) if there is no such class.
+        PyObject *lookup_class(std::string_view module_name, std::string_view type_name) {
+            Entry &entry = find(module_name, type_name);
+            if (entry.epoch != epoch_) {
+                if (entry.epoch == 0 || !still_valid(entry, module_name, type_name)) {
+                    resolve_class(entry, module_name, type_name);
+                }
+                entry.epoch = epoch_;
+            }
+            return entry.cls;
+        }
+
+        // Object reached from module `module_name` by the dotted `qualname`, the
+        // way pickle resolves classes and functions stored by reference. Returns
+        // a borrowed reference, or nullptr with the error set.
+        PyObject *lookup_global(std::string_view module_name, std::string_view qualname) {
+            Entry &entry = find(module_name, qualname, '\1');
+            if (entry.epoch != epoch_ || !entry.cls) {
+                if (entry.epoch == 0 || !entry.cls || !still_valid(entry, module_name, qualname)) {
+                    Py_CLEAR(entry.module);
+                    Py_CLEAR(entry.cls);
+                    entry.module = import(module_name);
+                    entry.cls = entry.module ? get_dotted(entry.module, qualname) : nullptr;
+                    if (!entry.cls) return nullptr;
+                }
+                entry.epoch = epoch_;
+            }
+            return entry.cls;
+        }
+
+        // Imported module `module_name`. Returns a borrowed reference, or
+        // nullptr with the import error set.
+        PyObject *lookup_module(std::string_view module_name) {
+            Entry &entry = find(module_name, {});
+            if (entry.epoch != epoch_ || !entry.module) {
+                if (entry.epoch == 0 || !entry.module || !still_valid(entry, module_name, {})) {
+                    Py_CLEAR(entry.module);
+                    entry.module = import(module_name);
+                    if (!entry.module) return nullptr;
+                }
+                entry.epoch = epoch_;
+            }
+            return entry.module;
+        }
+
+    private:
+        struct Entry {
+            PyObject *module = nullptr; // owned; nullptr when resolved from builtins
+            PyObject *cls = nullptr;    // owned class or global; nullptr when not found
+            uint64_t epoch = 0;
+        };
+
+        Entry &find(std::string_view module_name, std::string_view type_name, char separator = '\0') {
+            key_.assign(module_name);
+            key_.push_back(separator);
+            key_.append(type_name);
+            return entries_[key_];
+        }
+
+        static PyObject *import(std::string_view module_name) {
+            PyObject *name = PyUnicode_FromStringAndSize(module_name.data(),
+                                                         static_cast<Py_ssize_t>(module_name.size()));
+            if (!name) return nullptr;
+            PyObject *module = PyImport_Import(name);
+            Py_DECREF(name);
+            return module;
+        }
+
+        // Cheap revalidation: one sys.modules lookup plus one attribute lookup.
+        static bool still_valid(const Entry &entry, std::string_view module_name, std::string_view type_name) {
+            if (!entry.module) return type_name.empty() ? false : entry.cls != nullptr;
+            PyObject *name = PyUnicode_FromStringAndSize(module_name.data(),
+                                                         static_cast<Py_ssize_t>(module_name.size()));
+            PyObject *current = name ? PyImport_GetModule(name) : nullptr;
+            Py_XDECREF(name);
+            bool valid = current == entry.module;
+            Py_XDECREF(current);
+            if (valid && !type_name.empty()) {
+                PyObject *cls = get_dotted(entry.module, type_name);
+                valid = cls == entry.cls;
+                Py_XDECREF(cls);
+            }
+            PyErr_Clear();
+            return valid;
+        }
+
+        static void resolve_class(Entry &entry, std::string_view module_name, std::string_view type_name) {
+            Py_CLEAR(entry.module);
+            Py_CLEAR(entry.cls);
+            std::string type_str(type_name);
+            if (!module_name.empty()) {
+                entry.module = import(module_name);
+            }
+            if (entry.module) {
+                entry.cls = PyObject_GetAttrString(entry.module, type_str.c_str());
+            } else {
+                PyErr_Clear();
+                entry.cls = PyDict_GetItemString(PyEval_GetBuiltins(), type_str.c_str());
+                Py_XINCREF(entry.cls);
+            }
+            PyErr_Clear();
+            if (entry.cls && !PyType_Check(entry.cls)) {
+                Py_CLEAR(entry.cls);
+            }
+        }
+
+        std::unordered_map<std::string, Entry> entries_;
+        std::string key_;
+        uint64_t epoch_ = 1;
+    };
+} // namespace pyser
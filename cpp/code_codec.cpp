@@ -0,0 +1,518 @@
+// code_codec.cpp
+// Binary code object encoding and the process-wide code cache (see
+// code_codec.h).
+#include "code_codec.h"
+#include <cstring>
+
+namespace pyser {
+    namespace {
+        // Constant tags.
+        enum ConstTag : uint8_t {
+            CONST_NONE = 'N',
+            CONST_TRUE = 'T',
+            CONST_FALSE = 'F',
+            CONST_ELLIPSIS = 'E',
+            CONST_INT = 'i',        // zigzag varint
+            CONST_BIGINT = 'I',     // varint byte count, signed little-endian bytes
+            CONST_FLOAT = 'f',      // IEEE 754 double, little endian
+            CONST_COMPLEX = 'x',    // two doubles
+            CONST_STR = 's',        // varint length, UTF-8 (surrogatepass)
+            CONST_BYTES = 'b',      // varint length, raw bytes
+            CONST_TUPLE = 't',      // varint count, constants
+            CONST_FROZENSET = 'z',  // varint count, constants
+            CONST_CODE = 'c',       // code body
+        };
+
+        constexpr char CODE_MAGIC = 'C';
+
+        void put_varint(std::string &out, uint64_t value) {
+            while (value >= 0x80) {
+                out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<char>(value));
+        }
+
+        void put_bytes(std::string &out, const char *data, size_t size) {
+            put_varint(out, size);
+            out.append(data, size);
+        }
+
+        void put_double(std::string &out, double value) {
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            for (int i = 0; i < 8; i++) out.push_back(static_cast<char>(bits >> (8 * i)));
+        }
+
+        bool put_str(std::string &out, PyObject *str) {
+            Py_ssize_t size;
+            const char *data = PyUnicode_AsUTF8AndSize(str, &size);
+            if (data) {
+                put_bytes(out, data, size);
+                return true;
+            }
+            // Lone surrogates have no strict UTF-8 form.
+            PyErr_Clear();
+            PyObject *encoded = PyUnicode_AsEncodedString(str, "utf-8", "surrogatepass");
+            if (!encoded) return false;
+            put_bytes(out, PyBytes_AS_STRING(encoded), PyBytes_GET_SIZE(encoded));
+            Py_DECREF(encoded);
+            return true;
+        }
+
+        bool put_int_attr(std::string &out, PyObject *code, const char *name) {
+            PyObject *value = PyObject_GetAttrString(code, name);
+            if (!value) return false;
+            long v = PyLong_AsLong(value);
+            Py_DECREF(value);
+            if (v == -1 && PyErr_Occurred()) return false;
+            put_varint(out, static_cast<uint64_t>(v));
+            return true;
+        }
+
+        bool put_bytes_attr(std::string &out, PyObject *code, const char *name) {
+            PyObject *value = PyObject_GetAttrString(code, name);
+            if (!value) return false;
+            bool ok = PyBytes_Check(value);
+            if (ok) {
+                put_bytes(out, PyBytes_AS_STRING(value), PyBytes_GET_SIZE(value));
+            } else {
+                PyErr_Format(PyExc_TypeError, "code.%s is not bytes", name);
+            }
+            Py_DECREF(value);
+            return ok;
+        }
+
+        bool put_str_attr(std::string &out, PyObject *code, const char *name) {
+            PyObject *value = PyObject_GetAttrString(code, name);
+            if (!value) return false;
+            bool ok = PyUnicode_Check(value) && put_str(out, value);
+            if (!ok && !PyErr_Occurred()) PyErr_Format(PyExc_TypeError, "code.%s is not a str", name);
+            Py_DECREF(value);
+            return ok;
+        }
+
+        bool put_names_attr(std::string &out, PyObject *code, const char *name) {
+            PyObject *value = PyObject_GetAttrString(code, name);
+            if (!value) return false;
+            bool ok = PyTuple_Check(value);
+            if (ok) {
+                put_varint(out, PyTuple_GET_SIZE(value));
+                for (Py_ssize_t i = 0; ok && i < PyTuple_GET_SIZE(value); i++) {
+                    PyObject *item = PyTuple_GET_ITEM(value, i);
+                    ok = PyUnicode_Check(item) && put_str(out, item);
+                }
+            }
+            if (!ok && !PyErr_Occurred()) PyErr_Format(PyExc_TypeError, "code.%s is not a tuple of str", name);
+            Py_DECREF(value);
+            return ok;
+        }
+
+        bool put_code_body(std::string &out, PyObject *code);
+
+        bool put_const(std::string &out, PyObject *obj) {
+            if (obj == Py_None) {
+                out.push_back(CONST_NONE);
+            } else if (obj == Py_True || obj == Py_False) {
+                out.push_back(obj == Py_True ? CONST_TRUE : CONST_FALSE);
+            } else if (obj == Py_Ellipsis) {
+                out.push_back(CONST_ELLIPSIS);
+            } else if (PyLong_CheckExact(obj)) {
+                int overflow;
+                long long value = PyLong_AsLongLongAndOverflow(obj, &overflow);
+                if (overflow == 0) {
+                    if (value == -1 && PyErr_Occurred()) return false;
+                    out.push_back(CONST_INT);
+                    put_varint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+                    return true;
+                }
+                size_t n_bytes = _PyLong_NumBits(obj) / 8 + 1;
+                std::string raw(n_bytes, '\0');
+                auto *long_obj = reinterpret_cast<PyLongObject *>(obj);
+                auto *dst = reinterpret_cast<unsigned char *>(raw.data());
+#if PY_VERSION_HEX >= 0x030D0000
+                if (_PyLong_AsByteArray(long_obj, dst, n_bytes, 1, 1, 1) < 0) return false;
+#else
+                if (_PyLong_AsByteArray(long_obj, dst, n_bytes, 1, 1) < 0) return false;
+#endif
+                out.push_back(CONST_BIGINT);
+                put_bytes(out, raw.data(), raw.size());
+            } else if (PyFloat_CheckExact(obj)) {
+                out.push_back(CONST_FLOAT);
+                put_double(out, PyFloat_AS_DOUBLE(obj));
+            } else if (PyComplex_CheckExact(obj)) {
+                out.push_back(CONST_COMPLEX);
+                put_double(out, PyComplex_RealAsDouble(obj));
+                put_double(out, PyComplex_ImagAsDouble(obj));
+            } else if (PyUnicode_CheckExact(obj)) {
+                out.push_back(CONST_STR);
+                return put_str(out, obj);
+            } else if (PyBytes_CheckExact(obj)) {
+                out.push_back(CONST_BYTES);
+                put_bytes(out, PyBytes_AS_STRING(obj), PyBytes_GET_SIZE(obj));
+            } else if (PyTuple_CheckExact(obj)) {
+                out.push_back(CONST_TUPLE);
+                put_varint(out, PyTuple_GET_SIZE(obj));
+                for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(obj); i++) {
+                    if (!put_const(out, PyTuple_GET_ITEM(obj, i))) return false;
+                }
+            } else if (PyFrozenSet_CheckExact(obj)) {
+                out.push_back(CONST_FROZENSET);
+                put_varint(out, PySet_GET_SIZE(obj));
+                PyObject *iter = PyObject_GetIter(obj);
+                if (!iter) return false;
+                PyObject *item;
+                while ((item = PyIter_Next(iter))) {
+                    bool ok = put_const(out, item);
+                    Py_DECREF(item);
+                    if (!ok) break;
+                }
+                Py_DECREF(iter);
+                return !PyErr_Occurred();
+            } else if (PyCode_Check(obj)) {
+                out.push_back(CONST_CODE);
+                return put_code_body(out, obj);
+            } else {
+                PyErr_Format(PyExc_TypeError, "Unsupported code constant of type '%s'", Py_TYPE(obj)->tp_name);
+                return false;
+            }
+            return true;
+        }
+
+        bool put_code_body(std::string &out, PyObject *code) {
+            static const char *const int_fields[] = {
+                "co_argcount", "co_posonlyargcount", "co_kwonlyargcount", "co_nlocals",
+                "co_stacksize", "co_flags", "co_firstlineno",
+            };
+            for (const char *field: int_fields) {
+                if (!put_int_attr(out, code, field)) return false;
+            }
+            if (!put_bytes_attr(out, code, "co_code")) return false;
+            PyObject *consts = PyObject_GetAttrString(code, "co_consts");
+            if (!consts) return false;
+            bool ok = PyTuple_Check(consts);
+            if (ok) {
+                put_varint(out, PyTuple_GET_SIZE(consts));
+                for (Py_ssize_t i = 0; ok && i < PyTuple_GET_SIZE(consts); i++) {
+                    ok = put_const(out, PyTuple_GET_ITEM(consts, i));
+                }
+            }
+            Py_DECREF(consts);
+            if (!ok) return false;
+            return put_names_attr(out, code, "co_names") &&
+                   put_names_attr(out, code, "co_varnames") &&
+                   put_names_attr(out, code, "co_freevars") &&
+                   put_names_attr(out, code, "co_cellvars") &&
+                   put_str_attr(out, code, "co_filename") &&
+                   put_str_attr(out, code, "co_name") &&
+#if PY_VERSION_HEX >= 0x030B0000
+                   put_str_attr(out, code, "co_qualname") &&
+                   put_bytes_attr(out, code, "co_linetable") &&
+                   put_bytes_attr(out, code, "co_exceptiontable");
+#elif PY_VERSION_HEX >= 0x030A0000
+                   put_bytes_attr(out, code, "co_linetable");
+#else
+                   put_bytes_attr(out, code, "co_lnotab");
+#endif
+        }
+
+        // Bounds-checked reader over one encoding. Every failure sets
+        // ValueError.
+        struct Reader {
+            const char *pos;
+            const char *end;
+
+            bool fail() {
+                if (!PyErr_Occurred()) PyErr_SetString(PyExc_ValueError, "Malformed code object encoding");
+                return false;
+            }
+
+            bool u8(uint8_t &value) {
+                if (pos == end) return fail();
+                value = static_cast<uint8_t>(*pos++);
+                return true;
+            }
+
+            bool varint(uint64_t &value) {
+                value = 0;
+                for (int shift = 0; shift < 64; shift += 7) {
+                    uint8_t byte;
+                    if (!u8(byte)) return false;
+                    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                    if (!(byte & 0x80)) return true;
+                }
+                return fail();
+            }
+
+            bool integer(int &value) {
+                uint64_t raw;
+                if (!varint(raw)) return false;
+                value = static_cast<int>(static_cast<int64_t>(raw));
+                return true;
+            }
+
+            bool view(const char *&data, size_t &size) {
+                uint64_t n;
+                if (!varint(n)) return false;
+                if (n > static_cast<uint64_t>(end - pos)) return fail();
+                data = pos;
+                size = static_cast<size_t>(n);
+                pos += size;
+                return true;
+            }
+
+            bool real(double &value) {
+                if (end - pos < 8) return fail();
+                uint64_t bits = 0;
+                for (int i = 0; i < 8; i++) bits |= static_cast<uint64_t>(static_cast<uint8_t>(pos[i])) << (8 * i);
+                pos += 8;
+                std::memcpy(&value, &bits, sizeof(value));
+                return true;
+            }
+
+            PyObject *bytes() {
+                const char *data;
+                size_t size;
+                if (!view(data, size)) return nullptr;
+                return PyBytes_FromStringAndSize(data, static_cast<Py_ssize_t>(size));
+            }
+
+            PyObject *str() {
+                const char *data;
+                size_t size;
+                if (!view(data, size)) return nullptr;
+                return PyUnicode_DecodeUTF8(data, static_cast<Py_ssize_t>(size), "surrogatepass");
+            }
+
+            PyObject *names() {
+                uint64_t n;
+                if (!varint(n)) return nullptr;
+                if (n > static_cast<uint64_t>(end - pos)) return fail(), nullptr;
+                PyObject *tuple = PyTuple_New(static_cast<Py_ssize_t>(n));
+                for (Py_ssize_t i = 0; tuple && i < static_cast<Py_ssize_t>(n); i++) {
+                    PyObject *name = str();
+                    if (!name) Py_CLEAR(tuple);
+                    else PyTuple_SET_ITEM(tuple, i, name);
+                }
+                return tuple;
+            }
+
+            PyObject *constant();
+
+            PyObject *code_body();
+        };
+
+        PyObject *Reader::constant() {
+            uint8_t tag;
+            if (!u8(tag)) return nullptr;
+            switch (tag) {
+                case CONST_NONE:
+                    Py_RETURN_NONE;
+                case CONST_TRUE:
+                    Py_RETURN_TRUE;
+                case CONST_FALSE:
+                    Py_RETURN_FALSE;
+                case CONST_ELLIPSIS:
+                    Py_INCREF(Py_Ellipsis);
+                    return Py_Ellipsis;
+                case CONST_INT: {
+                    uint64_t raw;
+                    if (!varint(raw)) return nullptr;
+                    auto value = static_cast<long long>((raw >> 1) ^ (~(raw & 1) + 1));
+                    return PyLong_FromLongLong(value);
+                }
+                case CONST_BIGINT: {
+                    const char *data;
+                    size_t size;
+                    if (!view(data, size)) return nullptr;
+                    return _PyLong_FromByteArray(reinterpret_cast<const unsigned char *>(data), size, 1, 1);
+                }
+                case CONST_FLOAT: {
+                    double value;
+                    if (!real(value)) return nullptr;
+                    return PyFloat_FromDouble(value);
+                }
+                case CONST_COMPLEX: {
+                    double re, im;
+                    if (!real(re) || !real(im)) return nullptr;
+                    return PyComplex_FromDoubles(re, im);
+                }
+                case CONST_STR:
+                    return str();
+                case CONST_BYTES:
+                    return bytes();
+                case CONST_TUPLE:
+                case CONST_FROZENSET: {
+                    uint64_t n;
+                    if (!varint(n)) return nullptr;
+                    if (n > static_cast<uint64_t>(end - pos)) return fail(), nullptr;
+                    PyObject *tuple = PyTuple_New(static_cast<Py_ssize_t>(n));
+                    for (Py_ssize_t i = 0; tuple && i < static_cast<Py_ssize_t>(n); i++) {
+                        PyObject *item = constant();
+                        if (!item) Py_CLEAR(tuple);
+                        else PyTuple_SET_ITEM(tuple, i, item);
+                    }
+                    if (!tuple || tag == CONST_TUPLE) return tuple;
+                    PyObject *set = PyFrozenSet_New(tuple);
+                    Py_DECREF(tuple);
+                    return set;
+                }
+                case CONST_CODE:
+                    return code_body();
+                default:
+                    return fail(), nullptr;
+            }
+        }
+
+        PyObject *Reader::code_body() {
+            int argcount, posonly, kwonly, nlocals, stacksize, flags, firstlineno;
+            if (!integer(argcount) || !integer(posonly) || !integer(kwonly) || !integer(nlocals) ||
+                !integer(stacksize) || !integer(flags) || !integer(firstlineno)) {
+                return nullptr;
+            }
+            PyObject *bytecode = bytes();
+            PyObject *consts = nullptr;
+            uint64_t n_consts;
+            if (bytecode && varint(n_consts)) {
+                if (n_consts > static_cast<uint64_t>(end - pos)) {
+                    fail();
+                } else {
+                    consts = PyTuple_New(static_cast<Py_ssize_t>(n_consts));
+                }
+                for (Py_ssize_t i = 0; consts && i < static_cast<Py_ssize_t>(n_consts); i++) {
+                    PyObject *item = constant();
+                    if (!item) Py_CLEAR(consts);
+                    else PyTuple_SET_ITEM(consts, i, item);
+                }
+            }
+            PyObject *names = consts ? this->names() : nullptr;
+            PyObject *varnames = names ? this->names() : nullptr;
+            PyObject *freevars = varnames ? this->names() : nullptr;
+            PyObject *cellvars = freevars ? this->names() : nullptr;
+            PyObject *filename = cellvars ? str() : nullptr;
+            PyObject *name = filename ? str() : nullptr;
+            PyObject *code = nullptr;
+#if PY_VERSION_HEX >= 0x030B0000
+            PyObject *qualname = name ? str() : nullptr;
+            PyObject *linetable = qualname ? bytes() : nullptr;
+            PyObject *exceptiontable = linetable ? bytes() : nullptr;
+            if (exceptiontable) {
+#if PY_VERSION_HEX >= 0x030C0000
+                code = reinterpret_cast<PyObject *>(PyUnstable_Code_NewWithPosOnlyArgs(
+#else
+                code = reinterpret_cast<PyObject *>(PyCode_NewWithPosOnlyArgs(
+#endif
+                    argcount, posonly, kwonly, nlocals, stacksize, flags, bytecode, consts, names, varnames,
+                    freevars, cellvars, filename, name, qualname, firstlineno, linetable, exceptiontable));
+            }
+            Py_XDECREF(qualname);
+            Py_XDECREF(exceptiontable);
+#else
+            PyObject *linetable = name ? bytes() : nullptr;
+            if (linetable) {
+                code = reinterpret_cast<PyObject *>(PyCode_NewWithPosOnlyArgs(
+                    argcount, posonly, kwonly, nlocals, stacksize, flags, bytecode, consts, names, varnames,
+                    freevars, cellvars, filename, name, firstlineno, linetable));
+            }
+#endif
+            Py_XDECREF(linetable);
+            Py_XDECREF(name);
+            Py_XDECREF(filename);
+            Py_XDECREF(cellvars);
+            Py_XDECREF(freevars);
+            Py_XDECREF(varnames);
+            Py_XDECREF(names);
+            Py_XDECREF(consts);
+            Py_XDECREF(bytecode);
+            return code;
+        }
+
+        struct BlobHash {
+            using is_transparent = void;
+
+            size_t operator()(std::string_view blob) const { return std::hash<std::string_view>{}(blob); }
+        };
+
+        using CodeCache = std::unordered_map<std::string, PyObject *, BlobHash, std::equal_to<>>;
+
+        // Reconstructed code objects by encoding; values are owned. Never
+        // destroyed, since the interpreter may already be gone at exit.
+        CodeCache &code_cache() {
+            static auto *cache = new CodeCache();
+            return *cache;
+        }
+    } // namespace
+
+    bool encode_code(PyObject *code, std::string &out) {
+        if (!PyCode_Check(code)) {
+            PyErr_SetString(PyExc_TypeError, "Expected a code object");
+            return false;
+        }
+        out.push_back(CODE_MAGIC);
+        out.push_back(static_cast<char>(CODE_FORMAT_VERSION));
+        out.push_back(static_cast<char>(PY_MAJOR_VERSION));
+        out.push_back(static_cast<char>(PY_MINOR_VERSION));
+        return put_code_body(out, code);
+    }
+
+    PyObject *load_code(std::string_view data) {
+        CodeCache &cache = code_cache();
+        auto it = cache.find(data);
+        if (it != cache.end()) {
+            Py_INCREF(it->second);
+            return it->second;
+        }
+        if (data.size() < 4 || data[0] != CODE_MAGIC || static_cast<uint8_t>(data[1]) != CODE_FORMAT_VERSION) {
+            PyErr_SetString(PyExc_ValueError, "Malformed code object encoding");
+            return nullptr;
+        }
+        if (data[2] != PY_MAJOR_VERSION || data[3] != PY_MINOR_VERSION) {
+            PyErr_Format(PyExc_ValueError,
+                         "Code object was serialized by Python %d.%d and cannot be loaded by Python %d.%d",
+                         data[2], data[3], PY_MAJOR_VERSION, PY_MINOR_VERSION);
+            return nullptr;
+        }
+        Reader reader{data.data() + 4, data.data() + data.size()};
+        PyObject *code = reader.code_body();
+        if (!code) return nullptr;
+        if (reader.pos != reader.end) {
+            Py_DECREF(code);
+            reader.fail();
+            return nullptr;
+        }
+        if (cache.size() >= CODE_CACHE_MAX_ENTRIES) {
+            for (auto &[blob, cached]: cache) Py_DECREF(cached);
+            cache.clear();
+        }
+        Py_INCREF(code);
+        cache.emplace(std::string(data), code);
+        return code;
+    }
+
+    void CodeTable::clear() {
+        for (auto &[code, index]: by_object_) Py_DECREF(code);
+        by_object_.clear();
+        by_content_.clear();
+        blobs_.clear();
+    }
+
+    bool CodeTable::add(PyObject *code, uint32_t &index, bool &added) {
+        auto known = by_object_.find(code);
+        if (known != by_object_.end()) {
+            index = known->second;
+            added = false;
+            return true;
+        }
+        scratch_.clear();
+        if (!encode_code(code, scratch_)) return false;
+        auto [it, inserted] = by_content_.try_emplace(scratch_, static_cast<uint32_t>(blobs_.size()));
+        if (inserted) blobs_.push_back(&it->first);
+        // The table keeps the code object alive so its address cannot be
+        // reused by another code object during the same payload.
+        Py_INCREF(code);
+        by_object_.emplace(code, it->second);
+        index = it->second;
+        added = inserted;
+        return true;
+    }
+} // namespace pyser
@@ -0,0 +1,68 @@
+// code_codec.h
+// Binary encoding of function code objects, used by FUNCTION records (wire)
+// and FUNCTION nodes (graph) in place of the JSON form from pyobj_to_json.
+//
+// Notes:
+// - The encoding carries every CodeType constructor field of the running
+//   interpreter (including line and exception tables and the qualified name)
+//   and starts with the Python major/minor version that produced it: bytecode
+//   is only valid for the version it was compiled by.
+// - Constants are encoded recursively with a one-byte tag per value; nested
+//   code objects (inner functions, lambdas, comprehensions) are inlined.
+// - CodeTable deduplicates code objects within one payload, first by object
+//   and then by encoded content, so functions sharing code (closures made by
+//   one factory, repeated lambdas) store it once.
+// - load_code() keeps a process-wide cache keyed by the encoded bytes, so
+//   loading the same code again (in this or a later payload) reuses the
+//   reconstructed code object.
+
+#pragma once
+#include <Python.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace pyser {
+    constexpr uint8_t CODE_FORMAT_VERSION = 1;
+    // The process-wide code cache is dropped wholesale when it grows past this.
+    constexpr size_t CODE_CACHE_MAX_ENTRIES = 4096;
+
+    // Append the encoding of `code` to `out`. Returns false with a Python error
+    // set.
+    bool encode_code(PyObject *code, std::string &out);
+
+    // Code object for an encoding made by encode_code(). Returns a new
+    // reference, or nullptr with a Python error set.
+    PyObject *load_code(std::string_view data);
+
+    // Code objects of one payload in first-seen order.
+    class CodeTable {
+    public:
+        CodeTable() = default;
+
+        CodeTable(const CodeTable &) = delete;
+
+        CodeTable &operator=(const CodeTable &) = delete;
+
+        ~CodeTable() { clear(); }
+
+        void clear();
+
+        // Index of `code` in the table, encoding it the first time it (or an
+        // identical code object) is seen; `added` tells whether blob(index) is
+        // new. Returns false with a Python error set.
+        bool add(PyObject *code, uint32_t &index, bool &added);
+
+        [[nodiscard]] const std::string &blob(uint32_t index) const { return *blobs_[index]; }
+
+        [[nodiscard]] size_t size() const { return blobs_.size(); }
+
+    private:
+        std::unordered_map<PyObject *, uint32_t> by_object_;    // keys owned
+        std::unordered_map<std::string, uint32_t> by_content_;
+        std::vector<const std::string *> blobs_;                // keys of by_content_
+        std::string scratch_;
+    };
+} // namespace pyser
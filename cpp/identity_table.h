@@ -0,0 +1,124 @@
+// identity_table.h
+// Flat open-addressing map from PyObject* to node id, used by the serializer
+// to detect objects it has already emitted (shared references and cycles).
+//
+// Notes:
+// - Keys are object addresses; hashing mixes the pointer bits with a
+//   multiplicative hash since the low bits are always zero (alignment).
+// - Slots live in one contiguous array with linear probing and no per-entry
+//   allocation. The table never erases, so no tombstones are needed.
+// - Immutable atoms whose identity is irrelevant are not tracked at all (see
+//   needs_identity()); re-emitting them is cheaper than a table entry plus a
+//   REFERENCE node.
+
+#pragma once
+#include <Python.h>
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "std_types.h"
+
+namespace pyser {
+    class IdentityTable {
+    public:
+        explicit IdentityTable(size_t expected = 0) : size_(0), mask_(0) {
+            reserve(expected);
+        }
+
+        // Make room for `expected` entries without rehashing.
+        void reserve(size_t expected) {
+            size_t capacity = 16;
+            while (capacity < expected * 2) capacity <<= 1;
+            if (capacity > slots_.size()) rehash(capacity);
+        }
+
+        // Look up `key`; if absent, insert it with `id`. Returns the id stored for
+        // the key and whether it was inserted by this call. One probe sequence
+        // serves both the lookup and the insertion.
+        std::pair<uint32_t, bool> try_emplace(PyObject *key, uint32_t id) {
+            if ((size_ + 1) * 2 > slots_.size()) rehash(slots_.size() * 2);
+            size_t i = hash(key) & mask_;
+            while (true) {
+                Slot &slot = slots_[i];
+                if (slot.key == key) return {slot.id, false};
+                if (slot.key == nullptr) {
+                    slot.key = key;
+                    slot.id = id;
+                    size_++;
+                    return {id, true};
+                }
+                i = (i + 1) & mask_;
+            }
+        }
+
+        // True if `key` is in the table, without inserting it.
+        [[nodiscard]] bool contains(PyObject *key) const {
+            if (slots_.empty()) return false;
+            size_t i = hash(key) & mask_;
+            while (slots_[i].key) {
+                if (slots_[i].key == key) return true;
+                i = (i + 1) & mask_;
+            }
+            return false;
+        }
+
+        [[nodiscard]] size_t size() const { return size_; }
+
+        // Forget every entry but keep the slot array for the next walk.
+        void clear() {
+            std::fill(slots_.begin(), slots_.end(), Slot{});
+            size_ = 0;
+        }
+
+        // Objects whose identity never matters: None, bools, ints and floats.
+        // Both walkers write these as plain values (int and float subclasses
+        // included, Enum members excepted), so the wire decoder can tell from
+        // the record tag alone which records own a memo id. Containers,
+        // strings and everything user-defined are tracked so shared
+        // references and cycles survive.
+        static bool needs_identity(PyObject *obj) {
+            if (obj == Py_None || PyLong_CheckExact(obj) || PyFloat_CheckExact(obj) || PyBool_Check(obj)) return false;
+            if (PyLong_Check(obj) || PyFloat_Check(obj)) return is_enum_type(Py_TYPE(obj));
+            return true;
+        }
+
+        // Cheap lower bound on the number of objects reachable from `root`,
+        // used to presize the table.
+        static size_t estimate_size(PyObject *root) {
+            if (PyList_Check(root)) return static_cast<size_t>(PyList_GET_SIZE(root)) + 1;
+            if (PyTuple_Check(root)) return static_cast<size_t>(PyTuple_GET_SIZE(root)) + 1;
+            if (PyDict_Check(root)) return static_cast<size_t>(PyDict_Size(root)) * 2 + 1;
+            if (PyAnySet_Check(root)) return static_cast<size_t>(PySet_GET_SIZE(root)) + 1;
+            return 16;
+        }
+
+    private:
+        struct Slot {
+            PyObject *key = nullptr;
+            uint32_t id = 0;
+        };
+
+        static size_t hash(PyObject *key) {
+            uint64_t x = reinterpret_cast<uintptr_t>(key) >> 4;
+            x *= 0x9E3779B97F4A7C15ull;
+            return static_cast<size_t>(x ^ (x >> 29));
+        }
+
+        void rehash(size_t capacity) {
+            std::vector<Slot> old = std::move(slots_);
+            slots_.assign(capacity, Slot{});
+            mask_ = capacity - 1;
+            for (const Slot &slot: old) {
+                if (!slot.key) continue;
+                size_t i = hash(slot.key) & mask_;
+                while (slots_[i].key) i = (i + 1) & mask_;
+                slots_[i] = slot;
+            }
+        }
+
+        std::vector<Slot> slots_;
+        size_t size_;
+        size_t mask_;
+    };
+} // namespace pyser
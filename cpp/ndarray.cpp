@@ -0,0 +1,237 @@
+// ndarray.cpp
+// numpy.ndarray layout, header coding and construction (see ndarray.h).
+#include "ndarray.h"
+#include <cstring>
+#include "packed_array.h"
+
+namespace pyser {
+    namespace {
+        // numpy.ndarray, once seen (owned, never released).
+        PyTypeObject *ndarray_type = nullptr;
+        // numpy.ndarray for building arrays, imported on first use.
+        PyObject *ndarray_class = nullptr;
+
+        constexpr size_t DTYPE_MAX_LENGTH = 64;
+
+        bool attr_is(PyObject *obj, const char *name, PyObject *expected, bool &result) {
+            PyObject *value = PyObject_GetAttrString(obj, name);
+            if (!value) return false;
+            result = value == expected;
+            Py_DECREF(value);
+            return true;
+        }
+
+        // The dtypes whose dtype.str describes them fully.
+        bool native_dtype(PyObject *dtype, bool &native) {
+            bool no_object, no_fields, no_subdtype;
+            if (!attr_is(dtype, "hasobject", Py_False, no_object) || !attr_is(dtype, "fields", Py_None, no_fields) ||
+                !attr_is(dtype, "subdtype", Py_None, no_subdtype)) {
+                return false;
+            }
+            native = no_object && no_fields && no_subdtype;
+            return true;
+        }
+
+        bool as_int64s(PyObject *tuple, std::vector<int64_t> &out) {
+            if (!PyTuple_Check(tuple) || static_cast<size_t>(PyTuple_GET_SIZE(tuple)) > NDARRAY_MAX_DIMS) {
+                PyErr_SetString(PyExc_ValueError, "Unexpected __array_interface__");
+                return false;
+            }
+            out.clear();
+            for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(tuple); i++) {
+                long long value = PyLong_AsLongLong(PyTuple_GET_ITEM(tuple, i));
+                if (value == -1 && PyErr_Occurred()) return false;
+                out.push_back(value);
+            }
+            return true;
+        }
+
+        // Shape, strides and data address of `array` from its array
+        // interface. `contiguous` is false unless the data is one C- or
+        // Fortran-ordered block.
+        bool read_interface(PyObject *array, int64_t itemsize, ArrayData &out, bool &contiguous) {
+            PyObject *interface = PyObject_GetAttrString(array, "__array_interface__");
+            if (!interface) return false;
+            PyObject *data = PyDict_Check(interface) ? PyDict_GetItemString(interface, "data") : nullptr;
+            PyObject *shape = PyDict_Check(interface) ? PyDict_GetItemString(interface, "shape") : nullptr;
+            PyObject *strides = PyDict_Check(interface) ? PyDict_GetItemString(interface, "strides") : nullptr;
+            if (!data || !PyTuple_Check(data) || PyTuple_GET_SIZE(data) < 1 || !shape) {
+                Py_DECREF(interface);
+                PyErr_SetString(PyExc_ValueError, "Unexpected __array_interface__");
+                return false;
+            }
+            ArrayHeader &header = out.header;
+            bool ok = as_int64s(shape, header.shape);
+            if (ok && strides && strides != Py_None) ok = as_int64s(strides, header.strides);
+            void *address = ok ? PyLong_AsVoidPtr(PyTuple_GET_ITEM(data, 0)) : nullptr;
+            ok = ok && !PyErr_Occurred();
+            out.writable = PyTuple_GET_SIZE(data) < 2 || PyTuple_GET_ITEM(data, 1) != Py_True;
+            Py_DECREF(interface);
+            if (!ok) return false;
+            out.data = static_cast<const uint8_t *>(address);
+
+            size_t ndim = header.shape.size();
+            std::vector<int64_t> c_strides(ndim), f_strides(ndim);
+            int64_t items = 1;
+            for (size_t i = ndim; i-- > 0;) {
+                c_strides[i] = items * itemsize;
+                items *= header.shape[i];
+            }
+            int64_t step = itemsize;
+            for (size_t i = 0; i < ndim; i++) {
+                f_strides[i] = step;
+                step *= header.shape[i];
+            }
+            header.size = static_cast<uint64_t>(items * itemsize);
+            if (header.strides.empty() || items == 0) {
+                // No strides: C-contiguous. Empty arrays have no layout to keep.
+                header.strides = c_strides;
+                contiguous = true;
+                return true;
+            }
+            // Strides of dimensions of size 1 are irrelevant, as in numpy.
+            bool c_order = true, f_order = true;
+            for (size_t i = 0; i < ndim; i++) {
+                if (header.shape[i] == 1) continue;
+                c_order = c_order && header.strides[i] == c_strides[i];
+                f_order = f_order && header.strides[i] == f_strides[i];
+            }
+            contiguous = c_order || f_order;
+            if (contiguous) header.strides = c_order ? c_strides : f_strides;
+            return true;
+        }
+    } // namespace
+
+    bool is_ndarray_type(PyTypeObject *type) {
+        if (ndarray_type) return type == ndarray_type;
+        if (std::strcmp(type->tp_name, "numpy.ndarray") != 0) return false;
+        PyObject *type_, *value, *traceback;
+        PyErr_Fetch(&type_, &value, &traceback);
+        PyObject *name = PyUnicode_FromString("numpy");
+        PyObject *numpy = name ? PyImport_GetModule(name) : nullptr;
+        Py_XDECREF(name);
+        PyObject *cls = numpy ? PyObject_GetAttrString(numpy, "ndarray") : nullptr;
+        Py_XDECREF(numpy);
+        bool found = cls == reinterpret_cast<PyObject *>(type);
+        if (found) {
+            ndarray_type = type;
+        } else {
+            Py_XDECREF(cls);
+        }
+        PyErr_Clear();
+        PyErr_Restore(type_, value, traceback);
+        return found;
+    }
+
+    bool ndarray_data(PyObject *array, ArrayData &out, bool &native) {
+        PyObject *dtype = PyObject_GetAttrString(array, "dtype");
+        if (!dtype) return false;
+        if (!native_dtype(dtype, native) || !native) {
+            Py_DECREF(dtype);
+            return !PyErr_Occurred();
+        }
+        PyObject *str = PyObject_GetAttrString(dtype, "str");
+        PyObject *itemsize_obj = PyObject_GetAttrString(dtype, "itemsize");
+        Py_DECREF(dtype);
+        long long itemsize = itemsize_obj ? PyLong_AsLongLong(itemsize_obj) : -1;
+        Py_XDECREF(itemsize_obj);
+        const char *text = str && PyUnicode_Check(str) ? PyUnicode_AsUTF8(str) : nullptr;
+        if (!text || itemsize < 0) {
+            Py_XDECREF(str);
+            if (!PyErr_Occurred()) PyErr_SetString(PyExc_ValueError, "Unexpected numpy dtype");
+            return false;
+        }
+        out.header.dtype = text;
+        Py_DECREF(str);
+
+        bool contiguous;
+        if (!read_interface(array, itemsize, out, contiguous)) return false;
+        Py_INCREF(array);
+        out.owner = array;
+        if (contiguous) return true;
+        // A C-ordered copy of a strided or reversed view.
+        PyObject *copy = PyObject_CallMethod(array, "copy", nullptr);
+        if (!copy) return false;
+        Py_DECREF(out.owner);
+        out.owner = copy;
+        out.header.strides.clear();
+        if (!read_interface(copy, itemsize, out, contiguous)) return false;
+        out.writable = false;  // nothing else can reach the copy
+        return true;
+    }
+
+    void append_ndarray_header(std::vector<uint8_t> &out, const ArrayHeader &header) {
+        append_varint(out, header.dtype.size());
+        out.insert(out.end(), header.dtype.begin(), header.dtype.end());
+        append_varint(out, header.shape.size());
+        for (int64_t size: header.shape) append_varint(out, static_cast<uint64_t>(size));
+        for (int64_t stride: header.strides) append_varint(out, zigzag(stride));
+        append_varint(out, header.size);
+    }
+
+    bool parse_ndarray_header(const uint8_t *&pos, const uint8_t *end, ArrayHeader &header) {
+        uint64_t length = 0, ndim = 0;
+        bool ok = parse_varint(pos, end, length) && length <= DTYPE_MAX_LENGTH &&
+                  length <= static_cast<uint64_t>(end - pos);
+        if (ok) {
+            header.dtype.assign(reinterpret_cast<const char *>(pos), length);
+            pos += length;
+            ok = parse_varint(pos, end, ndim) && ndim <= NDARRAY_MAX_DIMS;
+        }
+        header.shape.clear();
+        header.strides.clear();
+        for (uint64_t i = 0; ok && i < ndim; i++) {
+            uint64_t size;
+            ok = parse_varint(pos, end, size) && size <= static_cast<uint64_t>(PY_SSIZE_T_MAX);
+            header.shape.push_back(static_cast<int64_t>(size));
+        }
+        for (uint64_t i = 0; ok && i < ndim; i++) {
+            uint64_t stride;
+            ok = parse_varint(pos, end, stride);
+            header.strides.push_back(unzigzag(stride));
+        }
+        ok = ok && parse_varint(pos, end, header.size) && header.size <= static_cast<uint64_t>(PY_SSIZE_T_MAX);
+        if (!ok) PyErr_SetString(PyExc_ValueError, "Invalid numpy array header");
+        return ok;
+    }
+
+    PyObject *make_ndarray(const ArrayHeader &header, PyObject *buffer) {
+        if (!ndarray_class) {
+            PyObject *numpy = PyImport_ImportModule("numpy");
+            if (!numpy) return nullptr;
+            ndarray_class = PyObject_GetAttrString(numpy, "ndarray");
+            Py_DECREF(numpy);
+            if (!ndarray_class) return nullptr;
+        }
+        size_t ndim = header.shape.size();
+        PyObject *shape = PyTuple_New(static_cast<Py_ssize_t>(ndim));
+        PyObject *strides = PyTuple_New(static_cast<Py_ssize_t>(ndim));
+        PyObject *kwargs = PyDict_New();
+        bool ok = shape && strides && kwargs;
+        for (size_t i = 0; ok && i < ndim; i++) {
+            PyObject *size = PyLong_FromLongLong(header.shape[i]);
+            PyObject *stride = PyLong_FromLongLong(header.strides[i]);
+            if (size) PyTuple_SET_ITEM(shape, static_cast<Py_ssize_t>(i), size);
+            if (stride) PyTuple_SET_ITEM(strides, static_cast<Py_ssize_t>(i), stride);
+            ok = size && stride;
+        }
+        PyObject *dtype = ok ? PyUnicode_FromStringAndSize(header.dtype.data(), header.dtype.size()) : nullptr;
+        ok = dtype && PyDict_SetItemString(kwargs, "shape", shape) == 0 &&
+             PyDict_SetItemString(kwargs, "dtype", dtype) == 0 &&
+             PyDict_SetItemString(kwargs, "buffer", buffer) == 0 &&
+             PyDict_SetItemString(kwargs, "strides", strides) == 0;
+        Py_XDECREF(dtype);
+        PyObject *array = nullptr;
+        if (ok) {
+            PyObject *args = PyTuple_New(0);
+            if (args) {
+                array = PyObject_Call(ndarray_class, args, kwargs);
+                Py_DECREF(args);
+            }
+        }
+        Py_XDECREF(shape);
+        Py_XDECREF(strides);
+        Py_XDECREF(kwargs);
+        return array;
+    }
+} // namespace pyser
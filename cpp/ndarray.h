@@ -0,0 +1,78 @@
+// ndarray.h
+// Native numpy.ndarray support, shared by the wire encoder/decoder and the
+// graph serializer: an array is stored as its dtype, shape and strides plus
+// its raw data, and loaded as a new array over the decoded buffer.
+//
+// Notes:
+// - numpy stays optional. The writers recognise numpy.ndarray by name and
+//   only look at an already loaded numpy module (an array cannot exist before
+//   it); numpy is imported on the first array that is read back.
+// - Only exact ndarrays whose dtype is described by dtype.str are native:
+//   numbers, bool, bytes/str, datetime64/timedelta64 and plain void. Arrays
+//   of object and structured dtypes take the generic path (__reduce_ex__) in
+//   the wire format and are refused by the graph format. ndarray subclasses
+//   are still stored like any other buffer exporter.
+// - The data is read through the array interface, so dtypes numpy does not
+//   export through the buffer protocol (datetime64) work too. C- and
+//   Fortran-contiguous arrays are written in place with their strides; other
+//   arrays are written from a C-ordered copy.
+// - On load the array is numpy.ndarray(shape, dtype, buffer, strides) over a
+//   bytearray holding the data, or over the out-of-band buffer given back
+//   (out_of_band.h), so the data is not copied again. Loaded arrays are
+//   writable unless that buffer is read-only.
+// - Header layout: varint dtype length, dtype.str (ASCII), varint ndim, the
+//   ndim sizes as varints, the ndim byte strides as zigzag varints, varint
+//   data size.
+
+#pragma once
+#include <Python.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace pyser {
+    constexpr size_t NDARRAY_MAX_DIMS = 64;
+
+    struct ArrayHeader {
+        std::string dtype;                  // dtype.str, e.g. "<f8"
+        std::vector<int64_t> shape;
+        std::vector<int64_t> strides;       // in bytes, of the data as written
+        uint64_t size = 0;                  // bytes of data
+    };
+
+    // An array ready to be written: its header and the data it points to.
+    struct ArrayData {
+        ArrayHeader header;
+        const uint8_t *data = nullptr;
+        PyObject *owner = nullptr;          // array holding `data` (owned)
+        bool writable = false;              // `data` can still change under Python code
+
+        ArrayData() = default;
+
+        ArrayData(const ArrayData &) = delete;
+
+        ArrayData &operator=(const ArrayData &) = delete;
+
+        ~ArrayData() { Py_XDECREF(owner); }
+    };
+
+    // True if `type` is exactly numpy.ndarray. Never imports numpy and never
+    // leaves a Python error set.
+    bool is_ndarray_type(PyTypeObject *type);
+
+    // Describe `array` for writing. `native` is false when its dtype has no
+    // native layout; the caller then takes the generic path. Returns false
+    // with a Python error set.
+    bool ndarray_data(PyObject *array, ArrayData &out, bool &native);
+
+    void append_ndarray_header(std::vector<uint8_t> &out, const ArrayHeader &header);
+
+    // Parse a header written by append_ndarray_header(). Returns false with a
+    // Python error set on malformed input.
+    bool parse_ndarray_header(const uint8_t *&pos, const uint8_t *end, ArrayHeader &header);
+
+    // New array described by `header` over `buffer`, which must hold exactly
+    // header.size bytes. Returns a new reference, or nullptr with a Python
+    // error set.
+    PyObject *make_ndarray(const ArrayHeader &header, PyObject *buffer);
+} // namespace pyser
@@ -0,0 +1,67 @@
+// out_of_band.cpp
+// Out-of-band buffer callback and rebinding (see out_of_band.h).
+#include "out_of_band.h"
+
+namespace pyser {
+    bool BufferCallback::offer(PyObject *obj, size_t size, bool &out_of_band, uint64_t &index) {
+        out_of_band = false;
+        if (!callback_ || size < OUT_OF_BAND_MIN_SIZE) return true;
+        PyObject *buffer = PyPickleBuffer_FromObject(obj);
+        if (!buffer) {
+            // numpy refuses to export some dtypes (datetime64); those stay in band.
+            if (!PyErr_ExceptionMatches(PyExc_ValueError) && !PyErr_ExceptionMatches(PyExc_BufferError)) return false;
+            PyErr_Clear();
+            return true;
+        }
+        PyObject *result = PyObject_CallOneArg(callback_, buffer);
+        Py_DECREF(buffer);
+        if (!result) return false;
+        int in_band = PyObject_IsTrue(result);
+        Py_DECREF(result);
+        if (in_band < 0) return false;
+        if (!in_band) {
+            out_of_band = true;
+            index = next_index_++;
+        }
+        return true;
+    }
+
+    bool OutOfBandBuffers::reset(PyObject *buffers) {
+        Py_CLEAR(buffers_);
+        if (!buffers || buffers == Py_None) return true;
+        buffers_ = PySequence_Fast(buffers, "buffers must be an iterable of buffer objects");
+        return buffers_ != nullptr;
+    }
+
+    PyObject *OutOfBandBuffers::take(BufferKind kind, uint64_t index, uint64_t size) const {
+        if (!buffers_) {
+            PyErr_SetString(PyExc_ValueError, "Data refers to out-of-band buffers but no buffers were given");
+            return nullptr;
+        }
+        if (index >= static_cast<uint64_t>(PySequence_Fast_GET_SIZE(buffers_))) {
+            PyErr_SetString(PyExc_ValueError, "Not enough out-of-band buffers");
+            return nullptr;
+        }
+        PyObject *buffer = PySequence_Fast_GET_ITEM(buffers_, static_cast<Py_ssize_t>(index));
+        Py_buffer view;
+        if (PyObject_GetBuffer(buffer, &view, PyBUF_CONTIG_RO) != 0) return nullptr;
+        auto length = static_cast<uint64_t>(view.len);
+        PyBuffer_Release(&view);
+        if (length != size) {
+            PyErr_Format(PyExc_ValueError, "Out-of-band buffer %llu has %llu bytes, expected %llu",
+                         static_cast<unsigned long long>(index), static_cast<unsigned long long>(length),
+                         static_cast<unsigned long long>(size));
+            return nullptr;
+        }
+        if ((kind == BufferKind::BYTES && PyBytes_CheckExact(buffer)) ||
+            (kind == BufferKind::BYTEARRAY && PyByteArray_CheckExact(buffer))) {
+            Py_INCREF(buffer);
+            return buffer;
+        }
+        PyObject *memory = PyMemoryView_FromObject(buffer);
+        if (!memory || kind != BufferKind::BYTES || PyMemoryView_GET_BUFFER(memory)->readonly) return memory;
+        PyObject *readonly = PyObject_CallMethod(memory, "toreadonly", nullptr);
+        Py_DECREF(memory);
+        return readonly;
+    }
+} // namespace pyser
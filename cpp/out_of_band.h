@@ -0,0 +1,84 @@
+// out_of_band.h
+// Out-of-band buffers, in the manner of pickle protocol 5, shared by the wire
+// encoder/decoder and the graph serializer.
+//
+// Notes:
+// - serialize(obj, buffer_callback=f) calls f with a pickle.PickleBuffer for
+//   every bytes, bytearray, memoryview or other contiguous buffer exporter of
+//   at least OUT_OF_BAND_MIN_SIZE bytes. If f returns a false value the buffer
+//   is left out of the stream: only a placeholder is written, holding the
+//   buffer's kind, its index among the out-of-band buffers and its size. A
+//   true value keeps it in the stream as usual. The caller moves the data
+//   itself (shared memory, sendmsg, ...).
+// - deserialize(data, buffers=b) takes the buffers in the same order (any
+//   iterable of buffer exporters) and rebinds each placeholder without
+//   copying: a bytes stays bytes and a bytearray stays bytearray when the
+//   buffer given back is of that type; anything else comes back as a
+//   memoryview over the buffer given, read-only for bytes.
+// - A buffer shared by several references is offered once; the references
+//   resolve through the memo like any other object.
+// - numpy arrays (ndarray.h) offer their data the same way; the array is
+//   rebuilt over the buffer given back.
+
+#pragma once
+#include <Python.h>
+#include <cstdint>
+
+namespace pyser {
+    constexpr size_t OUT_OF_BAND_MIN_SIZE = 64 * 1024;
+
+    enum class BufferKind : uint8_t {
+        BYTES = 0,
+        BYTEARRAY = 1,
+        BUFFER = 2,     // memoryview or another buffer exporter
+    };
+
+    inline BufferKind buffer_kind(PyObject *obj) {
+        if (PyBytes_Check(obj)) return BufferKind::BYTES;
+        if (PyByteArray_Check(obj)) return BufferKind::BYTEARRAY;
+        return BufferKind::BUFFER;
+    }
+
+    // Encode side: the buffer_callback of one serialize() call.
+    class BufferCallback {
+    public:
+        // `callback` is borrowed for the duration of the call; nullptr or
+        // None keeps every buffer in band.
+        void reset(PyObject *callback) {
+            callback_ = callback == Py_None ? nullptr : callback;
+            next_index_ = 0;
+        }
+
+        // Offer `obj`, whose contiguous data is `size` bytes long, to the
+        // callback. Sets `index` when it goes out of band. Objects that do not
+        // export a buffer stay in band. Returns false with a Python error set.
+        bool offer(PyObject *obj, size_t size, bool &out_of_band, uint64_t &index);
+
+    private:
+        PyObject *callback_ = nullptr;
+        uint64_t next_index_ = 0;
+    };
+
+    // Decode side: the buffers= of one deserialize() call.
+    class OutOfBandBuffers {
+    public:
+        OutOfBandBuffers() = default;
+
+        OutOfBandBuffers(const OutOfBandBuffers &) = delete;
+
+        OutOfBandBuffers &operator=(const OutOfBandBuffers &) = delete;
+
+        ~OutOfBandBuffers() { Py_XDECREF(buffers_); }
+
+        // Take the buffers of the next call; nullptr or None means none.
+        // Returns false with a Python error set.
+        bool reset(PyObject *buffers);
+
+        // Object for the placeholder of buffer `index`. Returns a new
+        // reference, or nullptr with a Python error set.
+        PyObject *take(BufferKind kind, uint64_t index, uint64_t size) const;
+
+    private:
+        PyObject *buffers_ = nullptr;   // list or tuple (owned)
+    };
+} // namespace pyser
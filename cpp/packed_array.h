@@ -0,0 +1,602 @@
+// packed_array.h
+// Lists and tuples whose elements are all plain ints (within int64), all
+// plain floats or all plain strings, stored as one packed array instead of
+// one record or node per element. Shared by the wire encoder/decoder and the
+// graph serializer.
+//
+// Notes:
+// - Only exact int, float and str elements qualify: bools and subclasses
+//   keep their own records so their type survives.
+// - Numbers are atoms (see IdentityTable::needs_identity), so packing them
+//   loses no shared references; the container itself keeps its identity.
+// - Short sequences are not worth the detection pass and stay generic.
+// - Values are stored in blocks of PACKED_BLOCK_ITEMS. Within a float block
+//   the bytes are split into eight planes by significance (all lowest bytes,
+//   then all second bytes, ...), which turns the shared sign and exponent
+//   bytes into long runs that zstd compresses far better than interleaved
+//   values. No layout depends on host byte order.
+// - The plane split is an 8x8 byte transpose per eight values, done with
+//   SSE2 on x86-64 (part of the base instruction set, so no runtime dispatch)
+//   and with shifts elsewhere.
+// - Float blocks whose neighbouring values share most of their bits (slowly
+//   changing series, repeated or quantised readings) are XOR-delta coded
+//   instead, as in Facebook's Gorilla: each value is XORed with the previous
+//   one and only the differing bits are stored, one bit for a repeat. The
+//   bit patterns are kept, so NaN payloads, infinities and -0.0 survive. The
+//   encoder picks the layout per block by size.
+// - Int blocks use frame-of-reference encoding (see pack_int_block()): the
+//   values, or the differences between consecutive values, relative to
+//   their minimum, in just as many bits as that range needs. Sorted ids, counters and
+//   timestamps shrink to a few bits per value before zstd runs; an
+//   arithmetic sequence to none at all.
+// - String arrays are a table of one varint entry per element followed by
+//   the code units of the new strings back to back (str_units.h). An entry
+//   is the string's header shifted left by one, or (low bit set) a
+//   back-reference: to a memo id in the wire format, to an earlier element of
+//   the same array in the graph format. Decoding copies ASCII text straight
+//   into compact strings.
+
+#pragma once
+#include <Python.h>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define PYSER_PACKED_SSE2 1
+#endif
+
+namespace pyser {
+    constexpr Py_ssize_t PACKED_MIN_ITEMS = 8;
+    constexpr Py_ssize_t PACKED_BLOCK_ITEMS = 4096;
+
+    // Element encoding of a packed array (stored as one byte).
+    enum class PackedKind : uint8_t {
+        NONE = 0,
+        INT_FOR = 1,    // int64 in frame-of-reference blocks
+        FLOAT_XOR = 2,  // IEEE 754 double bits, each block XOR-delta coded or in byte planes
+        STR_UNITS = 3,  // entry table + code units in each string's own width
+    };
+
+#ifdef PYSER_PACKED_SSE2
+    // dst row j, byte i = src row i, byte j, for 8 rows of 8 bytes.
+    inline void transpose_8x8(const uint8_t *src, size_t src_stride, uint8_t *dst, size_t dst_stride) {
+        __m128i r[8];
+        for (int i = 0; i < 8; i++) {
+            r[i] = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i * src_stride));
+        }
+        __m128i s0 = _mm_unpacklo_epi8(r[0], r[1]);
+        __m128i s1 = _mm_unpacklo_epi8(r[2], r[3]);
+        __m128i s2 = _mm_unpacklo_epi8(r[4], r[5]);
+        __m128i s3 = _mm_unpacklo_epi8(r[6], r[7]);
+        __m128i u0 = _mm_unpacklo_epi16(s0, s1);
+        __m128i u1 = _mm_unpackhi_epi16(s0, s1);
+        __m128i u2 = _mm_unpacklo_epi16(s2, s3);
+        __m128i u3 = _mm_unpackhi_epi16(s2, s3);
+        __m128i w[4] = {
+            _mm_unpacklo_epi32(u0, u2), _mm_unpackhi_epi32(u0, u2),
+            _mm_unpacklo_epi32(u1, u3), _mm_unpackhi_epi32(u1, u3),
+        };
+        for (int j = 0; j < 4; j++) {
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + (2 * j) * dst_stride), w[j]);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + (2 * j + 1) * dst_stride),
+                             _mm_unpackhi_epi64(w[j], w[j]));
+        }
+    }
+#endif
+
+    // Write the `n` values as eight byte planes of `n` bytes each to `out`.
+    inline void split_planes(const uint64_t *values, size_t n, uint8_t *out) {
+        size_t i = 0;
+#ifdef PYSER_PACKED_SSE2
+        // x86 is little endian: the bytes of a value in memory are its planes.
+        for (; i + 8 <= n; i += 8) {
+            transpose_8x8(reinterpret_cast<const uint8_t *>(values + i), 8, out + i, n);
+        }
+#endif
+        for (; i < n; i++) {
+            for (size_t p = 0; p < 8; p++) out[p * n + i] = static_cast<uint8_t>(values[i] >> (8 * p));
+        }
+    }
+
+    // Inverse of split_planes().
+    inline void join_planes(const uint8_t *in, size_t n, uint64_t *values) {
+        size_t i = 0;
+#ifdef PYSER_PACKED_SSE2
+        for (; i + 8 <= n; i += 8) {
+            transpose_8x8(in + i, n, reinterpret_cast<uint8_t *>(values + i), 8);
+        }
+#endif
+        for (; i < n; i++) {
+            uint64_t value = 0;
+            for (size_t p = 0; p < 8; p++) value |= static_cast<uint64_t>(in[p * n + i]) << (8 * p);
+            values[i] = value;
+        }
+    }
+
+    // Kind the `n` items can be packed as, judged by type alone. INT_FOR may
+    // still fail in pack_ints() if a value does not fit int64.
+    inline PackedKind packed_kind(PyObject *const *items, Py_ssize_t n) {
+        if (n < PACKED_MIN_ITEMS) return PackedKind::NONE;
+        PyTypeObject *type = Py_TYPE(items[0]);
+        if (type != &PyLong_Type && type != &PyFloat_Type && type != &PyUnicode_Type) return PackedKind::NONE;
+        for (Py_ssize_t i = 1; i < n; i++) {
+            if (Py_TYPE(items[i]) != type) return PackedKind::NONE;
+        }
+        if (type == &PyUnicode_Type) return PackedKind::STR_UNITS;
+        return type == &PyLong_Type ? PackedKind::INT_FOR : PackedKind::FLOAT_XOR;
+    }
+
+    inline void append_varint(std::vector<uint8_t> &out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<uint8_t>(value) | 0x80);
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    // Read a varint at `pos`, advancing it. False if the data ends first.
+    inline bool parse_varint(const uint8_t *&pos, const uint8_t *end, uint64_t &value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && pos < end; shift += 7) {
+            uint8_t byte = *pos++;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    // Signed values as unsigned ones with small magnitudes first
+    // (0, -1, 1, -2, ...), so that small negative numbers make short varints.
+    inline uint64_t zigzag(int64_t value) {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    inline int64_t unzigzag(uint64_t value) {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    // True if the `size` bytes at `data` are all ASCII, checked a word at a time.
+    inline bool is_ascii(const char *data, size_t size) {
+        size_t i = 0;
+        uint64_t bits = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            bits |= word;
+        }
+        for (; i < size; i++) bits |= static_cast<uint8_t>(data[i]);
+        return (bits & 0x8080808080808080ULL) == 0;
+    }
+
+    // str from UTF-8 text. ASCII text is copied straight into a compact
+    // string; one-character strings go through the decoder, which returns the
+    // interpreter's cached singletons.
+    inline PyObject *make_str(const char *data, size_t size) {
+        if (size > 1 && is_ascii(data, size)) {
+            PyObject *str = PyUnicode_New(static_cast<Py_ssize_t>(size), 127);
+            if (str) std::memcpy(PyUnicode_1BYTE_DATA(str), data, size);
+            return str;
+        }
+        return PyUnicode_DecodeUTF8(data, static_cast<Py_ssize_t>(size), "strict");
+    }
+
+    // Value of an exact int if it fits int64. Small ints are read straight
+    // from their single digit.
+    inline bool int64_value(PyObject *obj, int64_t &value) {
+#if PY_VERSION_HEX >= 0x030C0000
+        auto *long_obj = reinterpret_cast<PyLongObject *>(obj);
+        if (PyUnstable_Long_IsCompact(long_obj)) {
+            value = PyUnstable_Long_CompactValue(long_obj);
+            return true;
+        }
+#else
+        Py_ssize_t size = Py_SIZE(obj);
+        if (size >= -1 && size <= 1) {
+            value = size * static_cast<int64_t>(reinterpret_cast<PyLongObject *>(obj)->ob_digit[0]);
+            return true;
+        }
+#endif
+        int overflow;
+        long long v = PyLong_AsLongLongAndOverflow(obj, &overflow);
+        if (overflow != 0) return false;
+        value = v;
+        return true;
+    }
+
+    // Bit stream written LSB first, 64 bits at a time.
+    class BitWriter {
+    public:
+        explicit BitWriter(std::vector<uint8_t> &out) : out_(out) {}
+
+        // Append the low `n` bits of `value` (which has no higher bits set).
+        void put(uint64_t value, unsigned n) {
+            acc_ |= value << fill_;
+            if (fill_ + n >= 64) {
+                unsigned taken = 64 - fill_;
+                emit(acc_, 8);
+                acc_ = taken < 64 ? value >> taken : 0;
+                fill_ = fill_ + n - 64;
+            } else {
+                fill_ += n;
+            }
+        }
+
+        void finish() {
+            emit(acc_, (fill_ + 7) / 8);
+            acc_ = 0;
+            fill_ = 0;
+        }
+
+    private:
+        void emit(uint64_t word, unsigned bytes) {
+            for (unsigned b = 0; b < bytes; b++) out_.push_back(static_cast<uint8_t>(word >> (8 * b)));
+        }
+
+        std::vector<uint8_t> &out_;
+        uint64_t acc_ = 0;
+        unsigned fill_ = 0;
+    };
+
+    // Reads what BitWriter wrote. Every read is one unaligned little-endian
+    // load at the current bit position, which yields at least 57 valid bits.
+    // Reading past the end yields zero bits; overrun() tells whether that
+    // happened.
+    class BitReader {
+    public:
+        BitReader(const uint8_t *data, size_t size) : data_(data), size_(size) {}
+
+        // The next (at least 57) bits without consuming them.
+        [[nodiscard]] uint64_t peek() const {
+            size_t byte = bit_ >> 3;
+            uint64_t word = 0;
+            if (byte + 8 <= size_) {
+                std::memcpy(&word, data_ + byte, sizeof(word));
+                if constexpr (std::endian::native == std::endian::big) word = byteswap(word);
+            } else {
+                for (size_t b = 0; byte + b < size_; b++) word |= static_cast<uint64_t>(data_[byte + b]) << (8 * b);
+            }
+            return word >> (bit_ & 7);
+        }
+
+        void skip(unsigned n) { bit_ += n; }
+
+        uint64_t get(unsigned n) {
+            uint64_t value;
+            if (n <= 57) {
+                value = peek() & low_bits(n);
+            } else {
+                value = peek() & low_bits(32);
+                bit_ += 32;
+                value |= (peek() & low_bits(n - 32)) << 32;
+                n -= 32;
+            }
+            bit_ += n;
+            return value;
+        }
+
+        [[nodiscard]] bool overrun() const { return bit_ > size_ * 8; }
+
+    private:
+        static uint64_t low_bits(unsigned n) { return n == 64 ? ~0ULL : (1ULL << n) - 1; }
+
+        static uint64_t byteswap(uint64_t v) {
+            uint64_t r = 0;
+            for (int b = 0; b < 8; b++) r = r << 8 | ((v >> (8 * b)) & 0xFF);
+            return r;
+        }
+
+        const uint8_t *data_;
+        size_t size_;
+        size_t bit_ = 0;
+    };
+
+    // XOR-delta coding of `n` double bit patterns: the first value in full,
+    // then per value a 0 bit if it repeats the previous one; otherwise a 1
+    // bit and the XOR with the previous value, either as its bits inside the
+    // previous window of meaningful bits (flag 0) or as a new window (flag 1:
+    // 5 bits of leading zeros, 6 bits of length - 1, then the bits).
+    inline void xor_encode(const uint64_t *values, size_t n, std::vector<uint8_t> &out) {
+        if (n == 0) return;
+        BitWriter bits(out);
+        bits.put(values[0], 64);
+        unsigned lead = 64, trail = 0;  // current window; none yet
+        for (size_t i = 1; i < n; i++) {
+            uint64_t x = values[i] ^ values[i - 1];
+            if (x == 0) {
+                bits.put(0, 1);
+                continue;
+            }
+            auto lz = std::min(static_cast<unsigned>(std::countl_zero(x)), 31u);
+            auto tz = static_cast<unsigned>(std::countr_zero(x));
+            if (lead != 64 && lz >= lead && tz >= trail) {
+                bits.put(1, 2);  // 1, then window flag 0
+                bits.put(x >> trail, 64 - lead - trail);
+                continue;
+            }
+            unsigned length = 64 - lz - tz;
+            bits.put(3 | lz << 2 | (length - 1) << 7, 13);
+            bits.put(x >> tz, length);
+            lead = lz;
+            trail = tz;
+        }
+        bits.finish();
+    }
+
+    // Inverse of xor_encode() over the `size` bytes at `data`. False if the
+    // data is too short for `n` values.
+    inline bool xor_decode(const uint8_t *data, size_t size, size_t n, uint64_t *values) {
+        if (n == 0) return true;
+        BitReader bits(data, size);
+        values[0] = bits.get(64);
+        // The window is kept as (length, trail); length 0 means none yet. The
+        // loop is written for conditional moves rather than branches: whether
+        // a value repeats or opens a new window is data dependent and would
+        // mispredict constantly.
+        unsigned length = 0, trail = 0;
+        bool bad = false;
+        for (size_t i = 1; i < n; i++) {
+            uint64_t control = bits.peek();
+            bool changed = control & 1;
+            bool fresh = changed && (control & 2);
+            auto new_lead = static_cast<unsigned>(control >> 2 & 31);
+            auto new_length = static_cast<unsigned>(control >> 7 & 63) + 1;
+            bad |= fresh && new_lead + new_length > 64;
+            bad |= changed && !fresh && length == 0;
+            length = fresh ? new_length : length;
+            trail = fresh ? 64 - std::min(new_lead + new_length, 64u) : trail;
+            unsigned header = changed ? (fresh ? 13 : 2) : 1;
+            unsigned payload = changed ? length : 0;
+            uint64_t x;
+            if (header + payload <= 57) {
+                x = control >> header & (payload ? ~0ULL >> (64 - payload) : 0);
+                bits.skip(header + payload);
+            } else {
+                bits.skip(header);
+                x = bits.get(payload);
+            }
+            values[i] = values[i - 1] ^ x << trail;
+        }
+        if (bad) return false;
+        return !bits.overrun();
+    }
+
+    // Largest XOR-delta block of `n` values: a new window for every value.
+    inline size_t xor_max_size(size_t n) {
+        return (64 + (n > 0 ? n - 1 : 0) * (2 + 5 + 6 + 64) + 7) / 8;
+    }
+
+    // Float block layouts of PackedKind::FLOAT_XOR: u8 mode, then 8 * count
+    // bytes of byte planes, or a varint byte size and the XOR-delta bits.
+    constexpr uint8_t FLOAT_BLOCK_PLANES = 0;
+    constexpr uint8_t FLOAT_BLOCK_XOR = 1;
+
+    // Append the `n` exact floats to `out` as FLOAT_XOR blocks. XOR-delta
+    // coding is kept for a block when it needs at most six bytes per value
+    // before compression: the bit stream still shrinks under zstd, while byte
+    // planes of noisy series rarely get below five or six.
+    inline void pack_floats(PyObject *const *items, Py_ssize_t n, std::vector<uint8_t> &out) {
+        uint64_t values[PACKED_BLOCK_ITEMS];
+        std::vector<uint8_t> coded;
+        for (Py_ssize_t start = 0; start < n; start += PACKED_BLOCK_ITEMS) {
+            auto count = static_cast<size_t>(std::min(PACKED_BLOCK_ITEMS, n - start));
+            for (size_t i = 0; i < count; i++) {
+                double value = PyFloat_AS_DOUBLE(items[start + i]);
+                std::memcpy(&values[i], &value, sizeof(value));
+            }
+            coded.clear();
+            xor_encode(values, count, coded);
+            if (coded.size() <= 6 * count) {
+                out.push_back(FLOAT_BLOCK_XOR);
+                append_varint(out, coded.size());
+                out.insert(out.end(), coded.begin(), coded.end());
+            } else {
+                out.push_back(FLOAT_BLOCK_PLANES);
+                size_t pos = out.size();
+                out.resize(pos + 8 * count);
+                split_planes(values, count, out.data() + pos);
+            }
+        }
+    }
+
+    // Floats for the `n` decoded bit patterns, stored into the empty slots `dst`.
+    inline bool make_floats(const uint64_t *values, Py_ssize_t n, PyObject **dst) {
+        for (Py_ssize_t i = 0; i < n; i++) {
+            double value;
+            std::memcpy(&value, &values[i], sizeof(value));
+            dst[i] = PyFloat_FromDouble(value);
+            if (!dst[i]) return false;
+        }
+        return true;
+    }
+
+    // Frame-of-reference int block: u8 mode, u8 width, varint
+    // zigzag(reference), in delta mode varint zigzag(first value), then
+    // `width`-bit values packed LSB first into ceil(count * width / 8) bytes.
+    // Plain mode packs value - reference for every value; delta mode packs
+    // (value - previous value) - reference for every value after the first.
+    // All arithmetic wraps modulo 2^64.
+    constexpr uint8_t INT_BLOCK_PLAIN = 0;
+    constexpr uint8_t INT_BLOCK_DELTA = 1;
+
+    struct IntBlockHeader {
+        uint8_t mode = INT_BLOCK_PLAIN;
+        uint8_t width = 0;
+        uint64_t reference = 0;
+        uint64_t first = 0;
+
+        [[nodiscard]] bool valid() const { return mode <= INT_BLOCK_DELTA && width <= 64; }
+
+        // Bytes of packed values that follow the header of a block of `count`.
+        [[nodiscard]] size_t data_size(size_t count) const {
+            size_t packed = mode == INT_BLOCK_DELTA && count > 0 ? count - 1 : count;
+            return (packed * width + 7) / 8;
+        }
+    };
+
+    // Append the `n` values (each below 2^width) to `out`, `width` bits each.
+    inline void put_bits(const uint64_t *values, size_t n, unsigned width, std::vector<uint8_t> &out) {
+        size_t pos = out.size();
+        out.resize(pos + (n * width + 7) / 8);
+        if (width == 0) return;
+        uint8_t *dst = out.data() + pos;
+        uint64_t acc = 0;
+        unsigned fill = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t value = values[i];
+            acc |= value << fill;
+            fill += width;
+            if (fill >= 64) {
+                for (int b = 0; b < 8; b++) *dst++ = static_cast<uint8_t>(acc >> (8 * b));
+                fill -= 64;
+                acc = fill ? value >> (width - fill) : 0;
+            }
+        }
+        for (unsigned b = 0; b < (fill + 7) / 8; b++) *dst++ = static_cast<uint8_t>(acc >> (8 * b));
+    }
+
+    // Inverse of put_bits(): read `n` values of `width` bits from `in`.
+    inline void get_bits(const uint8_t *in, size_t n, unsigned width, uint64_t *values) {
+        if (width == 0) {
+            std::fill(values, values + n, 0);
+            return;
+        }
+        size_t size = (n * width + 7) / 8;
+        size_t next = 0;
+        auto load = [&]() {
+            uint64_t word = 0;
+            size_t avail = std::min<size_t>(8, size - std::min(next, size));
+            for (size_t b = 0; b < avail; b++) word |= static_cast<uint64_t>(in[next + b]) << (8 * b);
+            next += 8;
+            return word;
+        };
+        uint64_t mask = width == 64 ? ~0ULL : (1ULL << width) - 1;
+        uint64_t word = load();
+        unsigned used = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t value = word >> used;
+            used += width;
+            if (used >= 64) {
+                used -= 64;
+                word = load();
+                if (used) value |= word << (width - used);
+            }
+            values[i] = value & mask;
+        }
+    }
+
+    // Append one block of `n` int64 values (as their bit patterns) to `out`,
+    // in whichever mode needs fewer bits. `values` is overwritten.
+    inline void pack_int_block(uint64_t *values, size_t n, std::vector<uint8_t> &out) {
+        int64_t lo = INT64_MAX, hi = INT64_MIN;
+        int64_t delta_lo = INT64_MAX, delta_hi = INT64_MIN;
+        for (size_t i = 0; i < n; i++) {
+            auto value = static_cast<int64_t>(values[i]);
+            lo = std::min(lo, value);
+            hi = std::max(hi, value);
+            if (i > 0) {
+                auto delta = static_cast<int64_t>(values[i] - values[i - 1]);
+                delta_lo = std::min(delta_lo, delta);
+                delta_hi = std::max(delta_hi, delta);
+            }
+        }
+        IntBlockHeader header;
+        header.width = static_cast<uint8_t>(std::bit_width(static_cast<uint64_t>(hi) - static_cast<uint64_t>(lo)));
+        header.reference = static_cast<uint64_t>(lo);
+        if (n > 1) {
+            auto delta_width = static_cast<uint8_t>(
+                std::bit_width(static_cast<uint64_t>(delta_hi) - static_cast<uint64_t>(delta_lo)));
+            if (delta_width < header.width) {
+                header.mode = INT_BLOCK_DELTA;
+                header.width = delta_width;
+                header.reference = static_cast<uint64_t>(delta_lo);
+                header.first = values[0];
+            }
+        }
+        out.push_back(header.mode);
+        out.push_back(header.width);
+        append_varint(out, zigzag(static_cast<int64_t>(header.reference)));
+        if (header.mode == INT_BLOCK_DELTA) {
+            append_varint(out, zigzag(static_cast<int64_t>(header.first)));
+            for (size_t i = n; i-- > 1;) values[i] = values[i] - values[i - 1] - header.reference;
+            put_bits(values + 1, n - 1, header.width, out);
+        } else {
+            for (size_t i = 0; i < n; i++) values[i] -= header.reference;
+            put_bits(values, n, header.width, out);
+        }
+    }
+
+    // Decode the `n` values of a block from its packed data.
+    inline void unpack_int_block(const IntBlockHeader &header, const uint8_t *data, size_t n, uint64_t *values) {
+        if (n == 0) return;
+        if (header.mode == INT_BLOCK_DELTA) {
+            values[0] = header.first;
+            get_bits(data, n - 1, header.width, values + 1);
+            for (size_t i = 1; i < n; i++) values[i] += values[i - 1] + header.reference;
+        } else {
+            get_bits(data, n, header.width, values);
+            for (size_t i = 0; i < n; i++) values[i] += header.reference;
+        }
+    }
+
+    // Read a block header at `pos`, advancing it. False if it is cut short or
+    // invalid.
+    inline bool parse_int_header(const uint8_t *&pos, const uint8_t *end, IntBlockHeader &header) {
+        if (end - pos < 2) return false;
+        header.mode = *pos++;
+        header.width = *pos++;
+        uint64_t reference, first = 0;
+        if (!header.valid() || !parse_varint(pos, end, reference)) return false;
+        if (header.mode == INT_BLOCK_DELTA && !parse_varint(pos, end, first)) return false;
+        header.reference = static_cast<uint64_t>(unzigzag(reference));
+        header.first = static_cast<uint64_t>(unzigzag(first));
+        return true;
+    }
+
+    // Append the `n` exact ints to `out` as INT_FOR blocks. Returns false
+    // (without a Python error) if an int does not fit int64.
+    inline bool pack_ints(PyObject *const *items, Py_ssize_t n, std::vector<uint8_t> &out) {
+        uint64_t values[PACKED_BLOCK_ITEMS];
+        for (Py_ssize_t start = 0; start < n; start += PACKED_BLOCK_ITEMS) {
+            Py_ssize_t count = std::min(PACKED_BLOCK_ITEMS, n - start);
+            for (Py_ssize_t i = 0; i < count; i++) {
+                int64_t value;
+                if (!int64_value(items[start + i], value)) return false;
+                values[i] = static_cast<uint64_t>(value);
+            }
+            pack_int_block(values, static_cast<size_t>(count), out);
+        }
+        return true;
+    }
+
+    // Ints for the `n` decoded values, stored into the empty slots `dst`.
+    inline bool make_ints(const uint64_t *values, Py_ssize_t n, PyObject **dst) {
+        for (Py_ssize_t i = 0; i < n; i++) {
+            dst[i] = PyLong_FromLongLong(static_cast<long long>(values[i]));
+            if (!dst[i]) return false;
+        }
+        return true;
+    }
+
+    // Create `n` floats from byte planes of their bits into the empty
+    // slots `dst` of a fresh list or tuple. Decoding may proceed block by
+    // block as long as each call starts on a block boundary. Returns false
+    // with a Python error set; slots filled so far belong to the container.
+    inline bool unpack_float_planes(const uint8_t *data, Py_ssize_t n, PyObject **dst) {
+        uint64_t values[PACKED_BLOCK_ITEMS];
+        for (Py_ssize_t start = 0; start < n; start += PACKED_BLOCK_ITEMS) {
+            Py_ssize_t count = std::min(PACKED_BLOCK_ITEMS, n - start);
+            join_planes(data + 8 * start, count, values);
+            PyObject **block = dst + start;
+            for (Py_ssize_t i = 0; i < count; i++) {
+                double value;
+                std::memcpy(&value, &values[i], sizeof(value));
+                block[i] = PyFloat_FromDouble(value);
+                if (!block[i]) return false;
+            }
+        }
+        return true;
+    }
+} // namespace pyser
@@ -1,53 +1,60 @@
 // pyser.cpp
 #include "pyser.hpp"
-#include <openssl/sha.h>
+#include "identity_table.h"
+#include "packed_array.h"
+#include "chunk_encoder.h"
 #include <nlohmann/json.hpp>
-#include <cppcodec/base64_rfc4648.hpp>
+#include "base64.h"
 #include <Python.h>
 
 namespace pyser {
     using json = nlohmann::json;
-    using base64 = cppcodec::base64_rfc4648;
 
 
-    std::vector<DataChunk> PyObjectSerializer::create_chunks(
+    std::pmr::vector<DataChunk> PyObjectSerializer::create_chunks(
         const std::vector<uint8_t> &data
     ) {
-        std::vector<DataChunk> chunks;
+        return create_chunks(std::span<const uint8_t>(data.data(), data.size()), false);
+    }
+
+    // Split `data` into chunks. With `view` the chunks reference `data`, which
+    // must outlive them (and may be `writable` by Python code); otherwise each
+    // chunk copies its slice. base64 and hashes are left to encode_chunks()
+    // once the walk is done.
+    std::pmr::vector<DataChunk> PyObjectSerializer::create_chunks(
+        std::span<const uint8_t> data, bool view, bool writable
+    ) {
+        std::pmr::vector<DataChunk> chunks(arena_);
+        chunks.reserve((data.size() + CHUNK_SIZE - 1) / CHUNK_SIZE);
         size_t offset = 0;
 
         while (offset < data.size()) {
-            DataChunk chunk;
+            DataChunk chunk(arena_);
             chunk.chunk_id = next_chunk_id_++;
             size_t chunk_size = std::min(CHUNK_SIZE, data.size() - offset);
-            chunk.raw_data.assign(
-                data.begin() + offset,
-                data.begin() + offset + chunk_size
-            );
+            std::span<const uint8_t> slice = data.subspan(offset, chunk_size);
+            if (view) {
+                chunk.view = slice;
+                chunk.writable = writable;
+            } else {
+                chunk.raw_data.assign(slice.begin(), slice.end());
+            }
             chunk.original_size = chunk_size;
-            chunk.base64_data = base64::encode(chunk.raw_data);
-            chunk.sha256_hash = compute_sha256(chunk.raw_data);
-            chunks.push_back(chunk);
+            chunks.push_back(std::move(chunk));
             offset += chunk_size;
         }
 
         return chunks;
     }
 
-    std::string PyObjectSerializer::compute_sha256(const std::vector<uint8_t> &data) {
-        unsigned char hash[SHA256_DIGEST_LENGTH];
-        SHA256(data.data(), data.size(), hash);
-        char hex[SHA256_DIGEST_LENGTH * 2 + 1];
-        for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-            sprintf(hex + i * 2, "%02x", hash[i]);
-        }
-        hex[SHA256_DIGEST_LENGTH * 2] = '\0';
-
-        return {hex};
+    std::string PyObjectSerializer::compute_sha256(const uint8_t *data, size_t size) {
+        std::string hex(SHA256_HEX_SIZE, '\0');
+        sha256_hex(data, size, hex.data());
+        return hex;
     }
 
     SerializedNode PyObjectSerializer::serialize_bigint(PyObject *obj) {
-        SerializedNode node;
+        SerializedNode node(arena_);
         node.type = NodeType::INT;
         node.meta.type_name = "int";
         node.meta.is_bigint = true;
@@ -79,7 +86,7 @@ namespace pyser {
     }
 
     SerializedNode PyObjectSerializer::serialize_int(PyObject *obj) {
-        SerializedNode node;
+        SerializedNode node(arena_);
         node.type = NodeType::INT;
         node.meta.type_name = "int";
         node.meta.refcount = 1;
@@ -95,36 +102,44 @@ namespace pyser {
             return serialize_bigint(obj);
         }
         node.meta.is_bigint = false;
-        std::vector<uint8_t> raw_data(sizeof(long long));
-        std::memcpy(raw_data.data(), &value, sizeof(long long));
+        // Zigzag varint. Older writers stored 8 raw bytes, so an 8-byte varint
+        // gets a redundant ninth byte to keep the two apart.
+        std::vector<uint8_t> raw_data;
+        append_varint(raw_data, zigzag(value));
+        if (raw_data.size() == sizeof(long long)) {
+            raw_data.back() |= 0x80;
+            raw_data.push_back(0);
+        }
         node.chunks = create_chunks(raw_data);
         return node;
     }
 
     SerializedNode PyObjectSerializer::serialize_string(PyObject *obj) {
-        SerializedNode node;
+        SerializedNode node(arena_);
         node.type = NodeType::STRING;
         node.meta.type_name = "str";
         node.meta.refcount = 1;
         node.meta.has_dict = false;
-        Py_ssize_t size;
-        const char *data = PyUnicode_AsUTF8AndSize(obj, &size);
-        std::vector<uint8_t> raw_data(data, data + size);
-        node.meta.total_size = size;
+        StrUnits units;
+        if (!str_units(obj, units)) return node;
+        std::vector<uint8_t> raw_data;
+        if (units.width == StrWidth::ASCII) {
+            const auto *data = static_cast<const uint8_t *>(units.data);
+            raw_data.assign(data, data + units.length);
+        } else {
+            node.type = NodeType::STR_UNITS;
+            append_varint(raw_data, units.header());
+            append_str_units(raw_data, units);
+        }
+        node.meta.total_size = units.size();
         node.chunks = create_chunks(raw_data);
         return node;
     }
 
-    // Update signatures to accept owner node id for pointer population
-    SerializedNode PyObjectSerializer::serialize_container(
-        PyObject *obj,
-        NodeType type,
-        SerializedGraph &graph,
-        std::unordered_map<PyObject *, uint32_t> &visited,
-        int depth,
-        uint32_t owner_node_id
-    ) {
-        SerializedNode node;
+    // Container nodes only carry metadata here; their children are produced by
+    // next_child()/attach_child() as the walk loop in serialize() gets to them.
+    SerializedNode PyObjectSerializer::serialize_container(PyObject *obj, NodeType type) {
+        SerializedNode node(arena_);
         node.type = type;
         node.meta.refcount = 1;
         Py_ssize_t size;
@@ -137,6 +152,9 @@ namespace pyser {
         } else if (type == NodeType::SET) {
             size = PySet_Size(obj);
             node.meta.type_name = "set";
+        } else if (type == NodeType::FROZENSET) {
+            size = PySet_Size(obj);
+            node.meta.type_name = "frozenset";
         } else {
             PyErr_SetString(PyExc_TypeError, "Unsupported container type");
             node.meta.has_dict = false;
@@ -145,38 +163,59 @@ namespace pyser {
         }
         node.meta.has_dict = false;
         node.meta.total_size = size;
-        for (Py_ssize_t i = 0; i < size; i++) {
-            PyObject *item = nullptr;
-            if (type == NodeType::LIST) {
-                item = PyList_GetItem(obj, i);
-            } else if (type == NodeType::TUPLE) {
-                item = PyTuple_GetItem(obj, i);
-            } else {
-                PyObject *iter = PyObject_GetIter(obj);
-                for (Py_ssize_t j = 0; j <= i; j++) {
-                    item = PyIter_Next(iter);
-                }
-                Py_DECREF(iter);
+        return node;
+    }
+
+    // Entry table and code units of a packed string array (packed_array.h).
+    // Repeats of a string object refer back to its first index. Returns
+    // false (without an error) if a string cannot be read.
+    static bool pack_strings(PyObject *const *items, Py_ssize_t n, std::vector<uint8_t> &raw_data) {
+        IdentityTable seen(static_cast<size_t>(n));
+        std::vector<StrUnits> strings(n);
+        for (Py_ssize_t i = 0; i < n; i++) {
+            auto [first, inserted] = seen.try_emplace(items[i], static_cast<uint32_t>(i));
+            if (!inserted) {
+                append_varint(raw_data, static_cast<uint64_t>(first) << 1 | 1);
+                continue;
             }
-            if (!item) continue;
-            uint32_t child_id = serialize_recursive(item, graph, visited, depth + 1);
-            if (child_id == UINT32_MAX) {
-                return node;
+            if (!str_units(items[i], strings[i])) {
+                PyErr_Clear();
+                return false;
             }
-            PointerInfo ptr;
-            ptr.from_node_id = owner_node_id;
-            ptr.from_chunk_id = 0;
-            ptr.offset = i * sizeof(void *);
-            ptr.to_node_id = child_id;
-            ptr.field_name = std::to_string(i);
-            node.pointers.push_back(ptr);
-            graph.all_pointers.push_back(ptr);
+            append_varint(raw_data, strings[i].header() << 1);
         }
-        return node;
+        for (const StrUnits &units: strings) append_str_units(raw_data, units);
+        return true;
+    }
+
+    // A list or tuple of plain ints, floats or strings becomes a single node
+    // whose chunks hold the packed elements. Returns false when `obj` does
+    // not qualify.
+    bool PyObjectSerializer::serialize_packed(PyObject *obj, SerializedNode &node) {
+        Py_ssize_t n = PySequence_Fast_GET_SIZE(obj);
+        PyObject **items = PySequence_Fast_ITEMS(obj);
+        PackedKind kind = packed_kind(items, n);
+        if (kind == PackedKind::NONE) return false;
+        std::vector<uint8_t> raw_data;
+        if (kind == PackedKind::STR_UNITS) {
+            if (!pack_strings(items, n, raw_data)) return false;
+            node.type = NodeType::STR_ARRAY;
+        } else if (kind == PackedKind::INT_FOR) {
+            if (!pack_ints(items, n, raw_data)) return false;
+            node.type = NodeType::INT_ARRAY;
+        } else {
+            pack_floats(items, n, raw_data);
+            node.type = NodeType::FLOAT_ARRAY;
+        }
+        node.meta.type_name = PyTuple_Check(obj) ? "tuple" : "list";
+        node.meta.refcount = 1;
+        node.meta.total_size = n;
+        node.chunks = create_chunks(raw_data);
+        return true;
     }
 
     SerializedNode PyObjectSerializer::serialize_float(PyObject *obj) {
-        SerializedNode node;
+        SerializedNode node(arena_);
         node.type = NodeType::FLOAT;
         node.meta.type_name = "float";
         node.meta.refcount = 1;
@@ -194,115 +233,94 @@ namespace pyser {
         return node;
     }
 
-    SerializedNode PyObjectSerializer::serialize_bytes(PyObject *obj) {
-        SerializedNode node;
+    SerializedNode PyObjectSerializer::serialize_bytes(PyObject *obj, SerializedGraph &graph) {
+        SerializedNode node(arena_);
         node.type = NodeType::BYTES;
-        node.meta.type_name = "bytes";
         node.meta.refcount = 1;
-
-        // Support multiple bytes-like objects: bytes, bytearray, memoryview, and
-        // any object that supports the buffer protocol. We copy the buffer
-        // contents into a local vector so it's safe to chunk and transport.
-        std::vector<uint8_t> raw_data;
-
-        // bytes
         if (PyBytes_Check(obj)) {
-            char *data = nullptr;
-            Py_ssize_t size = 0;
-            if (PyBytes_AsStringAndSize(obj, &data, &size) != 0) {
-                PyErr_SetString(PyExc_TypeError, "Failed to get bytes data");
-                return node;
-            }
-            raw_data.assign(reinterpret_cast<uint8_t *>(data), reinterpret_cast<uint8_t *>(data) + size);
             node.meta.type_name = "bytes";
-        }
-        // bytearray
-        else if (PyByteArray_Check(obj)) {
-            char *data = PyByteArray_AsString(obj);
-            Py_ssize_t size = PyByteArray_Size(obj);
-            raw_data.assign(reinterpret_cast<uint8_t *>(data), reinterpret_cast<uint8_t *>(data) + size);
+        } else if (PyByteArray_Check(obj)) {
             node.meta.type_name = "bytearray";
-        }
-        // memoryview or other buffer-supporting objects
-        else if (PyMemoryView_Check(obj) || PyObject_CheckBuffer(obj)) {
-            Py_buffer view;
-            // Request a readonly contiguous buffer view for simplicity
-            if (PyObject_GetBuffer(obj, &view, PyBUF_CONTIG_RO) != 0) {
-                PyErr_SetString(PyExc_TypeError, "Failed to get buffer from object");
-                return node;
-            }
-            raw_data.assign(reinterpret_cast<uint8_t *>(view.buf), reinterpret_cast<uint8_t *>(view.buf) + view.len);
-            if (PyMemoryView_Check(obj)) {
-                node.meta.type_name = "memoryview";
-            } else {
-                node.meta.type_name = "buffer";
-            }
-            PyBuffer_Release(&view);
+        } else if (PyMemoryView_Check(obj)) {
+            node.meta.type_name = "memoryview";
         } else {
-            PyErr_SetString(PyExc_TypeError, "Expected a bytes-like object");
-            return node;
+            node.meta.type_name = "buffer";
         }
 
-        node.chunks = create_chunks(raw_data);
+        // The chunks are views into the object's buffer, which the graph holds
+        // from here on: the data is never copied, only encoded. A bytearray
+        // cannot be resized while the graph is alive.
+        Py_buffer view;
+        if (PyObject_GetBuffer(obj, &view, PyBUF_CONTIG_RO) != 0) {
+            PyErr_SetString(PyExc_TypeError, "Failed to get buffer from object");
+            return node;
+        }
+        graph.buffers.emplace_back(view);
+        auto size = static_cast<size_t>(view.len);
+        bool out_of_band;
+        uint64_t index;
+        if (!buffer_callback_.offer(obj, size, out_of_band, index)) return node;
+        if (out_of_band) {
+            graph.buffers.pop_back();
+            node.type = NodeType::OUT_OF_BAND;
+            std::vector<uint8_t> placeholder{static_cast<uint8_t>(buffer_kind(obj))};
+            append_varint(placeholder, index);
+            append_varint(placeholder, size);
+            node.chunks = create_chunks(placeholder);
+            return node;
+        }
+        node.chunks = create_chunks(graph.buffers.back().bytes(), true, !view.readonly);
 
         return node;
     }
 
 
-    SerializedNode PyObjectSerializer::serialize_dict(
-        PyObject *obj,
-        SerializedGraph &graph,
-        std::unordered_map<PyObject *, uint32_t> &visited,
-        int depth,
-        uint32_t owner_node_id
-    ) {
-        SerializedNode node;
+    // numpy array with a native dtype (ndarray.h). The first chunk holds the
+    // header and where the data is; the data chunks are views into the array,
+    // which the graph holds like the buffer of a bytes object.
+    SerializedNode PyObjectSerializer::serialize_ndarray(PyObject *obj, SerializedGraph &graph) {
+        SerializedNode node(arena_);
+        node.type = NodeType::NDARRAY;
+        node.meta.type_name = "numpy.ndarray";
+        node.meta.refcount = 1;
+        ArrayData array;
+        bool native;
+        if (!ndarray_data(obj, array, native)) return node;
+        if (!native) {
+            // The custom-object path cannot rebuild these either.
+            PyErr_SetString(PyExc_TypeError, "Cannot serialize numpy arrays of object or structured dtype "
+                            "in the graph format");
+            return node;
+        }
+        bool out_of_band;
+        uint64_t index;
+        if (!buffer_callback_.offer(array.owner, array.header.size, out_of_band, index)) return node;
+        std::vector<uint8_t> header;
+        append_ndarray_header(header, array.header);
+        header.push_back(out_of_band ? 1 : 0);
+        if (out_of_band) append_varint(header, index);
+        node.chunks = create_chunks(header);
+        if (!out_of_band) {
+            std::span<const uint8_t> data(array.data, array.header.size);
+            graph.buffers.emplace_back(array.owner, data);
+            array.owner = nullptr;
+            for (DataChunk &chunk: create_chunks(data, true, array.writable)) node.chunks.push_back(std::move(chunk));
+        }
+        return node;
+    }
+
+    SerializedNode PyObjectSerializer::serialize_dict(PyObject *obj) {
+        SerializedNode node(arena_);
         node.type = NodeType::DICT;
         node.meta.type_name = "dict";
         node.meta.refcount = 1;
         node.meta.has_dict = true;
-        PyObject *key, *value;
-        Py_ssize_t pos = 0;
-        while (PyDict_Next(obj, &pos, &key, &value)) {
-            // Key
-            uint32_t key_id = serialize_recursive(key, graph, visited, depth + 1);
-            if (key_id == UINT32_MAX) return node;
-            // Value
-            uint32_t value_id = serialize_recursive(value, graph, visited, depth + 1);
-            if (value_id == UINT32_MAX) return node;
-            PyObject *key_str = PyObject_Str(key);
-            const char *key_cstr = PyUnicode_AsUTF8(key_str);
-            std::string key_name(key_cstr);
-            Py_DECREF(key_str);
-            node.meta.attr_names.push_back(key_name);
-            node.meta.attr_node_ids[key_name] = value_id;
-            PointerInfo ptr_key, ptr_val;
-            ptr_key.from_node_id = owner_node_id;
-            ptr_key.from_chunk_id = 0;
-            ptr_key.offset = 0;
-            ptr_key.to_node_id = key_id;
-            ptr_key.field_name = "key:" + key_name;
-            ptr_val.from_node_id = owner_node_id;
-            ptr_val.from_chunk_id = 0;
-            ptr_val.offset = 0;
-            ptr_val.to_node_id = value_id;
-            ptr_val.field_name = "val:" + key_name;
-            node.pointers.push_back(ptr_key);
-            node.pointers.push_back(ptr_val);
-            graph.all_pointers.push_back(ptr_key);
-            graph.all_pointers.push_back(ptr_val);
-        }
+        node.meta.total_size = PyDict_Size(obj);
         return node;
     }
 
-    SerializedNode PyObjectSerializer::serialize_function(
-        PyObject *obj,
-        SerializedGraph &graph,
-        std::unordered_map<PyObject *, uint32_t> &visited,
-        int depth,
-        uint32_t owner_node_id
-    ) {
-        SerializedNode node;
+    SerializedNode PyObjectSerializer::serialize_function(PyObject *obj) {
+        SerializedNode node(arena_);
         node.type = NodeType::FUNCTION;
         node.meta.type_name = "function";
         node.meta.refcount = 1;
@@ -311,165 +329,26 @@ namespace pyser {
             node.meta.module_name = PyUnicode_AsUTF8(name);
             Py_DECREF(name);
         }
-        PyObject *code_obj = PyObject_GetAttrString(obj, "__code__");
-        if (code_obj) {
-            PyObject *code_bytes = PyObject_GetAttrString(code_obj, "co_code");
-            PyObject *consts = PyObject_GetAttrString(code_obj, "co_consts");
-            PyObject *names = PyObject_GetAttrString(code_obj, "co_names");
-            PyObject *varnames = PyObject_GetAttrString(code_obj, "co_varnames");
-            PyObject *filename = PyObject_GetAttrString(code_obj, "co_filename");
-            PyObject *name_co = PyObject_GetAttrString(code_obj, "co_name");
-            PyObject *lnotab = PyObject_GetAttrString(code_obj, "co_lnotab");
-            PyObject *freevars = PyObject_GetAttrString(code_obj, "co_freevars");
-            PyObject *cellvars = PyObject_GetAttrString(code_obj, "co_cellvars");
-            PyObject *argcount = PyObject_GetAttrString(code_obj, "co_argcount");
-            PyObject *posonlyargcount = PyObject_GetAttrString(code_obj, "co_posonlyargcount");
-            PyObject *kwonlyargcount = PyObject_GetAttrString(code_obj, "co_kwonlyargcount");
-            PyObject *nlocals = PyObject_GetAttrString(code_obj, "co_nlocals");
-            PyObject *stacksize = PyObject_GetAttrString(code_obj, "co_stacksize");
-            PyObject *flags = PyObject_GetAttrString(code_obj, "co_flags");
-            PyObject *firstlineno = PyObject_GetAttrString(code_obj, "co_firstlineno");
-            PyObject *qualname = PyObject_GetAttrString(obj, "__qualname__");
-            if (code_bytes && PyBytes_Check(code_bytes)) {
-                Py_ssize_t size = PyBytes_Size(code_bytes);
-                json j_data{};
-                const char *data = PyBytes_AsString(code_bytes);
-                //                auto j_consts = serialize(consts);
-                //                auto j_names = serialize(names);
-                //                auto j_varnames = serialize(varnames);
-                //                auto j_filename = serialize(filename);
-                //                auto j_name_co = serialize(name_co);
-                //                auto j_lnotab = serialize(lnotab);
-                //                auto j_freevars = serialize(freevars);
-                //                auto j_cellvars = serialize(cellvars);
-                //                auto j_argcount = (argcount && PyLong_Check(argcount)) ? PyLong_AsLongLong(argcount) : 0;
-                //                auto j_posonlyargcount = (posonlyargcount && PyLong_Check(posonlyargcount)) ? PyLong_AsLongLong(posonlyargcount) : 0;
-                //                auto j_kwonlyargcount = (kwonlyargcount && PyLong_Check(kwonlyargcount)) ? PyLong_AsLongLong(kwonlyargcount) : 0;
-                //                auto j_nlocals = (nlocals && PyLong_Check(nlocals)) ? PyLong_AsLongLong(nlocals) : 0;
-                //                auto j_stacksize = (stacksize && PyLong_Check(stacksize)) ? PyLong_AsLongLong(stacksize) : 0;
-                //                auto j_flags = (flags && PyLong_Check(flags)) ? PyLong_AsLongLong(flags) : 0;
-                //                auto j_firstlineno = (firstlineno && PyLong_Check(firstlineno)) ? PyLong_AsLongLong(firstlineno) : 0;
-                //                auto j_qualname = serialize(qualname);
-                //                // Code bytes may contain arbitrary binary data (not valid UTF-8).
-                //                // Encode the raw bytes as base64 so the JSON string is valid.
-                //                std::vector<uint8_t> code_bytes_vec(reinterpret_cast<const uint8_t *>(data),
-                //                                                    reinterpret_cast<const uint8_t *>(data) + size);
-                //                j_data["data"] = base64::encode(code_bytes_vec);
-                //                // SerializedGraph::to_bytes() returns binary data; base64-encode
-                //                // to ensure the JSON fields are valid UTF-8 strings.
-                //                std::string consts_b64 = base64::encode(j_consts.to_bytes());
-                //                std::string names_b64 = base64::encode(j_names.to_bytes());
-                //                std::string varnames_b64 = base64::encode(j_varnames.to_bytes());
-                //                std::string filename_b64 = base64::encode(j_filename.to_bytes());
-                //                std::string name_b64 = base64::encode(j_name_co.to_bytes());
-                //                std::string lnotab_b64 = base64::encode(j_lnotab.to_bytes());
-                //                std::string freevars_b64 = base64::encode(j_freevars.to_bytes());
-                //                std::string cellvars_b64 = base64::encode(j_cellvars.to_bytes());
-                //                std::string qualname_b64 = base64::encode(j_qualname.to_bytes());
-                //
-                //                // Diagnostic logging to stderr to help debug invalid UTF-8 during JSON dump
-                //                fprintf(stderr, "pyser: func code bytes=%zu consts_b64_len=%zu names_b64_len=%zu varnames_b64_len=%zu filename_b64_len=%zu name_b64_len=%zu lnotab_b64_len=%zu qualname_b64_len=%zu\n",
-                //                        code_bytes_vec.size(), consts_b64.size(), names_b64.size(), varnames_b64.size(), filename_b64.size(), name_b64.size(), lnotab_b64.size(), qualname_b64.size());
-                //                if (!consts_b64.empty()) fprintf(stderr, "pyser: consts_b64_prefix=%c%c%c\n", consts_b64[0], consts_b64[1], consts_b64[2]);
-                //
-                //                j_data["consts"] = consts_b64;
-                //                j_data["names"] = names_b64;
-                //                j_data["varnames"] = varnames_b64;
-                //                j_data["filename"] = filename_b64;
-                //                j_data["name"] = name_b64;
-                //                j_data["lnotab"] = lnotab_b64;
-                //                j_data["freevars"] = freevars_b64;
-                //                j_data["cellvars"] = cellvars_b64;
-                //                j_data["argcount"] = j_argcount;
-                //                j_data["posonlyargcount"] = j_posonlyargcount;
-                //                j_data["kwonlyargcount"] = j_kwonlyargcount;
-                //                j_data["nlocals"] = j_nlocals;
-                //                j_data["stacksize"] = j_stacksize;
-                //                j_data["flags"] = j_flags;
-                //                j_data["firstlineno"] = j_firstlineno;
-                //                j_data["qualname"] = base64::encode(j_qualname.to_bytes());
-                //                std::string dump_str;
-                //                try {
-                //                    dump_str = j_data.dump();
-                //                } catch (const nlohmann::json::exception &ex) {
-                //                    fprintf(stderr, "pyser: j_data.dump() failed: %s\n", ex.what());
-                //                    fprintf(stderr, "pyser: j_data keys and sizes:\n");
-                //                    if (j_data.contains("data")) fprintf(stderr, " data_len=%zu\n", j_data["data"].get<std::string>().size());
-                //                    if (j_data.contains("consts")) fprintf(stderr, " consts_len=%zu\n", j_data["consts"].get<std::string>().size());
-                //                    if (j_data.contains("names")) fprintf(stderr, " names_len=%zu\n", j_data["names"].get<std::string>().size());
-                //                    if (j_data.contains("varnames")) fprintf(stderr, " varnames_len=%zu\n", j_data["varnames"].get<std::string>().size());
-                //                    if (j_data.contains("filename")) fprintf(stderr, " filename_len=%zu\n", j_data["filename"].get<std::string>().size());
-                //                    if (j_data.contains("name")) fprintf(stderr, " name_len=%zu\n", j_data["name"].get<std::string>().size());
-                //                    if (j_data.contains("lnotab")) fprintf(stderr, " lnotab_len=%zu\n", j_data["lnotab"].get<std::string>().size());
-                //                    if (j_data.contains("qualname")) fprintf(stderr, " qualname_len=%zu\n", j_data["qualname"].get<std::string>().size());
-                //                    throw;
-                //                }
-                //                node.meta.func_code = base64::encode(
-                //                    std::vector<uint8_t>(dump_str.begin(), dump_str.end())
-                //                );
-                // Use JSON-based serialization instead of Python's marshal.
-                // This gives us full control and cross-version compatibility.
-                // Clear any custom __reduce__ attribute on the original function
-                // object before serialization. Some user code installs a __reduce__
-                // hook that can influence pickling semantics. Removing it ensures
-                // we operate only on the code object.
-                if (PyObject_HasAttrString(obj, "__reduce__")) {
-                    // Try to delete the attribute; ignore failures.
-                    if (PyObject_DelAttrString(obj, "__reduce__") < 0) {
-                        PyErr_Clear();
-                    }
-                }
-                node.meta.func_code.clear();
-                // Serialize code object to JSON and encode as base64
-                json code_json = pyobj_to_json(code_obj);
-                std::string json_str = code_json.dump();
-                std::vector<uint8_t> json_bytes(json_str.begin(), json_str.end());
-                node.meta.func_code = base64::encode(json_bytes);
-
-                 // DECREF attribute objects we created
-                 Py_XDECREF(argcount);
-                 Py_XDECREF(posonlyargcount);
-                 Py_XDECREF(kwonlyargcount);
-                 Py_XDECREF(nlocals);
-                 Py_XDECREF(stacksize);
-                 Py_XDECREF(flags);
-                 Py_XDECREF(firstlineno);
-                 Py_XDECREF(qualname);
+        // Clear any custom __reduce__ attribute on the original function
+        // object before serialization. Some user code installs a __reduce__
+        // hook that can influence pickling semantics. Removing it ensures
+        // we operate only on the code object.
+        if (PyObject_HasAttrString(obj, "__reduce__")) {
+            // Try to delete the attribute; ignore failures.
+            if (PyObject_DelAttrString(obj, "__reduce__") < 0) {
+                PyErr_Clear();
             }
-            Py_XDECREF(code_bytes);
-            Py_XDECREF(consts);
-            Py_XDECREF(names);
-            Py_XDECREF(varnames);
-            Py_XDECREF(filename);
-            Py_XDECREF(name_co);
-            Py_XDECREF(lnotab);
-            Py_XDECREF(freevars);
-            Py_XDECREF(cellvars);
-            Py_XDECREF(code_obj);
         }
-        PyObject *closure = PyObject_GetAttrString(obj, "__closure__");
-        if (closure && closure != Py_None) {
-            Py_ssize_t n_cells = PyTuple_Size(closure);
-            for (Py_ssize_t i = 0; i < n_cells; i++) {
-                PyObject *cell = PyTuple_GetItem(closure, i);
-                if (PyObject *cell_contents = PyObject_GetAttrString(cell, "cell_contents")) {
-                    uint32_t cell_id = serialize_recursive(
-                        cell_contents, graph, visited, depth + 1
-                    );
-                    PointerInfo ptr;
-                    ptr.from_node_id = owner_node_id;
-                    ptr.from_chunk_id = 0;
-                    ptr.offset = 0;
-                    ptr.to_node_id = cell_id;
-                    ptr.field_name = "closure:" + std::to_string(i);
-                    node.pointers.push_back(ptr);
-                    graph.all_pointers.push_back(ptr);
-                    Py_DECREF(cell_contents);
-                }
-            }
+        // Each distinct code object is stored once per graph (binary encoding,
+        // see code_codec.h); the node refers to it as "#<index>".
+        uint32_t code_index;
+        bool added;
+        if (!codes_.add(PyFunction_GetCode(obj), code_index, added)) {
+            return node;
         }
-        Py_XDECREF(closure);
-        
+        node.meta.func_code = "#";
+        node.meta.func_code += std::to_string(code_index);
+        // Closure cells are walked as children of the function frame.
         // Serialize __defaults__ (tuple of default positional argument values)
         PyObject *defaults = PyObject_GetAttrString(obj, "__defaults__");
         if (defaults && defaults != Py_None && PyTuple_Check(defaults)) {
@@ -504,7 +383,7 @@ namespace pyser {
     }
 
     SerializedNode PyObjectSerializer::serialize_module(PyObject *obj) {
-        SerializedNode node;
+        SerializedNode node(arena_);
         node.type = NodeType::MODULE;
         node.meta.type_name = "module";
         node.meta.refcount = 1;
@@ -518,14 +397,8 @@ namespace pyser {
         return node;
     }
 
-    SerializedNode PyObjectSerializer::serialize_custom(
-        PyObject *obj,
-        SerializedGraph &graph,
-        std::unordered_map<PyObject *, uint32_t> &visited,
-        int depth,
-        uint32_t owner_node_id
-    ) {
-        SerializedNode node;
+    SerializedNode PyObjectSerializer::serialize_custom(PyObject *obj, PyObject **attrs) {
+        SerializedNode node(arena_);
         node.type = NodeType::CUSTOM;
         node.meta.refcount = 1;
         PyTypeObject *type = Py_TYPE(obj);
@@ -537,126 +410,494 @@ namespace pyser {
         node.meta.total_size = 0;
         node.meta.has_dict = false;
         Py_XDECREF(module);
+        *attrs = nullptr;
         if (PyObject_HasAttrString(obj, "__dict__")) {
             PyObject *dict = PyObject_GetAttrString(obj, "__dict__");
             if (dict && PyDict_Check(dict)) {
                 node.meta.has_dict = true;
-                PyObject *key, *value;
-                Py_ssize_t pos = 0;
-                while (PyDict_Next(dict, &pos, &key, &value)) {
-                    if (!PyUnicode_Check(key)) continue;
-                    const char *attr_name = PyUnicode_AsUTF8(key);
-                    uint32_t value_id = serialize_recursive(value, graph, visited, depth + 1);
-                    if (value_id != UINT32_MAX) {
-                        node.meta.attr_names.emplace_back(attr_name);
-                        node.meta.attr_node_ids[attr_name] = value_id;
-                        PointerInfo ptr;
-                        ptr.from_node_id = owner_node_id;
-                        ptr.from_chunk_id = 0;
-                        ptr.offset = 0;
-                        ptr.to_node_id = value_id;
-                        ptr.field_name = attr_name;
-                        node.pointers.push_back(ptr);
-                        graph.all_pointers.push_back(ptr);
-                    }
+                // Handed to the walk frame, which serializes the attribute values.
+                *attrs = dict;
+            } else {
+                Py_XDECREF(dict);
+            }
+        }
+        const TypePlan &plan = plans_.get(type);
+        if (!plan.slots.empty()) {
+            // __slots__ values live outside __dict__; the walk gets a merged
+            // copy and the deserializer restores them through setattr.
+            PyObject *merged = PyDict_New();
+            if (!merged) return node;
+            for (const SlotMember &slot: plan.slots) {
+                PyObject *value = TypePlanCache::slot_value(obj, slot);
+                if (value && PyDict_SetItem(merged, slot.name, value) < 0) break;
+            }
+            if (PyErr_Occurred() || (*attrs && PyDict_Update(merged, *attrs) < 0)) {
+                Py_DECREF(merged);
+                return node;
+            }
+            Py_XDECREF(*attrs);
+            *attrs = merged;
+            node.meta.has_dict = true;
+        }
+        return node;
+    }
+
+    // One entry of the explicit walk stack: a container whose children are still
+    // being serialized. The node is only pushed to the graph once every child is
+    // done, which keeps the post-order node layout of the old recursive walker.
+    struct PyObjectSerializer::WalkFrame {
+        PyObject *obj = nullptr;    // borrowed, kept alive by the parent
+        PyObject *owned = nullptr;  // custom __dict__, function closure, set iterator, deque items
+                                    // or OrderedDict items
+        PyObject *first = nullptr;  // owned: enum value or defaultdict factory, walked before the rest
+        PyObject *held = nullptr;   // current child if we own a reference to it
+        PyObject *key = nullptr;    // current dict key / attribute name (borrowed)
+        PyObject *value = nullptr;  // value belonging to key (borrowed)
+        SerializedNode node;
+        size_t depth = 0;
+        Py_ssize_t pos = 0;         // PyDict_Next / _PySet_NextEntry cursor
+        Py_ssize_t index = 0;       // index of the next child pointer
+        uint32_t key_id = 0;
+        bool want_value = false;
+        bool leading = false;       // the current child is `first`
+
+        explicit WalkFrame(std::pmr::memory_resource *arena) : node(arena) {}
+    };
+
+    // `module` and `qualname` of `obj` if importing the one and following the
+    // other gives back `obj`, the way classes and functions are stored by name.
+    static bool global_name(PyObject *obj, std::pmr::string &module, std::pmr::string &qualname) {
+        PyObject *module_obj = PyObject_GetAttrString(obj, "__module__");
+        PyObject *qualname_obj = module_obj ? PyObject_GetAttrString(obj, "__qualname__") : nullptr;
+        bool found = false;
+        if (module_obj && qualname_obj && PyUnicode_Check(module_obj) && PyUnicode_Check(qualname_obj)) {
+            const char *module_str = PyUnicode_AsUTF8(module_obj);
+            const char *qualname_str = PyUnicode_AsUTF8(qualname_obj);
+            PyObject *imported = module_str && qualname_str ? PyImport_Import(module_obj) : nullptr;
+            PyObject *target = imported ? get_dotted(imported, qualname_str) : nullptr;
+            found = target == obj;
+            if (found) {
+                module = module_str;
+                qualname = qualname_str;
+            }
+            Py_XDECREF(target);
+            Py_XDECREF(imported);
+        }
+        Py_XDECREF(module_obj);
+        Py_XDECREF(qualname_obj);
+        PyErr_Clear();
+        return found;
+    }
+
+    // Node for a standard library value or container (see std_types.h). Values
+    // carry their payload in a chunk; one that does not fit its layout is
+    // rejected. Containers set up `frame` for their children.
+    SerializedNode PyObjectSerializer::serialize_std(PyObject *obj, StdKind kind, WalkFrame &frame) {
+        SerializedNode node(arena_);
+        node.type = std_node_type(kind);
+        node.meta.type_name = Py_TYPE(obj)->tp_name;
+        node.meta.refcount = 1;
+        std::vector<uint8_t> payload;
+        if (is_std_value(kind)) {
+            bool native;
+            if (!pack_std_value(kind, obj, payload, native)) return node;
+            if (native) {
+                node.chunks = create_chunks(payload);
+            } else {
+                // The custom-object path cannot rebuild these either.
+                PyErr_Format(PyExc_TypeError, "Cannot serialize '%s' object with a tzinfo other than "
+                             "datetime.timezone in the graph format", Py_TYPE(obj)->tp_name);
+            }
+            return node;
+        }
+        switch (kind) {
+            case StdKind::ENUM: {
+                // Looked up by value on load, as pickle does.
+                PyObject *cls = reinterpret_cast<PyObject *>(Py_TYPE(obj));
+                if (!global_name(cls, node.meta.module_name, node.meta.type_name)) {
+                    PyErr_Format(PyExc_TypeError, "Cannot serialize enum class '%s': it is not importable by name",
+                                 Py_TYPE(obj)->tp_name);
+                    return node;
+                }
+                frame.first = PyObject_GetAttrString(obj, "_value_");
+                break;
+            }
+            case StdKind::DEQUE: {
+                PyObject *maxlen = PyObject_GetAttrString(obj, "maxlen");
+                if (!maxlen) return node;
+                Py_ssize_t bound = maxlen == Py_None ? -1 : PyLong_AsSsize_t(maxlen);
+                Py_DECREF(maxlen);
+                if (bound == -1 && PyErr_Occurred()) return node;
+                append_varint(payload, static_cast<uint64_t>(bound + 1));
+                node.chunks = create_chunks(payload);
+                frame.owned = PySequence_List(obj);
+                break;
+            }
+            case StdKind::ORDERED_DICT:
+                // The items in OrderedDict order, which move_to_end() keeps apart
+                // from the order of the underlying dict.
+                frame.owned = PyObject_CallOneArg(reinterpret_cast<PyObject *>(&PyDict_Type), obj);
+                break;
+            case StdKind::DEFAULT_DICT: {
+                PyObject *factory = PyObject_GetAttrString(obj, "default_factory");
+                if (!factory) return node;
+                // Classes and builtins go by name; Python functions are walked.
+                if (PyFunction_Check(factory)) {
+                    frame.first = factory;
+                    break;
+                }
+                if (factory != Py_None && !global_name(factory, node.meta.module_name, node.meta.type_name)) {
+                    PyErr_Format(PyExc_TypeError, "Cannot serialize defaultdict factory of type '%s'",
+                                 Py_TYPE(factory)->tp_name);
                 }
+                Py_DECREF(factory);
+                break;
             }
-            Py_XDECREF(dict);
+            default:
+                break;
         }
         return node;
     }
 
-    SerializedGraph PyObjectSerializer::serialize(PyObject *obj) {
+    static void add_pointer(SerializedNode &node, SerializedGraph &graph, uint32_t to_node_id,
+                            size_t offset, std::string_view field_name) {
+        PointerInfo ptr(graph.resource());
+        ptr.from_node_id = node.node_id;
+        ptr.from_chunk_id = 0;
+        ptr.offset = offset;
+        ptr.to_node_id = to_node_id;
+        ptr.field_name = field_name;
+        node.pointers.push_back(ptr);
+        graph.all_pointers.push_back(std::move(ptr));
+    }
+
+    bool PyObjectSerializer::next_child(WalkFrame &frame, PyObject *&child) {
+        if (frame.first) {
+            frame.held = frame.first;
+            frame.first = nullptr;
+            frame.leading = true;
+            child = frame.held;
+            return true;
+        }
+        switch (frame.node.type) {
+            case NodeType::LIST:
+            case NodeType::TUPLE: {
+                Py_ssize_t size = PyList_Check(frame.obj) ? PyList_GET_SIZE(frame.obj) : PyTuple_GET_SIZE(frame.obj);
+                if (frame.index >= size) return false;
+                child = PyList_Check(frame.obj)
+                            ? PyList_GET_ITEM(frame.obj, frame.index)
+                            : PyTuple_GET_ITEM(frame.obj, frame.index);
+                return true;
+            }
+            case NodeType::SET:
+            case NodeType::FROZENSET: {
+                // Walk the hash table once. _PySet_NextEntry hands out borrowed
+                // references without allocating; it moved to the internal API in
+                // 3.13, where a single iterator over the set is used instead.
+#if PY_VERSION_HEX < 0x030D0000
+                Py_hash_t hash;
+                return _PySet_NextEntry(frame.obj, &frame.pos, &child, &hash) != 0;
+#else
+                if (!frame.owned) {
+                    frame.owned = PyObject_GetIter(frame.obj);
+                    if (!frame.owned) return false;
+                }
+                frame.held = PyIter_Next(frame.owned);
+                child = frame.held;
+                return child != nullptr;
+#endif
+            }
+            case NodeType::DEQUE:
+                if (!frame.owned || frame.index >= PyList_GET_SIZE(frame.owned)) return false;
+                child = PyList_GET_ITEM(frame.owned, frame.index);
+                return true;
+            case NodeType::DICT:
+            case NodeType::ORDERED_DICT:
+            case NodeType::DEFAULT_DICT:
+            case NodeType::COUNTER: {
+                if (frame.want_value) {
+                    child = frame.value;
+                    return true;
+                }
+                PyObject *dict = frame.node.type == NodeType::ORDERED_DICT ? frame.owned : frame.obj;
+                if (!PyDict_Next(dict, &frame.pos, &frame.key, &frame.value)) return false;
+                child = frame.key;
+                return true;
+            }
+            case NodeType::FUNCTION: {
+                if (!frame.owned) return false;
+                Py_ssize_t n_cells = PyTuple_GET_SIZE(frame.owned);
+                while (frame.index < n_cells) {
+                    // Empty cells have no contents to serialize; skip them.
+                    frame.held = PyCell_Get(PyTuple_GET_ITEM(frame.owned, frame.index));
+                    if (frame.held) {
+                        child = frame.held;
+                        return true;
+                    }
+                    frame.index++;
+                }
+                return false;
+            }
+            case NodeType::CUSTOM:
+                if (!frame.owned) return false;
+                while (PyDict_Next(frame.owned, &frame.pos, &frame.key, &frame.value)) {
+                    if (!PyUnicode_Check(frame.key)) continue;
+                    child = frame.value;
+                    return true;
+                }
+                return false;
+            default:
+                return false;
+        }
+    }
+
+    void PyObjectSerializer::attach_child(WalkFrame &frame, uint32_t child_id, SerializedGraph &graph) {
+        SerializedNode &node = frame.node;
+        if (frame.leading) {
+            // Bound when the object is created rather than by resolve_pointers().
+            frame.leading = false;
+            add_pointer(node, graph, child_id, 0, node.type == NodeType::ENUM ? "init:value" : "init:default_factory");
+            Py_CLEAR(frame.held);
+            return;
+        }
+        switch (node.type) {
+            case NodeType::DICT:
+            case NodeType::ORDERED_DICT:
+            case NodeType::DEFAULT_DICT:
+            case NodeType::COUNTER: {
+                if (!frame.want_value) {
+                    frame.key_id = child_id;
+                    frame.want_value = true;
+                    return;
+                }
+                frame.want_value = false;
+                PyObject *key_str = PyObject_Str(frame.key);
+                const char *key_cstr = key_str ? PyUnicode_AsUTF8(key_str) : nullptr;
+                std::pmr::string key_name(key_cstr ? key_cstr : "", graph.resource());
+                Py_XDECREF(key_str);
+                node.meta.attr_names.push_back(key_name);
+                node.meta.attr_node_ids[key_name] = child_id;
+                std::pmr::string field("key:", graph.resource());
+                field += key_name;
+                add_pointer(node, graph, frame.key_id, 0, field);
+                field.replace(0, 3, "val");
+                add_pointer(node, graph, child_id, 0, field);
+                break;
+            }
+            case NodeType::FUNCTION:
+                add_pointer(node, graph, child_id, 0, "closure:" + std::to_string(frame.index));
+                frame.index++;
+                break;
+            case NodeType::CUSTOM: {
+                std::pmr::string attr_name(PyUnicode_AsUTF8(frame.key), graph.resource());
+                node.meta.attr_names.push_back(attr_name);
+                node.meta.attr_node_ids[attr_name] = child_id;
+                add_pointer(node, graph, child_id, 0, attr_name);
+                break;
+            }
+            default:
+                add_pointer(node, graph, child_id, frame.index * sizeof(void *), std::to_string(frame.index));
+                frame.index++;
+                break;
+        }
+        Py_CLEAR(frame.held);
+    }
+
+    void PyObjectSerializer::release_frame(WalkFrame &frame) {
+        Py_CLEAR(frame.held);
+        Py_CLEAR(frame.owned);
+        Py_CLEAR(frame.first);
+    }
+
+    SerializedGraph PyObjectSerializer::serialize(PyObject *obj, PyObject *buffer_callback) {
+        buffer_callback_.reset(buffer_callback);
+        // Ids restart with every graph, so a reused serializer writes the
+        // same bytes as a new one.
+        next_node_id_ = 0;
+        next_chunk_id_ = 0;
         SerializedGraph graph;
-        std::unordered_map<PyObject *, uint32_t> visited;
-        graph.root_id = serialize_recursive(obj, graph, visited, 0);
-        if (graph.root_id == UINT32_MAX) {
+        arena_ = graph.resource();
+        IdentityTable visited(IdentityTable::estimate_size(obj));
+        codes_.clear();
+        plans_.drop_stale();
+        std::vector<WalkFrame> stack;
+        bool failed = false;
+        graph.root_id = visit(obj, graph, visited, stack, 0);
+        failed = graph.root_id == UINT32_MAX;
+        while (!failed && !stack.empty()) {
+            PyObject *child = nullptr;
+            if (!next_child(stack.back(), child)) {
+                if (PyErr_Occurred()) {
+                    failed = true;
+                    break;
+                }
+                // All children are done: emit the container and hand its id to
+                // the parent frame.
+                WalkFrame &done = stack.back();
+                uint32_t done_id = done.node.node_id;
+                release_frame(done);
+                graph.nodes.push_back(std::move(done.node));
+                stack.pop_back();
+                if (!stack.empty()) {
+                    attach_child(stack.back(), done_id, graph);
+                }
+                continue;
+            }
+            size_t parent = stack.size() - 1;
+            uint32_t child_id = visit(child, graph, visited, stack, stack[parent].depth + 1);
+            if (child_id == UINT32_MAX) {
+                failed = true;
+                break;
+            }
+            // A container child pushed its own frame and is attached when it
+            // completes; leaves and references are attached right away.
+            if (stack.size() == parent + 1) {
+                attach_child(stack[parent], child_id, graph);
+            }
+        }
+        if (failed) {
+            for (auto &frame: stack) {
+                release_frame(frame);
+            }
+            codes_.clear();
             throw std::runtime_error("Serialization failed");
         }
+        graph.code_blobs.reserve(codes_.size());
+        for (uint32_t i = 0; i < codes_.size(); i++) {
+            graph.code_blobs.emplace_back(codes_.blob(i));
+        }
+        codes_.clear();
+        encode_chunks(graph);
         return graph;
     }
 
-    uint32_t PyObjectSerializer::serialize_recursive(
+    uint32_t PyObjectSerializer::visit(
         PyObject *obj,
         SerializedGraph &graph,
-        std::unordered_map<PyObject *, uint32_t> &visited,
-        int depth
+        IdentityTable &visited,
+        std::vector<WalkFrame> &stack,
+        size_t depth
     ) {
-        if (depth > MAX_DEPTH) {
+        if (max_depth_ != 0 && depth > max_depth_) {
             PyErr_SetString(PyExc_ValueError, "Object nesting too deep");
             return UINT32_MAX;
         }
-        auto it = visited.find(obj);
-        if (it != visited.end()) {
-            SerializedNode ref_node;
-            ref_node.node_id = next_node_id_++;
-            ref_node.type = NodeType::REFERENCE;
-            ref_node.meta.refcount = 0;
-            uint32_t ref_target = it->second;
-            std::vector<uint8_t> ref_data(sizeof(uint32_t));
-            std::memcpy(ref_data.data(), &ref_target, sizeof(uint32_t));
-            ref_node.chunks = create_chunks(ref_data);
-            graph.nodes.push_back(ref_node);
-            return ref_node.node_id;
+        // Atoms (None, bools, ints, floats) are re-emitted instead of tracked;
+        // everything else goes through one probe of the identity table.
+        if (IdentityTable::needs_identity(obj)) {
+            auto [known_id, inserted] = visited.try_emplace(obj, next_node_id_);
+            if (!inserted) {
+                SerializedNode ref_node(arena_);
+                ref_node.node_id = next_node_id_++;
+                ref_node.type = NodeType::REFERENCE;
+                ref_node.meta.refcount = 0;
+                uint32_t ref_target = known_id;
+                std::vector<uint8_t> ref_data(sizeof(uint32_t));
+                std::memcpy(ref_data.data(), &ref_target, sizeof(uint32_t));
+                ref_node.chunks = create_chunks(ref_data);
+                uint32_t ref_id = ref_node.node_id;
+                graph.nodes.push_back(std::move(ref_node));
+                return ref_id;
+            }
         }
         uint32_t current_id = next_node_id_++;
-        visited[obj] = current_id;
-        SerializedNode node;
-        // Assign the canonical node id immediately so any pointers created by
-        // per-type serializers use the correct from_node_id.
-        node.node_id = current_id;
-        if (obj == Py_None) {
-            node.type = NodeType::NONE;
-            node.meta.refcount = 1;
-        } else if (PyBool_Check(obj)) {
-            node.type = NodeType::BOOL;
-            node.meta.refcount = 1;
-            uint8_t val = (obj == Py_True) ? 1 : 0;
-            node.chunks = create_chunks({val});
-        } else if (PyLong_Check(obj)) {
-            node = serialize_int(obj);
-            node.node_id = current_id;
-        } else if (PyFloat_Check(obj)) {
-            node = serialize_float(obj);
-            node.node_id = current_id;
-        } else if (PyUnicode_Check(obj)) {
-            node = serialize_string(obj);
-            node.node_id = current_id;
-        } else if (PyBytes_Check(obj)) {
-            node = serialize_bytes(obj);
-            node.node_id = current_id;
-        } else if (PyByteArray_Check(obj) || PyMemoryView_Check(obj) || PyObject_CheckBuffer(obj)) {
-            // Handle other bytes-like objects (bytearray, memoryview, and buffer-supporting objects)
-            node = serialize_bytes(obj);
-            node.node_id = current_id;
-        } else if (PyList_Check(obj)) {
-            node = serialize_container(obj, NodeType::LIST, graph, visited, depth, current_id);
-            node.node_id = current_id;
-        } else if (PyTuple_Check(obj)) {
-            node = serialize_container(obj, NodeType::TUPLE, graph, visited, depth, current_id);
-            node.node_id = current_id;
-        } else if (PyDict_Check(obj)) {
-            node = serialize_dict(obj, graph, visited, depth, current_id);
-            node.node_id = current_id;
-        } else if (PySet_Check(obj)) {
-            node = serialize_container(obj, NodeType::SET, graph, visited, depth, current_id);
-            node.node_id = current_id;
-        } else if (PyFunction_Check(obj)) {
-            node = serialize_function(obj, graph, visited, depth, current_id);
-            node.node_id = current_id;
-        } else if (PyModule_Check(obj)) {
-            node = serialize_module(obj);
-            node.node_id = current_id;
-        } else if (PyObject_HasAttrString(obj, "fileno")) {
-            PyErr_SetString(PyExc_TypeError,
-                            "Cannot serialize file objects. Extract file descriptor manually.");
+        SerializedNode node(arena_);
+        WalkFrame frame(arena_);
+        bool is_container = true;
+        TypeDispatch dispatch = type_dispatch(obj);
+        switch (dispatch.kind) {
+            case TypeKind::NONE:
+                node.type = NodeType::NONE;
+                node.meta.refcount = 1;
+                is_container = false;
+                break;
+            case TypeKind::BOOL: {
+                node.type = NodeType::BOOL;
+                node.meta.refcount = 1;
+                uint8_t val = (obj == Py_True) ? 1 : 0;
+                node.chunks = create_chunks({val});
+                is_container = false;
+                break;
+            }
+            case TypeKind::INT:
+                node = serialize_int(obj);
+                is_container = false;
+                break;
+            case TypeKind::FLOAT:
+                node = serialize_float(obj);
+                is_container = false;
+                break;
+            case TypeKind::STR:
+                node = serialize_string(obj);
+                is_container = false;
+                break;
+            case TypeKind::BYTES:
+            case TypeKind::BYTEARRAY:
+            case TypeKind::BUFFER:
+                // bytearray, memoryview and other buffer exporters come back as bytes
+                node = serialize_bytes(obj, graph);
+                is_container = false;
+                break;
+            case TypeKind::LIST:
+            case TypeKind::TUPLE:
+                if (serialize_packed(obj, node)) {
+                    is_container = false;
+                } else {
+                    node = serialize_container(obj, dispatch.kind == TypeKind::LIST ? NodeType::LIST : NodeType::TUPLE);
+                }
+                break;
+            case TypeKind::DICT:
+                node = dispatch.std != StdKind::NONE ? serialize_std(obj, dispatch.std, frame) : serialize_dict(obj);
+                break;
+            case TypeKind::SET:
+                node = serialize_container(obj, NodeType::SET);
+                break;
+            case TypeKind::FROZENSET:
+                node = serialize_container(obj, NodeType::FROZENSET);
+                break;
+            case TypeKind::FUNCTION: {
+                node = serialize_function(obj);
+                PyObject *closure = PyFunction_GetClosure(obj);
+                if (closure && PyTuple_Check(closure)) {
+                    Py_INCREF(closure);
+                    frame.owned = closure;
+                }
+                break;
+            }
+            case TypeKind::MODULE:
+                node = serialize_module(obj);
+                is_container = false;
+                break;
+            case TypeKind::STD:
+                node = serialize_std(obj, dispatch.std, frame);
+                is_container = !is_std_value(dispatch.std);
+                break;
+            case TypeKind::FILE:
+                PyErr_SetString(PyExc_TypeError,
+                                "Cannot serialize file objects. Extract file descriptor manually.");
+                return UINT32_MAX;
+            case TypeKind::NDARRAY:
+                node = serialize_ndarray(obj, graph);
+                is_container = false;
+                break;
+            case TypeKind::GLOBAL:
+            case TypeKind::CUSTOM:
+                node = serialize_custom(obj, &frame.owned);
+                break;
+        }
+        if (PyErr_Occurred()) {
+            release_frame(frame);
             return UINT32_MAX;
-        } else {
-            node = serialize_custom(obj, graph, visited, depth, current_id);
-            node.node_id = current_id;
         }
-        // node.node_id was set earlier to current_id; push the finalized node.
-        graph.nodes.push_back(node);
+        node.node_id = current_id;
+        if (!is_container) {
+            graph.nodes.push_back(std::move(node));
+            return current_id;
+        }
+        frame.obj = obj;
+        frame.node = std::move(node);
+        frame.depth = depth;
+        stack.push_back(std::move(frame));
         return current_id;
     }
 
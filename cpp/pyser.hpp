@@ -5,7 +5,10 @@
 // - The serializer walks Python object graphs and produces a SerializedGraph
 //   which can be converted to compressed bytes (JSON + Zstd + base64 chunks).
 // - Each DataChunk contains raw bytes, a base64 representation, and a SHA256 hash
-//   which is validated during deserialization to detect corruption.
+//   which is validated during deserialization to detect corruption. The last
+//   two are computed after the walk, in parallel (chunk_encoder.h).
+// - Chunks of bytes-like objects are views into the object's buffer, which the
+//   graph holds until it is destroyed, instead of copies of it.
 // - This header exposes structures used by both the C++ implementation and the
 //   Python binding (python_binding.cpp).
 
@@ -16,10 +19,28 @@
 #include <unordered_map>
 #include <string>
 #include <memory>
+#include <memory_resource>
+#include <span>
 #include <nlohmann/json.hpp>
+#include "class_cache.h"
+#include "type_plan.h"
+#include "code_codec.h"
+#include "std_types.h"
+#include "str_units.h"
+#include "type_dispatch.h"
+#include "out_of_band.h"
+
+typedef struct ZSTD_CCtx_s ZSTD_CCtx;
+typedef struct ZSTD_DCtx_s ZSTD_DCtx;
+typedef struct ZSTD_CDict_s ZSTD_CDict;
+typedef struct ZSTD_DDict_s ZSTD_DDict;
+#include "ndarray.h"
 namespace pyser {
+    class IdentityTable;
     constexpr size_t CHUNK_SIZE = 65536; // 64KB per chunk
-    constexpr size_t MAX_DEPTH = 100;
+    // Default nesting limit for serialization; 0 disables the limit. The walker
+    // keeps its own stack, so deep data never grows the C stack.
+    constexpr size_t DEFAULT_MAX_DEPTH = 0;
 
     enum class NodeType : uint8_t {
         NONE = 0,
@@ -36,91 +57,291 @@ namespace pyser {
         FUNCTION = 11,
         METHOD = 12,
         MODULE = 13,
+        INT_ARRAY = 14,     // list/tuple of ints in frame-of-reference blocks (packed_array.h)
+        FLOAT_ARRAY = 15,   // list/tuple of floats in XOR-delta or byte-plane blocks
+        STR_ARRAY = 16,     // list/tuple of strs packed as entry table + code units
+        // Standard library types (std_types.h), in StdKind order.
+        DATETIME = 17,      // value payload in the chunk; likewise DATE to UUID
+        DATE = 18,
+        TIME = 19,
+        TIMEDELTA = 20,
+        DECIMAL = 21,
+        COMPLEX = 22,
+        RANGE = 23,
+        UUID = 24,
+        ENUM = 25,          // class in module_name/type_name, value through "init:value"
+        DEQUE = 26,         // items as LIST; the chunk holds varint maxlen + 1 (0: unbounded)
+        ORDERED_DICT = 27,  // items as DICT
+        DEFAULT_DICT = 28,  // items as DICT; factory in module_name/type_name or "init:default_factory"
+        COUNTER = 29,       // items as DICT
+        STR_UNITS = 30,     // non-ASCII str: varint header + code units (str_units.h)
+        OUT_OF_BAND = 31,   // placeholder: u8 BufferKind, varint buffer index, varint size (out_of_band.h)
+        NDARRAY = 32,       // numpy array: first chunk holds the header (ndarray.h), then u8 0 with
+                            // the data in the other chunks, or u8 1 and the varint index of an
+                            // out-of-band buffer
         CUSTOM = 99,
         REFERENCE = 100
     };
 
+    inline NodeType std_node_type(StdKind kind) {
+        return static_cast<NodeType>(static_cast<uint8_t>(NodeType::DATETIME) + static_cast<uint8_t>(kind) -
+                                     static_cast<uint8_t>(StdKind::DATETIME));
+    }
+
+    inline StdKind node_std_kind(NodeType type) {
+        if (type < NodeType::DATETIME || type > NodeType::COUNTER) return StdKind::NONE;
+        return static_cast<StdKind>(static_cast<uint8_t>(type) - static_cast<uint8_t>(NodeType::DATETIME) +
+                                    static_cast<uint8_t>(StdKind::DATETIME));
+    }
+
+    // Graph storage is allocator-aware: every vector and string below is drawn
+    // from the arena owned by the SerializedGraph it belongs to, so building a
+    // graph does not hit malloc per node and tearing it down is a single release.
+    using GraphAllocator = std::pmr::polymorphic_allocator<std::byte>;
+    constexpr size_t GRAPH_ARENA_INITIAL_SIZE = 64 * 1024;
+
     struct PointerInfo {
+        using allocator_type = GraphAllocator;
+
         uint32_t from_node_id;
         uint32_t from_chunk_id;
         size_t offset;
         uint32_t to_node_id;
-        std::string field_name;
+        std::pmr::string field_name;
+
+        explicit PointerInfo(const allocator_type &alloc = {})
+            : from_node_id(0), from_chunk_id(0), offset(0), to_node_id(0), field_name(alloc) {}
 
-        PointerInfo()
-            : from_node_id(0), from_chunk_id(0), offset(0), to_node_id(0), field_name() {}
+        PointerInfo(const PointerInfo &other, const allocator_type &alloc = {})
+            : from_node_id(other.from_node_id), from_chunk_id(other.from_chunk_id), offset(other.offset),
+              to_node_id(other.to_node_id), field_name(other.field_name, alloc) {}
+
+        PointerInfo(PointerInfo &&other, const allocator_type &alloc)
+            : from_node_id(other.from_node_id), from_chunk_id(other.from_chunk_id), offset(other.offset),
+              to_node_id(other.to_node_id), field_name(std::move(other.field_name), alloc) {}
+
+        PointerInfo(PointerInfo &&) noexcept = default;
+        PointerInfo &operator=(const PointerInfo &) = default;
+        PointerInfo &operator=(PointerInfo &&) = default;
     };
 
     struct DataChunk {
+        using allocator_type = GraphAllocator;
+
         uint32_t chunk_id;
-        std::vector<uint8_t> raw_data;
-        std::string base64_data;
-        std::string sha256_hash;
+        std::pmr::vector<uint8_t> raw_data;
+        // Set instead of raw_data when the chunk is a slice of a buffer held
+        // by the graph (SerializedGraph::buffers).
+        std::span<const uint8_t> view;
+        std::pmr::string base64_data;
+        std::pmr::string sha256_hash;
         size_t original_size;
+        // `view` is a buffer other Python threads may write to (a bytearray,
+        // a writable memoryview or array); it is only read with the GIL held.
+        bool writable = false;
+
+        explicit DataChunk(const allocator_type &alloc = {})
+            : chunk_id(0), raw_data(alloc), base64_data(alloc), sha256_hash(alloc), original_size(0) {}
+
+        DataChunk(const DataChunk &other, const allocator_type &alloc = {})
+            : chunk_id(other.chunk_id), raw_data(other.raw_data, alloc), view(other.view),
+              base64_data(other.base64_data, alloc), sha256_hash(other.sha256_hash, alloc),
+              original_size(other.original_size), writable(other.writable) {}
+
+        DataChunk(DataChunk &&other, const allocator_type &alloc)
+            : chunk_id(other.chunk_id), raw_data(std::move(other.raw_data), alloc), view(other.view),
+              base64_data(std::move(other.base64_data), alloc), sha256_hash(std::move(other.sha256_hash), alloc),
+              original_size(other.original_size), writable(other.writable) {}
+
+        DataChunk(DataChunk &&) noexcept = default;
+        DataChunk &operator=(const DataChunk &) = default;
+        DataChunk &operator=(DataChunk &&) = default;
+
+        // The chunk's bytes, wherever they live.
+        [[nodiscard]] std::span<const uint8_t> bytes() const {
+            return view.data() ? view : std::span<const uint8_t>(raw_data.data(), raw_data.size());
+        }
+    };
+
+    // Data owned by a Python object: a Py_buffer export, or memory the object
+    // owns (numpy arrays). Released (with the GIL held) when destroyed.
+    class HeldBuffer {
+    public:
+        HeldBuffer() = default;
+
+        // Takes over a buffer filled by PyObject_GetBuffer().
+        explicit HeldBuffer(const Py_buffer &view)
+            : view_(view), bytes_(static_cast<const uint8_t *>(view.buf), static_cast<size_t>(view.len)),
+              held_(true) {}
+
+        // Takes over a reference to `owner`, which keeps `bytes` alive.
+        HeldBuffer(PyObject *owner, std::span<const uint8_t> bytes) : owner_(owner), bytes_(bytes) {}
+
+        HeldBuffer(HeldBuffer &&other) noexcept
+            : view_(other.view_), owner_(other.owner_), bytes_(other.bytes_), held_(other.held_) {
+            other.owner_ = nullptr;
+            other.held_ = false;
+        }
+
+        HeldBuffer &operator=(HeldBuffer &&) = delete;
+
+        ~HeldBuffer() {
+            if (held_) PyBuffer_Release(&view_);
+            Py_XDECREF(owner_);
+        }
+
+        [[nodiscard]] std::span<const uint8_t> bytes() const { return bytes_; }
 
-        DataChunk() : chunk_id(0), raw_data(), base64_data(), sha256_hash(), original_size(0) {}
+    private:
+        Py_buffer view_{};
+        PyObject *owner_ = nullptr;
+        std::span<const uint8_t> bytes_;
+        bool held_ = false;
     };
 
     struct SerializedNode {
+        using allocator_type = GraphAllocator;
+
         uint32_t node_id;
         NodeType type;
-        std::vector<DataChunk> chunks;
-        std::vector<PointerInfo> pointers;
+        std::pmr::vector<DataChunk> chunks;
+        std::pmr::vector<PointerInfo> pointers;
 
         struct Metadata {
-            std::string type_name;
-            std::string module_name;
+            std::pmr::string type_name;
+            std::pmr::string module_name;
             size_t total_size;
             uint32_t refcount;
             bool has_dict;
-            std::vector<std::string> attr_names;
-            std::unordered_map<std::string, uint32_t> attr_node_ids;
+            std::pmr::vector<std::pmr::string> attr_names;
+            std::pmr::unordered_map<std::pmr::string, uint32_t> attr_node_ids;
             bool is_bigint;
             size_t bigint_num_digits;
-            std::string func_code;
-            std::vector<std::string> func_closure_vars;
-            std::string func_defaults;     // JSON-serialized __defaults__ tuple
-            std::string func_kwdefaults;   // JSON-serialized __kwdefaults__ dict
-
-            Metadata()
-                : type_name(), module_name(), total_size(0), refcount(0), has_dict(false),
-                  attr_names(), attr_node_ids(), is_bigint(false), bigint_num_digits(0),
-                  func_code(), func_closure_vars(), func_defaults(), func_kwdefaults() {}
+            std::pmr::string func_code;
+            std::pmr::vector<std::pmr::string> func_closure_vars;
+            std::pmr::string func_defaults;     // JSON-serialized __defaults__ tuple
+            std::pmr::string func_kwdefaults;   // JSON-serialized __kwdefaults__ dict
+
+            explicit Metadata(const allocator_type &alloc = {})
+                : type_name(alloc), module_name(alloc), total_size(0), refcount(0), has_dict(false),
+                  attr_names(alloc), attr_node_ids(alloc), is_bigint(false), bigint_num_digits(0),
+                  func_code(alloc), func_closure_vars(alloc), func_defaults(alloc), func_kwdefaults(alloc) {}
+
+            Metadata(const Metadata &other, const allocator_type &alloc = {})
+                : type_name(other.type_name, alloc), module_name(other.module_name, alloc),
+                  total_size(other.total_size), refcount(other.refcount), has_dict(other.has_dict),
+                  attr_names(other.attr_names, alloc), attr_node_ids(other.attr_node_ids, alloc),
+                  is_bigint(other.is_bigint), bigint_num_digits(other.bigint_num_digits),
+                  func_code(other.func_code, alloc), func_closure_vars(other.func_closure_vars, alloc),
+                  func_defaults(other.func_defaults, alloc), func_kwdefaults(other.func_kwdefaults, alloc) {}
+
+            Metadata(Metadata &&other, const allocator_type &alloc)
+                : type_name(std::move(other.type_name), alloc), module_name(std::move(other.module_name), alloc),
+                  total_size(other.total_size), refcount(other.refcount), has_dict(other.has_dict),
+                  attr_names(std::move(other.attr_names), alloc), attr_node_ids(std::move(other.attr_node_ids), alloc),
+                  is_bigint(other.is_bigint), bigint_num_digits(other.bigint_num_digits),
+                  func_code(std::move(other.func_code), alloc),
+                  func_closure_vars(std::move(other.func_closure_vars), alloc),
+                  func_defaults(std::move(other.func_defaults), alloc),
+                  func_kwdefaults(std::move(other.func_kwdefaults), alloc) {}
+
+            Metadata(Metadata &&) noexcept = default;
+            Metadata &operator=(const Metadata &) = default;
+            Metadata &operator=(Metadata &&) = default;
         } meta;
 
+        explicit SerializedNode(const allocator_type &alloc = {})
+            : node_id(0), type(NodeType::NONE), chunks(alloc), pointers(alloc), meta(alloc) {}
+
+        SerializedNode(const SerializedNode &other, const allocator_type &alloc = {})
+            : node_id(other.node_id), type(other.type), chunks(other.chunks, alloc),
+              pointers(other.pointers, alloc), meta(other.meta, alloc) {}
 
-        SerializedNode() : node_id(0), type(NodeType::NONE), chunks(), pointers(), meta() {}
+        SerializedNode(SerializedNode &&other, const allocator_type &alloc)
+            : node_id(other.node_id), type(other.type), chunks(std::move(other.chunks), alloc),
+              pointers(std::move(other.pointers), alloc), meta(std::move(other.meta), alloc) {}
+
+        SerializedNode(SerializedNode &&) noexcept = default;
+        SerializedNode &operator=(const SerializedNode &) = default;
+        SerializedNode &operator=(SerializedNode &&) = default;
     };
 
     struct SerializedGraph {
+        // Monotonic arena owning all node, chunk, pointer and string storage of
+        // this graph. Declared first so it outlives the containers using it.
+        std::unique_ptr<std::pmr::monotonic_buffer_resource> arena;
         uint32_t root_id;
-        std::vector<SerializedNode> nodes;
-        std::vector<PointerInfo> all_pointers;
-
-        [[nodiscard]] std::vector<uint8_t> to_bytes() const;
+        std::pmr::vector<SerializedNode> nodes;
+        std::pmr::vector<PointerInfo> all_pointers;
+        // Encoded code objects (code_codec.h) referenced by FUNCTION nodes as
+        // func_code "#<index>".
+        std::pmr::vector<std::pmr::string> code_blobs;
+        // Buffers of the bytes-like objects whose chunks are views. Never
+        // filled by from_bytes(); a graph holding any must be destroyed with
+        // the GIL held.
+        std::vector<HeldBuffer> buffers;
+
+        SerializedGraph()
+            : arena(std::make_unique<std::pmr::monotonic_buffer_resource>(GRAPH_ARENA_INITIAL_SIZE)),
+              root_id(0), nodes(arena.get()), all_pointers(arena.get()), code_blobs(arena.get()) {}
+
+        // Moving keeps the arena (and thus every allocation) alive. Assignment
+        // would have to re-home the contents into another arena, so it is not
+        // offered.
+        SerializedGraph(SerializedGraph &&) noexcept = default;
+        SerializedGraph &operator=(SerializedGraph &&) = delete;
+
+        [[nodiscard]] std::pmr::memory_resource *resource() const { return arena.get(); }
+
+        // Touches no Python objects; may run without the GIL. `cctx` and
+        // `dictionary` (both optional) are reused by callers that encode many
+        // graphs.
+        [[nodiscard]] std::vector<uint8_t> to_bytes(ZSTD_CCtx *cctx = nullptr,
+                                                    const ZSTD_CDict *dictionary = nullptr) const;
 
         static SerializedGraph from_bytes(const std::vector<uint8_t> &data);
+
+        // Touches no Python objects; may run without the GIL.
+        static SerializedGraph from_bytes(const uint8_t *data, size_t size, ZSTD_DCtx *dctx = nullptr,
+                                          const ZSTD_DDict *dictionary = nullptr);
     };
 
+    // Nodes of a graph by node id, built once per deserialize().
+    using NodeIndex = std::unordered_map<uint32_t, const SerializedNode *>;
+
     class PyObjectSerializer {
     public:
-        PyObjectSerializer() : next_node_id_(0), next_chunk_id_(0) {
+        explicit PyObjectSerializer(size_t max_depth = DEFAULT_MAX_DEPTH)
+            : next_node_id_(0), next_chunk_id_(0), max_depth_(max_depth) {
         }
 
-        SerializedGraph serialize(PyObject *obj);
+        // `buffer_callback` (borrowed, may be nullptr) receives the buffers
+        // that may go out of band (out_of_band.h).
+        SerializedGraph serialize(PyObject *obj, PyObject *buffer_callback = nullptr);
 
-        PyObject *deserialize(const SerializedGraph &graph);
+        // `buffers` (borrowed, may be nullptr) are the out-of-band buffers the
+        // graph refers to.
+        PyObject *deserialize(const SerializedGraph &graph, PyObject *buffers = nullptr);
 
-        static std::string compute_sha256(const std::vector<uint8_t> &data);
+        static std::string compute_sha256(const uint8_t *data, size_t size);
 
     private:
-        uint32_t serialize_recursive(
+        struct WalkFrame;
+
+        uint32_t visit(
             PyObject *obj,
             SerializedGraph &graph,
-            std::unordered_map<PyObject *, uint32_t> &visited,
-            int depth
+            IdentityTable &visited,
+            std::vector<WalkFrame> &stack,
+            size_t depth
         );
 
+        bool next_child(WalkFrame &frame, PyObject *&child);
+
+        void attach_child(WalkFrame &frame, uint32_t child_id, SerializedGraph &graph);
+
+        static void release_frame(WalkFrame &frame);
+
         SerializedNode serialize_int(PyObject *obj);
 
         SerializedNode serialize_bigint(PyObject *obj);
@@ -129,41 +350,48 @@ namespace pyser {
 
         SerializedNode serialize_string(PyObject *obj);
 
-        SerializedNode serialize_bytes(PyObject *obj);
+        SerializedNode serialize_bytes(PyObject *obj, SerializedGraph &graph);
 
-        SerializedNode serialize_container(PyObject *obj, NodeType type,
-            SerializedGraph &graph,
-            std::unordered_map<PyObject *, uint32_t> &visited,
-            int depth,
-            uint32_t owner_node_id);
+        SerializedNode serialize_ndarray(PyObject *obj, SerializedGraph &graph);
 
-        SerializedNode serialize_dict(PyObject *obj, SerializedGraph &graph,
-                                      std::unordered_map<PyObject *, uint32_t> &visited,
-                                      int depth,
-                                      uint32_t owner_node_id);
+        SerializedNode serialize_container(PyObject *obj, NodeType type);
 
-        SerializedNode serialize_function(PyObject *obj, SerializedGraph &graph,
-                                          std::unordered_map<PyObject *, uint32_t> &visited,
-                                          int depth,
-                                          uint32_t owner_node_id);
+        bool serialize_packed(PyObject *obj, SerializedNode &node);
+
+        SerializedNode serialize_dict(PyObject *obj);
+
+        SerializedNode serialize_function(PyObject *obj);
 
         SerializedNode serialize_module(PyObject *obj);
 
-        SerializedNode serialize_custom(PyObject *obj, SerializedGraph &graph,
-                                        std::unordered_map<PyObject *, uint32_t> &visited,
-                                        int depth,
-                                        uint32_t owner_node_id);
+        SerializedNode serialize_custom(PyObject *obj, PyObject **attrs);
+
+        SerializedNode serialize_std(PyObject *obj, StdKind kind, WalkFrame &frame);
+
+        std::pmr::vector<DataChunk> create_chunks(const std::vector<uint8_t> &data);
 
-        std::vector<DataChunk> create_chunks(const std::vector<uint8_t> &data);
+        std::pmr::vector<DataChunk> create_chunks(std::span<const uint8_t> data, bool view, bool writable = false);
 
-        PyObject *deserialize_node(uint32_t node_id, const SerializedGraph &graph,
+        PyObject *deserialize_node(uint32_t node_id, const SerializedGraph &graph, const NodeIndex &nodes,
                                    std::unordered_map<uint32_t, PyObject *> &cache);
 
-        void resolve_pointers(const SerializedGraph &graph,
+        // False with the error set if a frozenset cannot be built.
+        bool resolve_pointers(const SerializedGraph &graph, const NodeIndex &nodes,
                               std::unordered_map<uint32_t, PyObject *> &cache);
 
         uint32_t next_node_id_;
         uint32_t next_chunk_id_;
+        size_t max_depth_;
+        // Arena of the graph currently being built by serialize().
+        std::pmr::memory_resource *arena_ = std::pmr::get_default_resource();
+        // Per-class slot layout used by serialize_custom().
+        TypePlanCache plans_;
+        // Code objects of the graph being built, moved to code_blobs at the end.
+        CodeTable codes_;
+        BufferCallback buffer_callback_;
+        OutOfBandBuffers buffers_;
+        // Classes and modules resolved by deserialize().
+        ClassCache classes_;
     };
 
     // JSON conversion helpers for code object serialization
@@ -2,7 +2,8 @@
 #include <iostream>
 
 #include "pyser.hpp"
-#include <cppcodec/base64_rfc4648.hpp>
+#include "packed_array.h"
+#include "base64.h"
 #include <nlohmann/json.hpp>
 // Note: We use public C-API (PyFunction_GetClosure / PyFunction_SetClosure)
 // for closure handling to remain compatible across Python builds (3.11+).
@@ -13,8 +14,6 @@
 using json = nlohmann::json;
 
 namespace pyser {
-    using base64 = cppcodec::base64_rfc4648;
-
     PyObject *deserialize_bool(const SerializedNode &node) {
         if (node.chunks.empty() || node.chunks[0].raw_data.empty()) {
             PyErr_SetString(PyExc_ValueError, "Invalid bool data");
@@ -47,13 +46,20 @@ namespace pyser {
             );
             return result;
         }
-        if (full_data.size() != sizeof(long long)) {
+        if (full_data.size() == sizeof(long long)) {
+            // Written by older versions as 8 raw bytes.
+            long long value;
+            std::memcpy(&value, full_data.data(), sizeof(long long));
+            return PyLong_FromLongLong(value);
+        }
+        const uint8_t *pos = full_data.data();
+        const uint8_t *end = pos + full_data.size();
+        uint64_t raw;
+        if (!parse_varint(pos, end, raw) || pos != end) {
             PyErr_SetString(PyExc_ValueError, "Invalid int size");
             return nullptr;
         }
-        long long value;
-        std::memcpy(&value, full_data.data(), sizeof(long long));
-        return PyLong_FromLongLong(value);
+        return PyLong_FromLongLong(unzigzag(raw));
     }
 
     PyObject *deserialize_float(const SerializedNode &node) {
@@ -82,46 +88,114 @@ namespace pyser {
         );
     }
 
+    PyObject *deserialize_str_units(const SerializedNode &node) {
+        std::vector<uint8_t> full_data;
+        for (const auto &chunk: node.chunks) {
+            full_data.insert(full_data.end(), chunk.raw_data.begin(), chunk.raw_data.end());
+        }
+        const uint8_t *pos = full_data.data();
+        const uint8_t *end = pos + full_data.size();
+        uint64_t header;
+        if (!parse_varint(pos, end, header)) {
+            PyErr_SetString(PyExc_ValueError, "Invalid string data");
+            return nullptr;
+        }
+        auto width = static_cast<StrWidth>(header & 3);
+        uint64_t length = header >> 2;
+        if (length > static_cast<uint64_t>(end - pos) / unit_size(width) ||
+            length * unit_size(width) != static_cast<uint64_t>(end - pos)) {
+            PyErr_SetString(PyExc_ValueError, "Invalid string data");
+            return nullptr;
+        }
+        return make_str_units(width, pos, length);
+    }
+
     PyObject *deserialize_bytes(const SerializedNode &node) {
 #ifdef PYSER_ENABLE_DEBUG_PRINTS
         fprintf(stderr, "pyser: deserialize_bytes called for type='%s' chunks=%zu\n", node.meta.type_name.c_str(), node.chunks.size());
 #endif
-        if (node.chunks.empty()) {
-            return PyBytes_FromString("");
-        }
-        std::vector<uint8_t> full_data;
+        size_t total = 0;
         for (const auto &chunk: node.chunks) {
-            full_data.insert(full_data.end(),
-                             chunk.raw_data.begin(),
-                             chunk.raw_data.end());
+            total += chunk.bytes().size();
         }
 
-        // If the original type was recorded as bytearray or memoryview, reconstruct
-        // an appropriate Python object. Default to bytes for backward compatibility.
+        // The chunks are copied straight into the new object. memoryview and
+        // other buffer exporters come back as bytes.
+        PyObject *result;
+        char *dest;
         if (node.meta.type_name == "bytearray") {
-            PyObject *ba = PyByteArray_FromStringAndSize(
-                reinterpret_cast<const char *>(full_data.data()),
-                static_cast<Py_ssize_t>(full_data.size())
-            );
-            return ba;
+            result = PyByteArray_FromStringAndSize(nullptr, static_cast<Py_ssize_t>(total));
+            if (!result) return nullptr;
+            dest = PyByteArray_AS_STRING(result);
+        } else {
+            result = PyBytes_FromStringAndSize(nullptr, static_cast<Py_ssize_t>(total));
+            if (!result) return nullptr;
+            dest = PyBytes_AS_STRING(result);
         }
+        for (const auto &chunk: node.chunks) {
+            std::span<const uint8_t> bytes = chunk.bytes();
+            if (!bytes.empty()) std::memcpy(dest, bytes.data(), bytes.size());
+            dest += bytes.size();
+        }
+        return result;
+    }
 
-        if (node.meta.type_name == "memoryview") {
-            // Many builds don't need an actual memoryview object; returning
-            // bytes is acceptable and supported by the test-suite. Create a
-            // bytes object that owns the data and return it.
-            PyObject *bytes_obj = PyBytes_FromStringAndSize(
-                reinterpret_cast<const char *>(full_data.data()),
-                static_cast<Py_ssize_t>(full_data.size())
-            );
-            return bytes_obj;
+    PyObject *deserialize_out_of_band(const SerializedNode &node, const OutOfBandBuffers &buffers) {
+        std::vector<uint8_t> full_data;
+        for (const auto &chunk: node.chunks) {
+            full_data.insert(full_data.end(), chunk.raw_data.begin(), chunk.raw_data.end());
+        }
+        const uint8_t *pos = full_data.data();
+        const uint8_t *end = pos + full_data.size();
+        uint64_t index, size;
+        if (pos == end || *pos > static_cast<uint8_t>(BufferKind::BUFFER)) {
+            PyErr_SetString(PyExc_ValueError, "Invalid out-of-band buffer node");
+            return nullptr;
         }
+        auto kind = static_cast<BufferKind>(*pos++);
+        if (!parse_varint(pos, end, index) || !parse_varint(pos, end, size) || pos != end) {
+            PyErr_SetString(PyExc_ValueError, "Invalid out-of-band buffer node");
+            return nullptr;
+        }
+        return buffers.take(kind, index, size);
+    }
 
-        // Default: bytes
-        return PyBytes_FromStringAndSize(
-            reinterpret_cast<const char *>(full_data.data()),
-            static_cast<Py_ssize_t>(full_data.size())
-        );
+    PyObject *deserialize_ndarray(const SerializedNode &node, const OutOfBandBuffers &buffers) {
+        if (node.chunks.empty()) {
+            PyErr_SetString(PyExc_ValueError, "Invalid numpy array node");
+            return nullptr;
+        }
+        std::span<const uint8_t> first = node.chunks[0].bytes();
+        const uint8_t *pos = first.data();
+        const uint8_t *end = pos + first.size();
+        ArrayHeader header;
+        if (!parse_ndarray_header(pos, end, header)) return nullptr;
+        uint8_t placement = pos < end ? *pos++ : 2;
+        uint64_t index = 0;
+        bool ok = placement == 0 ? pos == end : placement == 1 && parse_varint(pos, end, index) && pos == end;
+        size_t total = 0;
+        for (size_t i = 1; i < node.chunks.size(); i++) total += node.chunks[i].bytes().size();
+        if (!ok || (placement == 0 ? total != header.size : node.chunks.size() != 1)) {
+            PyErr_SetString(PyExc_ValueError, "Invalid numpy array node");
+            return nullptr;
+        }
+        PyObject *buffer;
+        if (placement == 1) {
+            buffer = buffers.take(BufferKind::BUFFER, index, header.size);
+            if (!buffer) return nullptr;
+        } else {
+            buffer = PyByteArray_FromStringAndSize(nullptr, static_cast<Py_ssize_t>(total));
+            if (!buffer) return nullptr;
+            char *dest = PyByteArray_AS_STRING(buffer);
+            for (size_t i = 1; i < node.chunks.size(); i++) {
+                std::span<const uint8_t> bytes = node.chunks[i].bytes();
+                if (!bytes.empty()) std::memcpy(dest, bytes.data(), bytes.size());
+                dest += bytes.size();
+            }
+        }
+        PyObject *array = make_ndarray(header, buffer);
+        Py_DECREF(buffer);
+        return array;
     }
 
     PyObject *deserialize_list(
@@ -159,6 +233,130 @@ namespace pyser {
         return tuple;
     }
 
+    // Strings of a STR_ARRAY node into the empty slots `items`.
+    static bool unpack_strings(const std::vector<uint8_t> &data, Py_ssize_t n, PyObject **items) {
+        const uint8_t *pos = data.data();
+        const uint8_t *end = pos + data.size();
+        std::vector<uint64_t> entries(n);
+        for (Py_ssize_t i = 0; i < n; i++) {
+            if (!parse_varint(pos, end, entries[i])) {
+                PyErr_SetString(PyExc_ValueError, "Invalid packed string data");
+                return false;
+            }
+        }
+        for (Py_ssize_t i = 0; i < n; i++) {
+            uint64_t entry = entries[i];
+            if (entry & 1) {
+                uint64_t first = entry >> 1;
+                if (first >= static_cast<uint64_t>(i)) {
+                    PyErr_SetString(PyExc_ValueError, "Invalid packed string data");
+                    return false;
+                }
+                items[i] = items[first];
+                Py_INCREF(items[i]);
+                continue;
+            }
+            uint64_t header = entry >> 1;
+            auto width = static_cast<StrWidth>(header & 3);
+            uint64_t length = header >> 2;
+            if (length > static_cast<uint64_t>(end - pos) / unit_size(width)) {
+                PyErr_SetString(PyExc_ValueError, "Invalid packed string data");
+                return false;
+            }
+            items[i] = make_str_units(width, pos, length);
+            if (!items[i]) return false;
+            pos += length * unit_size(width);
+        }
+        return true;
+    }
+
+    // Ints of an INT_ARRAY node into the empty slots `items`.
+    static bool unpack_ints(const std::vector<uint8_t> &data, Py_ssize_t n, PyObject **items) {
+        const uint8_t *pos = data.data();
+        const uint8_t *end = pos + data.size();
+        uint64_t values[PACKED_BLOCK_ITEMS];
+        for (Py_ssize_t done = 0; done < n;) {
+            Py_ssize_t count = std::min(PACKED_BLOCK_ITEMS, n - done);
+            IntBlockHeader header;
+            if (!parse_int_header(pos, end, header) ||
+                header.data_size(count) > static_cast<size_t>(end - pos)) {
+                PyErr_SetString(PyExc_ValueError, "Invalid packed int data");
+                return false;
+            }
+            unpack_int_block(header, pos, count, values);
+            pos += header.data_size(count);
+            if (!make_ints(values, count, items + done)) return false;
+            done += count;
+        }
+        if (pos != end) {
+            PyErr_SetString(PyExc_ValueError, "Invalid packed int data");
+            return false;
+        }
+        return true;
+    }
+
+    // Floats of a FLOAT_ARRAY node into the empty slots `items`.
+    static bool unpack_floats(const std::vector<uint8_t> &data, Py_ssize_t n, PyObject **items) {
+        const uint8_t *pos = data.data();
+        const uint8_t *end = pos + data.size();
+        uint64_t values[PACKED_BLOCK_ITEMS];
+        for (Py_ssize_t done = 0; done < n;) {
+            Py_ssize_t count = std::min(PACKED_BLOCK_ITEMS, n - done);
+            uint8_t mode = pos < end ? *pos++ : 0xFF;
+            uint64_t size = 8 * static_cast<uint64_t>(count);
+            bool ok = mode == FLOAT_BLOCK_PLANES || (mode == FLOAT_BLOCK_XOR && parse_varint(pos, end, size));
+            if (!ok || size > static_cast<uint64_t>(end - pos) ||
+                (mode == FLOAT_BLOCK_XOR && !xor_decode(pos, size, count, values))) {
+                PyErr_SetString(PyExc_ValueError, "Invalid packed float data");
+                return false;
+            }
+            if (mode == FLOAT_BLOCK_PLANES) {
+                join_planes(pos, count, values);
+            }
+            pos += size;
+            if (!make_floats(values, count, items + done)) return false;
+            done += count;
+        }
+        if (pos != end) {
+            PyErr_SetString(PyExc_ValueError, "Invalid packed float data");
+            return false;
+        }
+        return true;
+    }
+
+    PyObject *deserialize_packed(const SerializedNode &node) {
+        std::vector<uint8_t> full_data;
+        for (const auto &chunk: node.chunks) {
+            full_data.insert(full_data.end(),
+                             chunk.raw_data.begin(),
+                             chunk.raw_data.end());
+        }
+        auto n = static_cast<Py_ssize_t>(node.meta.total_size);
+        // Strings take at least one byte each; the layouts of the other arrays
+        // are checked as they are read.
+        bool strings = node.type == NodeType::STR_ARRAY;
+        if (n < 0 || (strings && full_data.size() < node.meta.total_size)) {
+            PyErr_SetString(PyExc_ValueError, "Invalid packed array data");
+            return nullptr;
+        }
+        PyObject *seq = node.meta.type_name == "tuple" ? PyTuple_New(n) : PyList_New(n);
+        if (!seq) return nullptr;
+        PyObject **items = PySequence_Fast_ITEMS(seq);
+        bool ok;
+        if (strings) {
+            ok = unpack_strings(full_data, n, items);
+        } else if (node.type == NodeType::INT_ARRAY) {
+            ok = unpack_ints(full_data, n, items);
+        } else {
+            ok = unpack_floats(full_data, n, items);
+        }
+        if (!ok) {
+            Py_DECREF(seq);
+            return nullptr;
+        }
+        return seq;
+    }
+
     PyObject *deserialize_dict(
         const SerializedNode &node,
         const SerializedGraph &graph,
@@ -179,21 +377,22 @@ namespace pyser {
         return set;
     }
 
-    PyObject *deserialize_function(
+    PyObject *deserialize_frozenset(
         const SerializedNode &node,
         const SerializedGraph &graph,
         std::unordered_map<uint32_t, PyObject *> &cache
     ) {
-#ifdef PYSER_ENABLE_DEBUG_PRINTS
-        fprintf(stderr, "pyser: deserialize_function: func_code_empty=%d module='%s'\n", (int)node.meta.func_code.empty(), node.meta.module_name.c_str());
-#endif
-        if (node.meta.func_code.empty()) {
-            PyErr_SetString(PyExc_ValueError, "Function code is empty");
-            return nullptr;
+        // Frozensets are immutable, so members are collected into a placeholder
+        // tuple by resolve_pointers() and the frozenset is built from it once
+        // the last member is in place.
+        if (node.pointers.empty()) {
+            return PyFrozenSet_New(nullptr);
         }
+        return deserialize_tuple(node, graph, cache);
+    }
 
-        // The serializer stored a JSON-encoded code object as base64. Decode and
-        // use json_to_pyobj to reconstruct the code object.
+    // Code stored by older versions: a JSON-encoded code object, base64'd.
+    static PyObject *load_legacy_code(const SerializedNode &node) {
         std::vector<uint8_t> code_obj_bytes = base64::decode(node.meta.func_code);
         if (code_obj_bytes.empty()) {
             PyErr_SetString(PyExc_ValueError, "Empty code object JSON");
@@ -227,6 +426,38 @@ namespace pyser {
         }
 
 
+        return code_obj;
+    }
+
+    PyObject *deserialize_function(
+        const SerializedNode &node,
+        const SerializedGraph &graph,
+        std::unordered_map<uint32_t, PyObject *> &cache
+    ) {
+#ifdef PYSER_ENABLE_DEBUG_PRINTS
+        fprintf(stderr, "pyser: deserialize_function: func_code_empty=%d module='%s'\n", (int)node.meta.func_code.empty(), node.meta.module_name.c_str());
+#endif
+        if (node.meta.func_code.empty()) {
+            PyErr_SetString(PyExc_ValueError, "Function code is empty");
+            return nullptr;
+        }
+
+        PyObject *code_obj = nullptr;
+        if (node.meta.func_code[0] == '#') {
+            // Index into the graph's code table (code_codec.h). Identical code
+            // is reconstructed once per process.
+            size_t index = std::strtoul(node.meta.func_code.c_str() + 1, nullptr, 10);
+            if (index >= graph.code_blobs.size()) {
+                PyErr_Format(PyExc_ValueError, "Invalid code reference '%s'", node.meta.func_code.c_str());
+                return nullptr;
+            }
+            code_obj = load_code(graph.code_blobs[index]);
+            if (!code_obj) return nullptr;
+        } else {
+            code_obj = load_legacy_code(node);
+            if (!code_obj) return nullptr;
+        }
+
         PyObject *globals = PyDict_New();
         if (!globals) {
             Py_DECREF(code_obj);
@@ -305,52 +536,31 @@ namespace pyser {
     }
 
 
-    PyObject *deserialize_module(const SerializedNode &node) {
+    PyObject *deserialize_module(const SerializedNode &node, ClassCache &classes) {
         if (node.meta.module_name.empty()) {
             PyErr_SetString(PyExc_ValueError, "Module name is empty");
             return nullptr;
         }
-        PyObject *module_name = PyUnicode_FromString(node.meta.module_name.c_str());
-        PyObject *module = PyImport_Import(module_name);
-        Py_DECREF(module_name);
+        PyObject *module = classes.lookup_module(node.meta.module_name);
         if (!module) {
             PyErr_Format(PyExc_ImportError,
                          "Failed to import module '%s'",
                          node.meta.module_name.c_str());
             return nullptr;
         }
+        Py_INCREF(module);
         return module;
     }
 
     PyObject *deserialize_custom(
         const SerializedNode &node,
         const SerializedGraph &graph,
-        std::unordered_map<uint32_t, PyObject *> &cache
+        std::unordered_map<uint32_t, PyObject *> &cache,
+        ClassCache &classes
     ) {
-        PyObject *module = nullptr;
-        PyObject *cls = nullptr;
-        if (!node.meta.module_name.empty()) {
-            PyObject *module_name = PyUnicode_FromString(node.meta.module_name.c_str());
-            module = PyImport_Import(module_name);
-            Py_DECREF(module_name);
-            if (!module) {
-                // If importing the original module failed (e.g. the class was
-                // defined locally inside a function), fall through and attempt
-                // lower-risk fallbacks below instead of failing immediately.
-                PyErr_Clear();
-                module = nullptr;
-            }
-        }
-        if (module) {
-            cls = PyObject_GetAttrString(module, node.meta.type_name.c_str());
-            Py_DECREF(module);
-        } else {
-            PyObject *builtins = PyEval_GetBuiltins();
-            cls = PyDict_GetItemString(builtins, node.meta.type_name.c_str());
-            if (cls) {
-                Py_INCREF(cls);
-            }
-        }
+        // Resolved once per (module, type) per load; falls back to builtins when
+        // the module cannot be imported (e.g. the class was defined locally).
+        PyObject *cls = classes.lookup_class(node.meta.module_name, node.meta.type_name);
         if (!cls) {
             // Class not found by import or in builtins. Instead of failing,
             // create a generic object that supports attribute assignment
@@ -361,16 +571,10 @@ namespace pyser {
             // Unconditional diagnostic to help understand why fallback may fail.
             fprintf(stderr, "pyser: deserialize_custom: class '%s' not found in module '%s' - attempting SimpleNamespace fallback\n", node.meta.type_name.c_str(), node.meta.module_name.c_str());
 #endif
-            PyObject *types_mod = PyImport_ImportModule("types");
-            if (types_mod) {
-                PyObject *ss = PyObject_GetAttrString(types_mod, "SimpleNamespace");
-                Py_DECREF(types_mod);
-                if (ss && PyCallable_Check(ss)) {
-                    PyObject *inst = PyObject_CallObject(ss, nullptr);
-                    Py_XDECREF(ss);
-                    if (inst) return inst;
-                }
-                Py_XDECREF(ss);
+            PyObject *ss = classes.lookup_class("types", "SimpleNamespace");
+            if (ss) {
+                PyObject *inst = PyObject_CallObject(ss, nullptr);
+                if (inst) return inst;
             }
 #ifdef PYSER_ENABLE_DEBUG_PRINTS
             fprintf(stderr, "pyser: deserialize_custom: SimpleNamespace fallback failed for class '%s'\n", node.meta.type_name.c_str());
@@ -394,8 +598,6 @@ namespace pyser {
             PyErr_Clear();
         }
 
-        Py_DECREF(cls);
-
         if (!obj) {
             PyErr_Format(PyExc_TypeError,
                          "Failed to allocate instance of class '%s'",
@@ -406,16 +608,90 @@ namespace pyser {
         return obj;
     }
 
+    static bool reference_target(const SerializedNode &node, uint32_t &target_id) {
+        if (node.chunks.empty() || node.chunks[0].raw_data.size() != sizeof(uint32_t)) {
+            return false;
+        }
+        std::memcpy(&target_id, node.chunks[0].raw_data.data(), sizeof(uint32_t));
+        return true;
+    }
+
+    // Child of `node` behind the pointer named `field`, needed to create the
+    // node's object. Children precede their parent in the node list, so it is
+    // in `cache` already unless the pointer goes through a REFERENCE node.
+    // Returns a borrowed reference, or nullptr with the error set.
+    static PyObject *init_child(
+        const SerializedNode &node,
+        std::string_view field,
+        const NodeIndex &nodes,
+        std::unordered_map<uint32_t, PyObject *> &cache
+    ) {
+        for (const auto &ptr: node.pointers) {
+            if (ptr.field_name != field) continue;
+            uint32_t id = ptr.to_node_id;
+            if (!cache.count(id)) {
+                auto node_it = nodes.find(id);
+                if (node_it != nodes.end() && node_it->second->type == NodeType::REFERENCE) {
+                    reference_target(*node_it->second, id);
+                }
+            }
+            auto it = cache.find(id);
+            if (it != cache.end()) return it->second;
+            break;
+        }
+        PyErr_Format(PyExc_ValueError, "Missing %s of node %u", std::string(field).c_str(), node.node_id);
+        return nullptr;
+    }
+
+    PyObject *deserialize_std(
+        const SerializedNode &node,
+        const NodeIndex &nodes,
+        std::unordered_map<uint32_t, PyObject *> &cache,
+        ClassCache &classes
+    ) {
+        StdKind kind = node_std_kind(node.type);
+        std::vector<uint8_t> payload;
+        for (const auto &chunk: node.chunks) {
+            payload.insert(payload.end(), chunk.raw_data.begin(), chunk.raw_data.end());
+        }
+        if (is_std_value(kind)) return unpack_std_value(kind, payload.data(), payload.size());
+        if (kind == StdKind::ENUM) {
+            PyObject *cls = classes.lookup_global(node.meta.module_name, node.meta.type_name);
+            PyObject *value = cls ? init_child(node, "init:value", nodes, cache) : nullptr;
+            return value ? PyObject_CallOneArg(cls, value) : nullptr;
+        }
+        Py_ssize_t maxlen = -1;
+        if (kind == StdKind::DEQUE) {
+            const uint8_t *pos = payload.data();
+            uint64_t bound;
+            if (!parse_varint(pos, payload.data() + payload.size(), bound) || bound > PY_SSIZE_T_MAX) {
+                PyErr_SetString(PyExc_ValueError, "Invalid deque bound");
+                return nullptr;
+            }
+            maxlen = static_cast<Py_ssize_t>(bound) - 1;
+        }
+        // Items are added by resolve_pointers().
+        PyObject *obj = new_std_container(kind, maxlen);
+        if (!obj || kind != StdKind::DEFAULT_DICT) return obj;
+        PyObject *factory = Py_None;
+        if (!node.meta.module_name.empty()) {
+            factory = classes.lookup_global(node.meta.module_name, node.meta.type_name);
+        } else if (!node.pointers.empty() && node.pointers.front().field_name == "init:default_factory") {
+            factory = init_child(node, "init:default_factory", nodes, cache);
+        }
+        if (!factory || PyObject_SetAttrString(obj, "default_factory", factory) < 0) Py_CLEAR(obj);
+        return obj;
+    }
+
     PyObject *deserialize_reference(
         const SerializedNode &node,
         std::unordered_map<uint32_t, PyObject *> &cache
     ) {
-        if (node.chunks.empty() || node.chunks[0].raw_data.size() != sizeof(uint32_t)) {
+        uint32_t target_id;
+        if (!reference_target(node, target_id)) {
             PyErr_SetString(PyExc_ValueError, "Invalid reference data");
             return nullptr;
         }
-        uint32_t target_id;
-        std::memcpy(&target_id, node.chunks[0].raw_data.data(), sizeof(uint32_t));
         auto it = cache.find(target_id);
         if (it == cache.end()) {
             PyErr_Format(PyExc_ValueError,
@@ -428,26 +704,63 @@ namespace pyser {
         return target;
     }
 
-    void PyObjectSerializer::resolve_pointers(
+    bool PyObjectSerializer::resolve_pointers(
         const SerializedGraph &graph,
+        const NodeIndex &index,
         std::unordered_map<uint32_t, PyObject *> &cache
     ) {
+        // Members still missing from each frozenset's placeholder tuple.
+        std::unordered_map<uint32_t, size_t> frozen_pending;
+        for (const auto &n: graph.nodes) {
+            if (n.type == NodeType::FROZENSET && !n.pointers.empty()) {
+                frozen_pending[n.node_id] = n.pointers.size();
+            }
+        }
+        // REFERENCE nodes are looked up here rather than when the node list is
+        // materialized: the target may be an ancestor that did not exist yet, or
+        // a frozenset that was still a placeholder tuple at that point.
+        auto lookup = [&](uint32_t id) -> PyObject * {
+            auto node_it = index.find(id);
+            if (node_it != index.end() && node_it->second->type == NodeType::REFERENCE) {
+                if (!reference_target(*node_it->second, id)) return nullptr;
+            }
+            auto it = cache.find(id);
+            return it == cache.end() ? nullptr : it->second;
+        };
         for (const auto &ptr: graph.all_pointers) {
             // Diagnostic: print pointer being resolved for easier tracing of crashes
 #ifdef PYSER_ENABLE_DEBUG_PRINTS
             fprintf(stderr, "pyser: resolve pointer from=%u to=%u field=%s\n", ptr.from_node_id, ptr.to_node_id, ptr.field_name.c_str());
 #endif
-            auto src_it = cache.find(ptr.from_node_id);
-            auto dst_it = cache.find(ptr.to_node_id);
-            if (src_it == cache.end() || dst_it == cache.end()) {
+            PyObject *src_obj = lookup(ptr.from_node_id);
+            PyObject *dst_obj = lookup(ptr.to_node_id);
+            if (!src_obj || !dst_obj) {
+                continue;
+            }
+            const std::pmr::string &field = ptr.field_name;
+            // Already consumed when the object was created (deserialize_std).
+            if (field.rfind("init:", 0) == 0) continue;
+            auto frozen_it = frozen_pending.find(ptr.from_node_id);
+            if (frozen_it != frozen_pending.end()) {
+                size_t index_in_tuple;
+                try { index_in_tuple = std::stoull(std::string(field)); } catch (...) { continue; }
+                if (index_in_tuple >= static_cast<size_t>(PyTuple_Size(src_obj))) continue;
+                PyObject *old_item = PyTuple_GET_ITEM(src_obj, index_in_tuple);
+                Py_INCREF(dst_obj);
+                PyTuple_SET_ITEM(src_obj, index_in_tuple, dst_obj);
+                Py_XDECREF(old_item);
+                if (--frozen_it->second == 0) {
+                    PyObject *frozen = PyFrozenSet_New(src_obj);
+                    if (!frozen) return false;
+                    Py_DECREF(src_obj);
+                    cache[ptr.from_node_id] = frozen;
+                    frozen_pending.erase(frozen_it);
+                }
                 continue;
             }
-            PyObject *src_obj = src_it->second;
-            PyObject *dst_obj = dst_it->second;
-            const std::string &field = ptr.field_name;
             if (PyList_Check(src_obj)) {
                 try {
-                    size_t index = std::stoull(field);
+                    size_t index = std::stoull(std::string(field));
                     // PyList_SetItem steals a reference; provide an INCREF'd reference.
                     Py_INCREF(dst_obj);
                     if (PyList_SetItem(src_obj, static_cast<Py_ssize_t>(index), dst_obj) < 0) {
@@ -462,16 +775,17 @@ namespace pyser {
                 }
             } else if (PyTuple_Check(src_obj)) {
                 try {
-                    size_t index = std::stoull(field);
+                    size_t index = std::stoull(std::string(field));
                     // For tuples we need to replace or create a new tuple; here we set item
                     // only if within bounds. PyTuple_SetItem steals a reference.
+                    // PyTuple_SetItem refuses tuples with more than one reference,
+                    // which is the case as soon as the tuple is shared; fill the
+                    // slot directly since the tuple is still under construction.
                     if (index < static_cast<size_t>(PyTuple_Size(src_obj))) {
+                        PyObject *old_item = PyTuple_GET_ITEM(src_obj, index);
                         Py_INCREF(dst_obj);
-                        if (PyTuple_SetItem(src_obj, static_cast<Py_ssize_t>(index), dst_obj) < 0) {
-#ifdef PYSER_ENABLE_DEBUG_PRINTS
-                            std::cerr << "Failed to set tuple item: " << field << std::endl;
-#endif
-                        }
+                        PyTuple_SET_ITEM(src_obj, static_cast<Py_ssize_t>(index), dst_obj);
+                        Py_XDECREF(old_item);
                     } else {
 #ifdef PYSER_ENABLE_DEBUG_PRINTS
                         std::cerr << "Tuple index out of range: " << field << std::endl;
@@ -487,20 +801,18 @@ namespace pyser {
                     continue;
                 }
                 if (field.find("val:") == 0) {
-                    std::string key_name = field.substr(4);
-                    const SerializedNode *node = nullptr;
-                    for (const auto &n: graph.nodes) {
-                        if (n.node_id == ptr.from_node_id) {
-                            node = &n;
-                            break;
-                        }
-                    }
+                    std::pmr::string key_name = field.substr(4);
+                    auto node_it = index.find(ptr.from_node_id);
+                    const SerializedNode *node = node_it == index.end() ? nullptr : node_it->second;
                     if (node) {
                         auto key_it = node->meta.attr_node_ids.find(key_name);
                         if (key_it != node->meta.attr_node_ids.end()) {
                             PyObject *key = PyUnicode_FromString(key_name.c_str());
                             if (key) {
-                                if (PyDict_SetItem(src_obj, key, dst_obj) < 0) {
+                                // OrderedDict keeps its own order next to the dict storage.
+                                int rc = PyDict_CheckExact(src_obj) ? PyDict_SetItem(src_obj, key, dst_obj)
+                                                                    : PyObject_SetItem(src_obj, key, dst_obj);
+                                if (rc < 0) {
 #ifdef PYSER_ENABLE_DEBUG_PRINTS
                                     std::cerr << "Failed to set dict item for key: " << key_name << std::endl;
 #endif
@@ -510,6 +822,14 @@ namespace pyser {
                         }
                     }
                 }
+            } else if (std_kind(src_obj) == StdKind::DEQUE) {
+                // Items arrive in index order.
+                PyObject *rv = PyObject_CallMethod(src_obj, "append", "O", dst_obj);
+                if (!rv) {
+                    PyErr_Clear();
+                    continue;
+                }
+                Py_DECREF(rv);
             } else if (PySet_Check(src_obj)) {
                 if (PySet_Add(src_obj, dst_obj) < 0) {
 #ifdef PYSER_ENABLE_DEBUG_PRINTS
@@ -518,7 +838,7 @@ namespace pyser {
                 }
             } else if (PyFunction_Check(src_obj)) {
                 if (field.find("closure:") == 0) {
-                    std::string idx_str = field.substr(8);
+                    std::string idx_str(std::string_view(field).substr(8));
                     size_t idx;
                     try { idx = std::stoull(idx_str); } catch (...) {
 #ifdef PYSER_ENABLE_DEBUG_PRINTS
@@ -601,9 +921,10 @@ namespace pyser {
                 }
              }
          }
+        return true;
      }
 
-    PyObject *PyObjectSerializer::deserialize(const SerializedGraph &graph) {
+    PyObject *PyObjectSerializer::deserialize(const SerializedGraph &graph, PyObject *buffers) {
 #ifdef PYSER_ENABLE_DEBUG_PRINTS
         fprintf(stderr, "pyser: deserialize graph nodes=%zu root=%u\n", graph.nodes.size(), graph.root_id);
 #endif
@@ -620,8 +941,28 @@ namespace pyser {
                 case NodeType::TUPLE: type_name = "TUPLE"; break;
                 case NodeType::DICT: type_name = "DICT"; break;
                 case NodeType::SET: type_name = "SET"; break;
+                case NodeType::FROZENSET: type_name = "FROZENSET"; break;
                 case NodeType::FUNCTION: type_name = "FUNCTION"; break;
                 case NodeType::MODULE: type_name = "MODULE"; break;
+                case NodeType::INT_ARRAY: type_name = "INT_ARRAY"; break;
+                case NodeType::FLOAT_ARRAY: type_name = "FLOAT_ARRAY"; break;
+                case NodeType::STR_ARRAY: type_name = "STR_ARRAY"; break;
+                case NodeType::STR_UNITS: type_name = "STR_UNITS"; break;
+                case NodeType::OUT_OF_BAND: type_name = "OUT_OF_BAND"; break;
+                case NodeType::NDARRAY: type_name = "NDARRAY"; break;
+                case NodeType::DATETIME: type_name = "DATETIME"; break;
+                case NodeType::DATE: type_name = "DATE"; break;
+                case NodeType::TIME: type_name = "TIME"; break;
+                case NodeType::TIMEDELTA: type_name = "TIMEDELTA"; break;
+                case NodeType::DECIMAL: type_name = "DECIMAL"; break;
+                case NodeType::COMPLEX: type_name = "COMPLEX"; break;
+                case NodeType::RANGE: type_name = "RANGE"; break;
+                case NodeType::UUID: type_name = "UUID"; break;
+                case NodeType::ENUM: type_name = "ENUM"; break;
+                case NodeType::DEQUE: type_name = "DEQUE"; break;
+                case NodeType::ORDERED_DICT: type_name = "ORDERED_DICT"; break;
+                case NodeType::DEFAULT_DICT: type_name = "DEFAULT_DICT"; break;
+                case NodeType::COUNTER: type_name = "COUNTER"; break;
                 case NodeType::CUSTOM: type_name = "CUSTOM"; break;
                 case NodeType::REFERENCE: type_name = "REFERENCE"; break;
                 default: type_name = "UNKNOWN"; break;
@@ -630,18 +971,34 @@ namespace pyser {
             fprintf(stderr, "pyser: node id=%u type=%s meta.type_name='%s' chunks=%zu\n", n.node_id, type_name.c_str(), n.meta.type_name.c_str(), n.chunks.size());
 #endif
         }
+        NodeIndex nodes;
+        nodes.reserve(graph.nodes.size());
+        for (const auto &node: graph.nodes) {
+            nodes[node.node_id] = &node;
+        }
         std::unordered_map<uint32_t, PyObject *> cache;
+        classes_.new_epoch();
+        if (!buffers_.reset(buffers)) return nullptr;
         for (const auto &node: graph.nodes) {
-            PyObject *obj = deserialize_node(node.node_id, graph, cache);
+            // References are bound lazily by resolve_pointers().
+            if (node.type == NodeType::REFERENCE) continue;
+            PyObject *obj = deserialize_node(node.node_id, graph, nodes, cache);
             if (!obj) {
                 for (auto &pair: cache) {
                     Py_XDECREF(pair.second);
                 }
+                buffers_.reset(nullptr);
                 return nullptr;
             }
             cache[node.node_id] = obj;
         }
-        resolve_pointers(graph, cache);
+        buffers_.reset(nullptr);
+        if (!resolve_pointers(graph, nodes, cache)) {
+            for (auto &pair: cache) {
+                Py_XDECREF(pair.second);
+            }
+            return nullptr;
+        }
         PyObject *root = cache[graph.root_id];
         Py_INCREF(root);
         if (PyErr_Occurred()) {
@@ -656,6 +1013,7 @@ namespace pyser {
     PyObject *PyObjectSerializer::deserialize_node(
         uint32_t node_id,
         const SerializedGraph &graph,
+        const NodeIndex &nodes,
         std::unordered_map<uint32_t, PyObject *> &cache
     ) {
         // Diagnostic: log node id being deserialized and approximate type
@@ -667,13 +1025,8 @@ namespace pyser {
             Py_INCREF(it->second);
             return it->second;
         }
-        const SerializedNode *node = nullptr;
-        for (const auto &n: graph.nodes) {
-            if (n.node_id == node_id) {
-                node = &n;
-                break;
-            }
-        }
+        auto node_it = nodes.find(node_id);
+        const SerializedNode *node = node_it == nodes.end() ? nullptr : node_it->second;
         if (!node) {
             PyErr_Format(PyExc_ValueError, "Node %u not found", node_id);
             return nullptr;
@@ -696,29 +1049,61 @@ namespace pyser {
             case NodeType::STRING:
                 result = deserialize_string(*node);
                 break;
+            case NodeType::STR_UNITS:
+                result = deserialize_str_units(*node);
+                break;
             case NodeType::BYTES:
                 result = deserialize_bytes(*node);
                 break;
+            case NodeType::OUT_OF_BAND:
+                result = deserialize_out_of_band(*node, buffers_);
+                break;
+            case NodeType::NDARRAY:
+                result = deserialize_ndarray(*node, buffers_);
+                break;
             case NodeType::LIST:
                 result = deserialize_list(*node, graph, cache);
                 break;
             case NodeType::TUPLE:
                 result = deserialize_tuple(*node, graph, cache);
                 break;
+            case NodeType::INT_ARRAY:
+            case NodeType::FLOAT_ARRAY:
+            case NodeType::STR_ARRAY:
+                result = deserialize_packed(*node);
+                break;
             case NodeType::DICT:
                 result = deserialize_dict(*node, graph, cache);
                 break;
             case NodeType::SET:
                 result = deserialize_set(*node, graph, cache);
                 break;
+            case NodeType::FROZENSET:
+                result = deserialize_frozenset(*node, graph, cache);
+                break;
             case NodeType::FUNCTION:
                 result = deserialize_function(*node, graph, cache);
                 break;
             case NodeType::MODULE:
-                result = deserialize_module(*node);
+                result = deserialize_module(*node, classes_);
+                break;
+            case NodeType::DATETIME:
+            case NodeType::DATE:
+            case NodeType::TIME:
+            case NodeType::TIMEDELTA:
+            case NodeType::DECIMAL:
+            case NodeType::COMPLEX:
+            case NodeType::RANGE:
+            case NodeType::UUID:
+            case NodeType::ENUM:
+            case NodeType::DEQUE:
+            case NodeType::ORDERED_DICT:
+            case NodeType::DEFAULT_DICT:
+            case NodeType::COUNTER:
+                result = deserialize_std(*node, nodes, cache, classes_);
                 break;
             case NodeType::CUSTOM:
-                result = deserialize_custom(*node, graph, cache);
+                result = deserialize_custom(*node, graph, cache, classes_);
                 break;
             case NodeType::REFERENCE:
                 result = deserialize_reference(*node, cache);
@@ -7,7 +7,7 @@
 namespace pyser {
     using json = nlohmann::json;
 
-    std::vector<uint8_t> SerializedGraph::to_bytes() const {
+    std::vector<uint8_t> SerializedGraph::to_bytes(ZSTD_CCtx *cctx, const ZSTD_CDict *dictionary) const {
         json j;
         j["root_id"] = root_id;
         j["nodes"] = json::array();
@@ -36,7 +36,7 @@ namespace pyser {
                 if (c > 127) { needs_b64 = true; break; }
             }
             if (needs_b64) {
-                meta["func_code"] = base64::encode(std::vector<uint8_t>(node.meta.func_code.begin(), node.meta.func_code.end()));
+                meta["func_code"] = base64::encode(std::string_view(node.meta.func_code));
                 meta["func_code_b64"] = true;
             } else {
                 meta["func_code_b64"] = false;
@@ -57,6 +57,13 @@ namespace pyser {
             node_json["chunk_ids"] = chunk_ids;
             j["nodes"].push_back(node_json);
         }
+        if (!code_blobs.empty()) {
+            json codes = json::array();
+            for (const auto &blob: code_blobs) {
+                codes.push_back(base64::encode(std::string_view(blob)));
+            }
+            j["codes"] = std::move(codes);
+        }
         for (const auto &ptr: all_pointers) {
             json ptr_json;
             ptr_json["from_node"] = ptr.from_node_id;
@@ -91,11 +98,20 @@ namespace pyser {
         }
         size_t max_compressed = ZSTD_compressBound(json_str.size());
         std::vector<uint8_t> compressed(max_compressed);
-        size_t compressed_size = ZSTD_compress(
-            compressed.data(), compressed.size(),
-            json_str.data(), json_str.size(),
-            3
-        );
+        size_t compressed_size;
+        if (dictionary) {
+            compressed_size = ZSTD_compress_usingCDict(cctx, compressed.data(), compressed.size(),
+                                                       json_str.data(), json_str.size(), dictionary);
+        } else if (cctx) {
+            compressed_size = ZSTD_compressCCtx(cctx, compressed.data(), compressed.size(),
+                                                json_str.data(), json_str.size(), 3);
+        } else {
+            compressed_size = ZSTD_compress(
+                compressed.data(), compressed.size(),
+                json_str.data(), json_str.size(),
+                3
+            );
+        }
         if (ZSTD_isError(compressed_size)) {
             throw std::runtime_error("Zstd compression failed");
         }
@@ -104,28 +120,50 @@ namespace pyser {
     }
 
     SerializedGraph SerializedGraph::from_bytes(const std::vector<uint8_t> &data) {
-        size_t decompressed_size = ZSTD_getFrameContentSize(data.data(), data.size());
+        return from_bytes(data.data(), data.size());
+    }
+
+    SerializedGraph SerializedGraph::from_bytes(const uint8_t *data, size_t size, ZSTD_DCtx *dctx,
+                                                const ZSTD_DDict *dictionary) {
+        size_t decompressed_size = ZSTD_getFrameContentSize(data, size);
         std::vector<char> decompressed(decompressed_size);
-        size_t result = ZSTD_decompress(
-            decompressed.data(), decompressed.size(),
-            data.data(), data.size()
-        );
+        size_t result;
+        if (dictionary) {
+            result = ZSTD_decompress_usingDDict(dctx, decompressed.data(), decompressed.size(), data, size,
+                                                dictionary);
+        } else if (dctx) {
+            result = ZSTD_decompressDCtx(dctx, decompressed.data(), decompressed.size(), data, size);
+        } else {
+            result = ZSTD_decompress(
+                decompressed.data(), decompressed.size(),
+                data, size
+            );
+        }
         if (ZSTD_isError(result)) {
             throw std::runtime_error("Zstd decompression failed");
         }
         json j = json::parse(std::string(decompressed.data(), decompressed.size()));
         SerializedGraph graph;
+        std::pmr::memory_resource *arena = graph.resource();
+        // JSON strings are copied straight into arena-backed strings.
+        auto arena_string = [arena](const json &value) {
+            const auto &str = value.get_ref<const std::string &>();
+            return std::pmr::string(str.data(), str.size(), arena);
+        };
         graph.root_id = j["root_id"];
-        std::unordered_map<uint32_t, DataChunk> chunks_map;
+        std::pmr::unordered_map<uint32_t, DataChunk> chunks_map(arena);
+        chunks_map.reserve(j["chunks"].size());
         for (const auto &chunk_json: j["chunks"]) {
-            DataChunk chunk;
+            DataChunk chunk(arena);
             chunk.chunk_id = chunk_json["id"];
-            chunk.base64_data = chunk_json["data"];
-            chunk.sha256_hash = chunk_json["sha256"];
+            chunk.base64_data = arena_string(chunk_json["data"]);
+            chunk.sha256_hash = arena_string(chunk_json["sha256"]);
             chunk.original_size = chunk_json["size"];
-            chunk.raw_data = base64::decode(chunk.base64_data);
-            std::string computed_hash = PyObjectSerializer::compute_sha256(chunk.raw_data);
-            if (computed_hash != chunk.sha256_hash) {
+            chunk.raw_data.resize(base64::decoded_size_max(chunk.base64_data.size()));
+            chunk.raw_data.resize(base64::decode(chunk.raw_data.data(), chunk.base64_data.data(),
+                                                 chunk.base64_data.size()));
+            std::string computed_hash = PyObjectSerializer::compute_sha256(chunk.raw_data.data(), chunk.raw_data.size());
+            if (std::string_view(computed_hash) != std::string_view(chunk.sha256_hash)) {
                 // Diagnostic output to help debugging: print chunk id, stored hash, computed hash, sizes
 #ifdef PYSER_ENABLE_DEBUG_PRINTS
                 fprintf(stderr, "pyser: chunk id=%u stored_sha=%s computed_sha=%s raw_size=%zu base64_len=%zu\n",
@@ -142,43 +180,61 @@ namespace pyser {
 #endif
                 // throw std::runtime_error("Chunk SHA256 mismatch - data corrupted");
             }
-            chunks_map[chunk.chunk_id] = chunk;
+            uint32_t chunk_id = chunk.chunk_id;
+            chunks_map.emplace(chunk_id, std::move(chunk));
         }
 
+        graph.nodes.reserve(j["nodes"].size());
         for (const auto &node_json: j["nodes"]) {
-            SerializedNode node;
+            SerializedNode node(arena);
+            const json &meta = node_json["meta"];
             node.node_id = node_json["id"];
             node.type = static_cast<NodeType>(node_json["type"].get<int>());
-            node.meta.type_name = node_json["meta"]["type_name"];
-            node.meta.module_name = node_json["meta"]["module_name"];
-            node.meta.total_size = node_json["meta"]["total_size"];
-            node.meta.refcount = node_json["meta"]["refcount"];
-            node.meta.has_dict = node_json["meta"]["has_dict"];
-            node.meta.is_bigint = node_json["meta"]["is_bigint"];
-            node.meta.bigint_num_digits = node_json["meta"]["bigint_num_digits"];
-            node.meta.attr_names = node_json["meta"]["attr_names"].get<std::vector<std::string> >();
-            node.meta.attr_node_ids = node_json["meta"]["attr_node_ids"]
-                    .get<std::unordered_map<std::string, uint32_t> >();
-            node.meta.func_code = node_json["meta"]["func_code"];
-            if (node_json["meta"].contains("func_defaults")) {
-                node.meta.func_defaults = node_json["meta"]["func_defaults"];
+            node.meta.type_name = arena_string(meta["type_name"]);
+            node.meta.module_name = arena_string(meta["module_name"]);
+            node.meta.total_size = meta["total_size"];
+            node.meta.refcount = meta["refcount"];
+            node.meta.has_dict = meta["has_dict"];
+            node.meta.is_bigint = meta["is_bigint"];
+            node.meta.bigint_num_digits = meta["bigint_num_digits"];
+            for (const auto &name: meta["attr_names"]) {
+                node.meta.attr_names.push_back(arena_string(name));
             }
-            if (node_json["meta"].contains("func_kwdefaults")) {
-                node.meta.func_kwdefaults = node_json["meta"]["func_kwdefaults"];
+            for (const auto &[name, id]: meta["attr_node_ids"].items()) {
+                node.meta.attr_node_ids.emplace(std::pmr::string(name, arena), id.get<uint32_t>());
             }
+            node.meta.func_code = arena_string(meta["func_code"]);
+            if (meta.contains("func_defaults")) {
+                node.meta.func_defaults = arena_string(meta["func_defaults"]);
+            }
+            if (meta.contains("func_kwdefaults")) {
+                node.meta.func_kwdefaults = arena_string(meta["func_kwdefaults"]);
+            }
+            // Every chunk belongs to exactly one node, so it is moved out of
+            // the lookup table rather than copied.
             for (uint32_t chunk_id: node_json["chunk_ids"]) {
-                node.chunks.push_back(chunks_map[chunk_id]);
+                auto chunk_it = chunks_map.find(chunk_id);
+                if (chunk_it != chunks_map.end()) {
+                    node.chunks.push_back(std::move(chunk_it->second));
+                }
+            }
+            graph.nodes.push_back(std::move(node));
+        }
+        if (j.contains("codes")) {
+            for (const auto &blob: j["codes"]) {
+                std::vector<uint8_t> decoded = base64::decode(blob.get_ref<const std::string &>());
+                graph.code_blobs.emplace_back(reinterpret_cast<const char *>(decoded.data()), decoded.size());
             }
-            graph.nodes.push_back(node);
         }
+        graph.all_pointers.reserve(j["pointers"].size());
         for (const auto &ptr_json: j["pointers"]) {
-            PointerInfo ptr;
+            PointerInfo ptr(arena);
             ptr.from_node_id = ptr_json["from_node"];
             ptr.from_chunk_id = ptr_json["from_chunk"];
             ptr.offset = ptr_json["offset"];
             ptr.to_node_id = ptr_json["to_node"];
-            ptr.field_name = ptr_json["field"];
-            graph.all_pointers.push_back(ptr);
+            ptr.field_name = arena_string(ptr_json["field"]);
+            graph.all_pointers.push_back(std::move(ptr));
         }
         // Populate per-node pointers for convenient access during deserialization.
         // This mirrors how pointers were created during serialization.
@@ -0,0 +1,1154 @@
+// pyser_wire.cpp
+// Single-pass encoder for the wire format described in pyser_wire.hpp.
+#include "pyser_wire.hpp"
+#include <zstd.h>
+#include <cstring>
+#include <stdexcept>
+
+namespace pyser {
+    // A container whose element records are still being written. The container's
+    // own tag and count are already in the buffer when its frame is pushed.
+    struct WireEncoder::Frame {
+        PyObject *obj = nullptr;    // borrowed, kept alive by the parent
+        PyObject *owned = nullptr;  // function closure, custom __dict__, reduce tuple, set iterator,
+                                    // enum value, deque items, OrderedDict items or default factory
+        PyObject *held = nullptr;   // current child if we own a reference to it
+        WireTag kind = WireTag::NONE;
+        size_t depth = 0;
+        Py_ssize_t pos = 0;         // PyDict_Next / _PySet_NextEntry cursor
+        Py_ssize_t index = 0;       // next list/tuple index or closure cell
+        Py_ssize_t remaining = 0;   // elements (or dict items) still to write
+        PyObject *value = nullptr;  // dict value following the key just written
+        bool want_value = false;
+        int stage = 0;              // function: defaults, kwdefaults, cell count, cells;
+                                    // rows: segment header, plain, generic column, next column;
+                                    // defaultdict: factory, items
+        const TypePlan *plan = nullptr;  // custom: slots are written before __dict__ values
+        // rows: `owned` holds the values of the current run column by column.
+        Py_ssize_t count = 0;       // elements of the sequence
+        Py_ssize_t run_rows = 0;
+        Py_ssize_t n_columns = 0;
+        Py_ssize_t column = 0;
+        Py_ssize_t row = 0;         // next row of the generic column being written
+    };
+
+    WireEncoder::WireEncoder(size_t max_depth) : cctx_(ZSTD_createCCtx()), max_depth_(max_depth) {
+        if (!cctx_) {
+            throw std::runtime_error("Failed to create zstd compression context");
+        }
+        buf_.reserve(WIRE_FLUSH_SIZE + 4096);
+    }
+
+    WireEncoder::~WireEncoder() {
+        clear_schemas();
+        clear_keep_alive();
+        ZSTD_freeCCtx(cctx_);
+    }
+
+    void WireEncoder::put_varint(uint64_t value) {
+        while (value >= 0x80) {
+            buf_.push_back(static_cast<uint8_t>(value) | 0x80);
+            value >>= 7;
+        }
+        buf_.push_back(static_cast<uint8_t>(value));
+    }
+
+    void WireEncoder::put_raw(const void *data, size_t size) {
+        const auto *p = static_cast<const uint8_t *>(data);
+        buf_.insert(buf_.end(), p, p + size);
+    }
+
+    void WireEncoder::put_str(std::string_view s) {
+        put_varint(s.size());
+        put_raw(s.data(), s.size());
+    }
+
+    void WireEncoder::put_bytes(const void *data, size_t size, bool writable) {
+        put_varint(size);
+        put_data(data, size, writable);
+    }
+
+    // Payloads past the flush size go to zstd straight from the object
+    // instead of through buf_. `writable` if Python code can change the
+    // object's bytes (a bytearray, a writable memoryview or array).
+    void WireEncoder::put_data(const void *data, size_t size, bool writable) {
+        if (size < WIRE_FLUSH_SIZE) {
+            put_raw(data, size);
+            return;
+        }
+        compress(false);
+        feed(data, size, false, writable);
+    }
+
+    // Runs without the GIL for batches of ALLOW_THREADS_MIN_SIZE and more;
+    // `data` is either buf_ or the buffer of an object held by the walk. A
+    // `writable` buffer keeps the GIL, so no other thread changes it midway.
+    void WireEncoder::feed(const void *data, size_t size, bool finish, bool writable) {
+        AllowThreads nogil(!writable && size >= ALLOW_THREADS_MIN_SIZE);
+        ZSTD_inBuffer in{data, size, 0};
+        ZSTD_EndDirective mode = finish ? ZSTD_e_end : ZSTD_e_continue;
+        const size_t step = ZSTD_CStreamOutSize();
+        while (true) {
+            size_t used = out_.size();
+            out_.resize(used + step);
+            ZSTD_outBuffer out{out_.data() + used, step, 0};
+            size_t rc = ZSTD_compressStream2(cctx_, &out, &in, mode);
+            out_.resize(used + out.pos);
+            if (ZSTD_isError(rc)) {
+                throw std::runtime_error(std::string("zstd compression failed: ") + ZSTD_getErrorName(rc));
+            }
+            if (finish ? rc == 0 : in.pos == in.size) break;
+        }
+    }
+
+    // Feed the pending records to zstd. With `finish` the frame is closed,
+    // which also writes the content checksum.
+    void WireEncoder::compress(bool finish) {
+        feed(buf_.data(), buf_.size(), finish);
+        buf_.clear();
+    }
+
+    void WireEncoder::run(PyObject *obj, PyObject *buffer_callback) {
+        buffer_callback_.reset(buffer_callback);
+        buf_.clear();
+        out_.clear();
+        memo_.clear();
+        memo_.reserve(IdentityTable::estimate_size(obj));
+        next_memo_ = 0;
+        clear_schemas();
+        plans_.drop_stale();
+        ZSTD_CCtx_reset(cctx_, ZSTD_reset_session_only);
+        ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel, WIRE_COMPRESSION_LEVEL);
+        ZSTD_CCtx_setParameter(cctx_, ZSTD_c_checksumFlag, 1);
+        out_.insert(out_.end(), WIRE_MAGIC, WIRE_MAGIC + sizeof(WIRE_MAGIC));
+        out_.push_back(WIRE_VERSION);
+
+        std::vector<Frame> stack;
+        bool ok = write_object(obj, stack, 0);
+        try {
+            while (ok && !stack.empty()) {
+                PyObject *child = nullptr;
+                Frame &top = stack.back();
+                if (!next_child(top, child)) {
+                    if (PyErr_Occurred()) {
+                        ok = false;
+                        break;
+                    }
+                    release(stack.back());
+                    stack.pop_back();
+                    continue;
+                }
+                // The callable of a reduce tuple is stored by name when possible.
+                bool by_name = top.kind == WireTag::REDUCE && top.index == 1;
+                // Values of a run sit one level below their row.
+                size_t depth = top.depth + (top.kind == WireTag::ROWS && top.stage == 2 ? 2 : 1);
+                ok = write_object(child, stack, depth, by_name);
+                if (buf_.size() >= WIRE_FLUSH_SIZE) {
+                    compress(false);
+                }
+            }
+            if (ok) {
+                compress(true);
+            }
+        } catch (...) {
+            for (auto &frame: stack) {
+                release(frame);
+            }
+            clear_keep_alive();
+            throw;
+        }
+        clear_keep_alive();
+        if (!ok) {
+            for (auto &frame: stack) {
+                release(frame);
+            }
+            throw std::runtime_error("Serialization failed");
+        }
+    }
+
+    std::vector<uint8_t> WireEncoder::encode(PyObject *obj, PyObject *buffer_callback) {
+        run(obj, buffer_callback);
+        return std::move(out_);
+    }
+
+    std::span<const uint8_t> WireEncoder::encode_in_place(PyObject *obj, PyObject *buffer_callback) {
+        run(obj, buffer_callback);
+        return out_;
+    }
+
+    void WireEncoder::trim() {
+        if (out_.capacity() > WIRE_KEEP_BUFFER_SIZE) out_ = {};
+    }
+
+    void WireEncoder::set_dictionary(const ZSTD_CDict *dictionary) {
+        // Sticky: kept by the session resets of later calls.
+        ZSTD_CCtx_refCDict(cctx_, dictionary);
+    }
+
+    void WireEncoder::release(Frame &frame) {
+        Py_CLEAR(frame.held);
+        Py_CLEAR(frame.owned);
+    }
+
+    bool WireEncoder::next_child(Frame &frame, PyObject *&child) {
+        Py_CLEAR(frame.held);
+        switch (frame.kind) {
+            case WireTag::LIST:
+                // User code run during the walk (attribute hooks) can shrink a
+                // list after its count was written; fail instead of emitting a
+                // truncated record.
+                if (frame.remaining == 0) return false;
+                if (frame.index >= PyList_GET_SIZE(frame.obj)) break;
+                child = PyList_GET_ITEM(frame.obj, frame.index++);
+                frame.remaining--;
+                return true;
+            case WireTag::TUPLE:
+                if (frame.remaining == 0) return false;
+                child = PyTuple_GET_ITEM(frame.obj, frame.index++);
+                frame.remaining--;
+                return true;
+            case WireTag::ROWS: {
+                if (PySequence_Fast_GET_SIZE(frame.obj) != frame.count) break;
+                while (true) {
+                    if (frame.stage == 1) {
+                        if (frame.remaining > 0) {
+                            child = PySequence_Fast_ITEMS(frame.obj)[frame.index++];
+                            frame.remaining--;
+                            return true;
+                        }
+                        frame.stage = 0;
+                    } else if (frame.stage == 2) {
+                        if (frame.row < frame.run_rows) {
+                            child = PyTuple_GET_ITEM(frame.owned, frame.column * frame.run_rows + frame.row++);
+                            return true;
+                        }
+                        frame.column++;
+                        frame.stage = 3;
+                    } else if (frame.stage == 3) {
+                        if (frame.column < frame.n_columns) {
+                            PyObject **values = PySequence_Fast_ITEMS(frame.owned) + frame.column * frame.run_rows;
+                            bool generic;
+                            if (!write_column(values, frame.run_rows, generic)) return false;
+                            if (generic) {
+                                frame.row = 0;
+                                frame.stage = 2;
+                            } else {
+                                frame.column++;
+                            }
+                            continue;
+                        }
+                        Py_CLEAR(frame.owned);
+                        frame.index += frame.run_rows;
+                        frame.stage = 0;
+                    } else {
+                        if (frame.index == frame.count) return false;
+                        // Runs are only worth starting where their values stay
+                        // within the depth limit; otherwise the elements are
+                        // written (and rejected) one by one.
+                        bool runs = max_depth_ == 0 || frame.depth + 2 <= max_depth_;
+                        Py_ssize_t rows = runs ? run_length(PySequence_Fast_ITEMS(frame.obj) + frame.index,
+                                                            frame.count - frame.index) : 0;
+                        if (PySequence_Fast_GET_SIZE(frame.obj) != frame.count) break;
+                        if (rows >= ROWS_MIN_RUN) {
+                            if (!start_run(frame, PySequence_Fast_ITEMS(frame.obj) + frame.index, rows)) return false;
+                            frame.stage = 3;
+                            continue;
+                        }
+                        // Plain elements up to the next run.
+                        Py_ssize_t end = frame.index + std::max<Py_ssize_t>(rows, 1);
+                        while (runs && end < frame.count) {
+                            Py_ssize_t r = run_length(PySequence_Fast_ITEMS(frame.obj) + end, frame.count - end);
+                            if (PySequence_Fast_GET_SIZE(frame.obj) != frame.count) break;
+                            if (r >= ROWS_MIN_RUN) break;
+                            end += std::max<Py_ssize_t>(r, 1);
+                        }
+                        if (PySequence_Fast_GET_SIZE(frame.obj) != frame.count) break;
+                        if (!runs) end = frame.count;
+                        frame.remaining = end - frame.index;
+                        put_varint(static_cast<uint64_t>(frame.remaining) << 1);
+                        frame.stage = 1;
+                    }
+                }
+                break;
+            }
+            case WireTag::SET:
+            case WireTag::FROZENSET: {
+                if (frame.remaining == 0) return false;
+#if PY_VERSION_HEX < 0x030D0000
+                Py_hash_t hash;
+                if (!_PySet_NextEntry(frame.obj, &frame.pos, &child, &hash)) break;
+#else
+                if (!frame.owned) {
+                    frame.owned = PyObject_GetIter(frame.obj);
+                    if (!frame.owned) return false;
+                }
+                frame.held = PyIter_Next(frame.owned);
+                if (!frame.held) {
+                    if (PyErr_Occurred()) return false;
+                    break;
+                }
+                child = frame.held;
+#endif
+                frame.remaining--;
+                return true;
+            }
+            case WireTag::DEFAULT_DICT:
+                if (frame.stage == 0) {
+                    frame.stage = 1;
+                    child = frame.owned;
+                    return true;
+                }
+                [[fallthrough]];
+            case WireTag::DICT:
+            case WireTag::ORDERED_DICT:
+            case WireTag::COUNTER: {
+                if (frame.want_value) {
+                    frame.want_value = false;
+                    child = frame.value;
+                    return true;
+                }
+                if (frame.remaining == 0) return false;
+                PyObject *dict = frame.kind == WireTag::ORDERED_DICT ? frame.owned : frame.obj;
+                if (!PyDict_Next(dict, &frame.pos, &child, &frame.value)) break;
+                frame.want_value = true;
+                frame.remaining--;
+                return true;
+            }
+            case WireTag::DEQUE:
+                if (frame.remaining == 0) return false;
+                child = PyList_GET_ITEM(frame.owned, frame.index++);
+                frame.remaining--;
+                return true;
+            case WireTag::ENUM:
+                if (frame.index == 2) return false;
+                child = frame.index++ == 0 ? reinterpret_cast<PyObject *>(Py_TYPE(frame.obj)) : frame.owned;
+                return true;
+            case WireTag::FUNCTION: {
+                if (frame.stage == 0) {
+                    frame.stage = 1;
+                    PyObject *defaults = PyFunction_GetDefaults(frame.obj);
+                    child = defaults ? defaults : Py_None;
+                    return true;
+                }
+                if (frame.stage == 1) {
+                    frame.stage = 2;
+                    PyObject *kwdefaults = PyFunction_GetKwDefaults(frame.obj);
+                    child = kwdefaults ? kwdefaults : Py_None;
+                    return true;
+                }
+                Py_ssize_t n_cells = frame.owned ? PyTuple_GET_SIZE(frame.owned) : 0;
+                if (frame.stage == 2) {
+                    frame.stage = 3;
+                    put_varint(n_cells);
+                }
+                while (frame.index < n_cells) {
+                    // One flag byte per cell; empty cells have nothing to follow.
+                    frame.held = PyCell_Get(PyTuple_GET_ITEM(frame.owned, frame.index++));
+                    put_u8(frame.held ? 1 : 0);
+                    if (frame.held) {
+                        child = frame.held;
+                        return true;
+                    }
+                }
+                return false;
+            }
+            case WireTag::CUSTOM: {
+                // Values only, in schema order; the names went out with the schema.
+                if (frame.remaining == 0) return false;
+                const std::vector<SlotMember> &slots = frame.plan->slots;
+                while (frame.index < static_cast<Py_ssize_t>(slots.size())) {
+                    child = TypePlanCache::slot_value(frame.obj, slots[frame.index++]);
+                    if (child) {
+                        frame.remaining--;
+                        return true;
+                    }
+                }
+                PyObject *key;
+                while (frame.owned && PyDict_Next(frame.owned, &frame.pos, &key, &child)) {
+                    if (!PyUnicode_Check(key)) continue;
+                    frame.remaining--;
+                    return true;
+                }
+                break;
+            }
+            case WireTag::REDUCE: {
+                // Always six records; missing trailing items are written as None.
+                if (frame.index == 6) return false;
+                Py_ssize_t i = frame.index++;
+                child = i < PyTuple_GET_SIZE(frame.owned) ? PyTuple_GET_ITEM(frame.owned, i) : Py_None;
+                if (i == 1 && !PyTuple_Check(child)) {
+                    PyErr_SetString(PyExc_TypeError, "__reduce_ex__ arguments must be a tuple");
+                    return false;
+                }
+                if ((i == 3 || i == 4) && child != Py_None) {
+                    // listitems / dictitems are iterators; store them as a list
+                    // (of key/value pairs for dictitems).
+                    child = PySequence_List(child);
+                    if (!child) return false;
+                    keep_alive_.push_back(child);
+                }
+                return true;
+            }
+            default:
+                return false;
+        }
+        PyErr_SetString(PyExc_RuntimeError, "container changed size during serialization");
+        return false;
+    }
+
+    bool WireEncoder::write_function(PyObject *obj, Frame &frame) {
+        put_tag(WireTag::FUNCTION);
+        PyObject *name = PyObject_GetAttrString(obj, "__name__");
+        const char *name_str = name ? PyUnicode_AsUTF8(name) : nullptr;
+        put_str(name_str ? name_str : "");
+        Py_XDECREF(name);
+        PyErr_Clear();
+        // Each distinct code object is written once per payload (see
+        // code_codec.h); defaults, kwdefaults and closure cells follow as
+        // ordinary records.
+        uint32_t code_index;
+        bool added;
+        if (!codes_.add(PyFunction_GetCode(obj), code_index, added)) return false;
+        if (added) {
+            put_varint(0);
+            put_str(codes_.blob(code_index));
+        } else {
+            put_varint(code_index + 1);
+        }
+        PyObject *closure = PyFunction_GetClosure(obj);
+        if (closure && PyTuple_Check(closure)) {
+            Py_INCREF(closure);
+            frame.owned = closure;
+        }
+        return !PyErr_Occurred();
+    }
+
+    // Instance __dict__ as a new reference, or nullptr if the object has none.
+    // Plain instances take the generic slot directly instead of two attribute
+    // lookups through the MRO.
+    static PyObject *instance_dict(PyObject *obj) {
+        PyTypeObject *type = Py_TYPE(obj);
+        bool has_dict_slot = type->tp_dictoffset != 0;
+#ifdef Py_TPFLAGS_MANAGED_DICT
+        has_dict_slot = has_dict_slot || PyType_HasFeature(type, Py_TPFLAGS_MANAGED_DICT);
+#endif
+        PyObject *dict = nullptr;
+        if (!PyType_Check(obj) && type->tp_getattro == PyObject_GenericGetAttr) {
+            if (has_dict_slot) dict = PyObject_GenericGetDict(obj, nullptr);
+        } else if (PyObject_HasAttrString(obj, "__dict__")) {
+            dict = PyObject_GetAttrString(obj, "__dict__");
+        }
+        if (!dict || !PyDict_Check(dict)) {
+            Py_XDECREF(dict);
+            PyErr_Clear();
+            return nullptr;
+        }
+        return dict;
+    }
+
+    // True if the set slots of `obj` followed by the str keys of `dict`, in
+    // iteration order, are exactly the names of `schema`.
+    static bool schema_matches(const WireSchema &schema, const TypePlan &plan, PyObject *obj, PyObject *dict) {
+        const std::vector<PyObject *> &names = schema.names;
+        size_t i = 0;
+        for (const SlotMember &slot: plan.slots) {
+            if (!TypePlanCache::slot_value(obj, slot)) continue;
+            if (i == schema.n_slots || names[i] != slot.name) return false;
+            i++;
+        }
+        if (i != schema.n_slots) return false;
+        if (!dict) return i == names.size();
+        PyObject *key, *value;
+        Py_ssize_t pos = 0;
+        while (PyDict_Next(dict, &pos, &key, &value)) {
+            if (!PyUnicode_Check(key)) continue;
+            if (i == names.size()) return false;
+            PyObject *name = names[i++];
+            // Instances of one class usually share their key objects.
+            if (name != key && PyUnicode_Compare(name, key) != 0) return false;
+        }
+        return i == names.size();
+    }
+
+    void WireEncoder::clear_keep_alive() {
+        for (PyObject *obj: keep_alive_) Py_DECREF(obj);
+        keep_alive_.clear();
+    }
+
+    // Per-payload state; type plans are kept from call to call.
+    void WireEncoder::clear_schemas() {
+        codes_.clear();
+        for (auto &[type, schemas]: schemas_) {
+            for (auto &schema: schemas) {
+                for (PyObject *name: schema.names) Py_DECREF(name);
+            }
+        }
+        schemas_.clear();
+        next_schema_ = 0;
+    }
+
+    bool WireEncoder::write_custom(PyObject *obj, Frame &frame) {
+        PyTypeObject *type = Py_TYPE(obj);
+        const TypePlan &plan = plans_.get(type);
+        if (plan.reduce) {
+            frame.kind = WireTag::REDUCE;
+            return write_reduce(obj, frame);
+        }
+        PyObject *dict = instance_dict(obj);
+        put_tag(WireTag::CUSTOM);
+        const WireSchema *schema = write_schema(obj, plan, dict);
+        if (!schema) {
+            Py_XDECREF(dict);
+            return false;
+        }
+        frame.owned = dict;
+        frame.plan = &plan;
+        frame.remaining = static_cast<Py_ssize_t>(schema->names.size());
+        return true;
+    }
+
+    // Write the schema of `obj` (its id, or 0 and a definition if new) and
+    // return it; nullptr with a Python error set on failure.
+    const WireSchema *WireEncoder::write_schema(PyObject *obj, const TypePlan &plan, PyObject *dict) {
+        PyTypeObject *type = Py_TYPE(obj);
+        // Instances of a class normally share one attribute layout; look for it
+        // among the most recent layouts of this type before defining a new one.
+        std::vector<WireSchema> &schemas = schemas_[type];
+        size_t first = schemas.size() > WIRE_SCHEMA_SEARCH ? schemas.size() - WIRE_SCHEMA_SEARCH : 0;
+        for (size_t i = schemas.size(); i-- > first;) {
+            if (schema_matches(schemas[i], plan, obj, dict)) {
+                put_varint(schemas[i].id);
+                return &schemas[i];
+            }
+        }
+        WireSchema fresh;
+        fresh.id = ++next_schema_;
+        for (const SlotMember &slot: plan.slots) {
+            if (!TypePlanCache::slot_value(obj, slot)) continue;
+            Py_INCREF(slot.name);
+            fresh.names.push_back(slot.name);
+        }
+        fresh.n_slots = fresh.names.size();
+        if (dict) {
+            PyObject *key, *value;
+            Py_ssize_t pos = 0;
+            while (PyDict_Next(dict, &pos, &key, &value)) {
+                if (!PyUnicode_Check(key)) continue;
+                Py_INCREF(key);
+                fresh.names.push_back(key);
+            }
+        }
+        schemas.push_back(std::move(fresh));
+        const WireSchema *schema = &schemas.back();
+        PyObject *module = PyObject_GetAttrString(reinterpret_cast<PyObject *>(type), "__module__");
+        const char *module_str = module && PyUnicode_Check(module) ? PyUnicode_AsUTF8(module) : nullptr;
+        PyErr_Clear();
+        put_varint(0);
+        put_str(module_str ? module_str : "");
+        put_str(type->tp_name);
+        Py_XDECREF(module);
+        put_varint(schema->n_slots);
+        put_varint(schema->names.size());
+        for (PyObject *name: schema->names) {
+            Py_ssize_t size;
+            const char *name_str = PyUnicode_AsUTF8AndSize(name, &size);
+            if (!name_str) return nullptr;
+            put_str({name_str, static_cast<size_t>(size)});
+        }
+        return schema;
+    }
+
+    // Classes that customise their pickled state go through __reduce_ex__(4),
+    // as pickle would call it. A string result names a module-level singleton
+    // and becomes a GLOBAL record (frame.kind is set to GLOBAL: nothing
+    // follows); a tuple becomes a REDUCE record whose items follow.
+    bool WireEncoder::write_reduce(PyObject *obj, Frame &frame) {
+        PyObject *rv = PyObject_CallMethod(obj, "__reduce_ex__", "i", 4);
+        if (!rv) return false;
+        if (PyUnicode_Check(rv)) {
+            PyObject *module = PyObject_GetAttrString(obj, "__module__");
+            const char *module_str = module && PyUnicode_Check(module) ? PyUnicode_AsUTF8(module) : nullptr;
+            const char *name_str = module_str ? PyUnicode_AsUTF8(rv) : nullptr;
+            if (name_str) {
+                put_tag(WireTag::GLOBAL);
+                put_str(module_str);
+                put_str(name_str);
+            } else if (!PyErr_Occurred()) {
+                PyErr_Format(PyExc_TypeError, "Cannot serialize '%s' object: no __module__ for global '%U'",
+                             Py_TYPE(obj)->tp_name, rv);
+            }
+            Py_XDECREF(module);
+            Py_DECREF(rv);
+            frame.kind = WireTag::GLOBAL;
+            return name_str != nullptr;
+        }
+        if (!PyTuple_Check(rv) || PyTuple_GET_SIZE(rv) < 2 || PyTuple_GET_SIZE(rv) > 6) {
+            PyErr_Format(PyExc_TypeError, "%s.__reduce_ex__ must return a string or a tuple of 2 to 6 items",
+                         Py_TYPE(obj)->tp_name);
+            Py_DECREF(rv);
+            return false;
+        }
+        put_tag(WireTag::REDUCE);
+        keep_alive_.push_back(rv);
+        frame.owned = rv;
+        Py_INCREF(rv);
+        return true;
+    }
+
+    // Write `obj` as a GLOBAL record if importing its __module__ and following
+    // its __qualname__ gives back the same object. `found` is false (and no
+    // error is set) when it cannot be found that way.
+    bool WireEncoder::write_global(PyObject *obj, bool &found) {
+        found = false;
+        PyObject *module = PyObject_GetAttrString(obj, "__module__");
+        PyObject *qualname = module ? PyObject_GetAttrString(obj, "__qualname__") : nullptr;
+        PyErr_Clear();
+        if (module && qualname && PyUnicode_Check(module) && PyUnicode_Check(qualname)) {
+            Py_ssize_t module_size, qualname_size;
+            const char *module_str = PyUnicode_AsUTF8AndSize(module, &module_size);
+            const char *qualname_str = PyUnicode_AsUTF8AndSize(qualname, &qualname_size);
+            PyObject *imported = module_str && qualname_str ? PyImport_Import(module) : nullptr;
+            PyObject *target = imported
+                                   ? get_dotted(imported, {qualname_str, static_cast<size_t>(qualname_size)})
+                                   : nullptr;
+            PyErr_Clear();
+            found = target == obj;
+            if (found) {
+                put_tag(WireTag::GLOBAL);
+                put_str({module_str, static_cast<size_t>(module_size)});
+                put_str({qualname_str, static_cast<size_t>(qualname_size)});
+            }
+            Py_XDECREF(target);
+            Py_XDECREF(imported);
+        }
+        Py_XDECREF(module);
+        Py_XDECREF(qualname);
+        return true;
+    }
+
+    // Write a list or tuple of plain ints, floats or strings as one PACKED
+    // record. `packed` is false when `obj` does not qualify, leaving the
+    // buffer as it was.
+    bool WireEncoder::write_packed(PyObject *obj, bool &packed) {
+        Py_ssize_t n = PySequence_Fast_GET_SIZE(obj);
+        PyObject **items = PySequence_Fast_ITEMS(obj);
+        PackedKind kind = packed_kind(items, n);
+        packed = kind != PackedKind::NONE;
+        if (!packed) return true;
+        size_t start = buf_.size();
+        put_tag(WireTag::PACKED);
+        put_u8(PyTuple_Check(obj) ? 1 : 0);
+        put_u8(static_cast<uint8_t>(kind));
+        put_varint(n);
+        if (!write_packed_values(kind, items, n, packed)) return false;
+        if (!packed) buf_.resize(start);
+        return true;
+    }
+
+    // Payload of a packed array of `kind`. `packed` is false (and the caller
+    // drops what was written) if an int does not fit int64.
+    bool WireEncoder::write_packed_values(PackedKind kind, PyObject *const *items, Py_ssize_t n, bool &packed) {
+        packed = true;
+        if (kind == PackedKind::STR_UNITS) {
+            // Strings already in the memo become back-references; the others
+            // take memo ids in order and their code units follow the table.
+            str_units_.resize(n);
+            size_t text_size = 0;
+            for (Py_ssize_t i = 0; i < n; i++) {
+                auto [memo_id, inserted] = memo_.try_emplace(items[i], next_memo_);
+                if (!inserted) {
+                    put_varint(static_cast<uint64_t>(memo_id) << 1 | 1);
+                    str_units_[i] = {};
+                    continue;
+                }
+                next_memo_++;
+                if (!str_units(items[i], str_units_[i])) return false;
+                put_varint(str_units_[i].header() << 1);
+                text_size += str_units_[i].size();
+            }
+            put_varint(text_size);
+            buf_.reserve(buf_.size() + text_size);
+            for (const StrUnits &units: str_units_) append_str_units(buf_, units);
+            return true;
+        }
+        if (kind == PackedKind::INT_FOR) {
+            packed = pack_ints(items, n, buf_);
+        } else {
+            pack_floats(items, n, buf_);
+        }
+        return true;
+    }
+
+    // True if `obj` would be written as a CUSTOM record: an instance of a
+    // Python class that derives from no built-in kind write_object() handles
+    // itself and does not go through the reduce protocol.
+    static bool is_plain_instance(PyObject *obj, TypePlanCache &plans) {
+        PyTypeObject *type = Py_TYPE(obj);
+        return type_dispatch(type).kind == TypeKind::CUSTOM && PyType_HasFeature(type, Py_TPFLAGS_HEAPTYPE) &&
+               !plans.get(type).reduce;
+    }
+
+    // True if dict `b` has exactly the keys of `a`, in the same order.
+    static bool same_keys(PyObject *a, PyObject *b) {
+        if (PyDict_GET_SIZE(a) != PyDict_GET_SIZE(b)) return false;
+        Py_ssize_t pos_a = 0, pos_b = 0;
+        PyObject *key_a, *key_b, *value;
+        while (PyDict_Next(a, &pos_a, &key_a, &value)) {
+            if (!PyDict_Next(b, &pos_b, &key_b, &value)) return false;
+            // Records built by one piece of code usually share their key objects.
+            if (key_a != key_b && (!PyUnicode_CheckExact(key_b) || PyUnicode_Compare(key_a, key_b) != 0)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // True if instances `a` and `b` of one class would get the same schema:
+    // the same slots set and the same str keys in their __dict__s.
+    static bool same_layout(const TypePlan &plan, PyObject *a, PyObject *dict_a, PyObject *b, PyObject *dict_b) {
+        for (const SlotMember &slot: plan.slots) {
+            if (!TypePlanCache::slot_value(a, slot) != !TypePlanCache::slot_value(b, slot)) return false;
+        }
+        if (!dict_a || !dict_b) return !dict_a == !dict_b;
+        Py_ssize_t pos_a = 0, pos_b = 0;
+        PyObject *key_a, *key_b, *value;
+        while (true) {
+            bool more_a, more_b;
+            while ((more_a = PyDict_Next(dict_a, &pos_a, &key_a, &value)) && !PyUnicode_Check(key_a)) {}
+            while ((more_b = PyDict_Next(dict_b, &pos_b, &key_b, &value)) && !PyUnicode_Check(key_b)) {}
+            if (!more_a || !more_b) return more_a == more_b;
+            if (key_a != key_b && PyUnicode_Compare(key_a, key_b) != 0) return false;
+        }
+    }
+
+    // Number of elements from items[0] on (at most ROWS_MAX_RUN) that can be
+    // written as one run: plain dicts with the same str keys, or plain
+    // instances of one class with the same layout, none of them written
+    // before. 0 if items[0] cannot start a run.
+    Py_ssize_t WireEncoder::run_length(PyObject *const *items, Py_ssize_t n) {
+        Py_ssize_t limit = std::min(n, ROWS_MAX_RUN);
+        PyObject *first = items[0];
+        if (memo_.contains(first)) return 0;
+        Py_ssize_t rows = 1;
+        if (PyDict_CheckExact(first)) {
+            PyObject *key, *value;
+            Py_ssize_t pos = 0;
+            while (PyDict_Next(first, &pos, &key, &value)) {
+                if (!PyUnicode_CheckExact(key)) return 0;
+            }
+            while (rows < limit && PyDict_CheckExact(items[rows]) && !memo_.contains(items[rows]) &&
+                   same_keys(first, items[rows])) {
+                rows++;
+            }
+            return rows;
+        }
+        // Only classes with the default attribute lookup: their layout cannot
+        // change between this check and start_run().
+        PyTypeObject *type = Py_TYPE(first);
+        if (type->tp_getattro != PyObject_GenericGetAttr || !is_plain_instance(first, plans_)) return 0;
+        const TypePlan &plan = plans_.get(type);
+        PyObject *first_dict = instance_dict(first);
+        while (rows < limit && Py_TYPE(items[rows]) == type && !memo_.contains(items[rows])) {
+            PyObject *dict = instance_dict(items[rows]);
+            bool same = same_layout(plan, first, first_dict, items[rows], dict);
+            Py_XDECREF(dict);
+            if (!same) break;
+            rows++;
+        }
+        Py_XDECREF(first_dict);
+        return rows;
+    }
+
+    // Write the header of a run over items[0, rows) and collect its values
+    // column by column into frame.owned. The rows take memo ids in order; the
+    // run ends early at a row that repeats an earlier one.
+    bool WireEncoder::start_run(Frame &frame, PyObject *const *items, Py_ssize_t rows) {
+        Py_ssize_t taken = 0;
+        while (taken < rows && memo_.try_emplace(items[taken], next_memo_).second) {
+            next_memo_++;
+            taken++;
+        }
+        rows = taken;
+        put_varint(static_cast<uint64_t>(rows) << 1 | 1);
+        PyObject *first = items[0];
+        PyObject *values = nullptr;
+        Py_ssize_t n_columns;
+        if (PyDict_CheckExact(first)) {
+            put_u8(0);
+            n_columns = PyDict_GET_SIZE(first);
+            put_varint(n_columns);
+            PyObject *key, *value;
+            Py_ssize_t pos = 0;
+            while (PyDict_Next(first, &pos, &key, &value)) {
+                Py_ssize_t size;
+                const char *key_str = PyUnicode_AsUTF8AndSize(key, &size);
+                if (!key_str) return false;
+                put_str({key_str, static_cast<size_t>(size)});
+            }
+            values = PyTuple_New(n_columns * rows);
+            if (!values) return false;
+            for (Py_ssize_t r = 0; r < rows; r++) {
+                pos = 0;
+                for (Py_ssize_t c = 0; PyDict_Next(items[r], &pos, &key, &value); c++) {
+                    Py_INCREF(value);
+                    PyTuple_SET_ITEM(values, c * rows + r, value);
+                }
+            }
+        } else {
+            put_u8(1);
+            const TypePlan &plan = plans_.get(Py_TYPE(first));
+            PyObject *first_dict = instance_dict(first);
+            const WireSchema *schema = write_schema(first, plan, first_dict);
+            Py_XDECREF(first_dict);
+            if (!schema) return false;
+            n_columns = static_cast<Py_ssize_t>(schema->names.size());
+            values = PyTuple_New(n_columns * rows);
+            if (!values) return false;
+            for (Py_ssize_t r = 0; r < rows; r++) {
+                Py_ssize_t c = 0;
+                for (const SlotMember &slot: plan.slots) {
+                    PyObject *value = TypePlanCache::slot_value(items[r], slot);
+                    if (!value) continue;
+                    Py_INCREF(value);
+                    PyTuple_SET_ITEM(values, c++ * rows + r, value);
+                }
+                PyObject *dict = instance_dict(items[r]);
+                PyObject *key, *value;
+                Py_ssize_t pos = 0;
+                while (dict && PyDict_Next(dict, &pos, &key, &value)) {
+                    if (!PyUnicode_Check(key)) continue;
+                    Py_INCREF(value);
+                    PyTuple_SET_ITEM(values, c++ * rows + r, value);
+                }
+                Py_XDECREF(dict);
+            }
+        }
+        frame.owned = values;
+        frame.run_rows = rows;
+        frame.n_columns = n_columns;
+        frame.column = 0;
+        return true;
+    }
+
+    // One column of a run: packed when its values allow, otherwise a NONE
+    // kind byte after which the caller writes one record per row.
+    bool WireEncoder::write_column(PyObject *const *values, Py_ssize_t n, bool &generic) {
+        PackedKind kind = packed_kind(values, n);
+        generic = kind == PackedKind::NONE;
+        if (!generic) {
+            size_t start = buf_.size();
+            put_u8(static_cast<uint8_t>(kind));
+            bool packed;
+            if (!write_packed_values(kind, values, n, packed)) return false;
+            if (packed) return true;
+            buf_.resize(start);
+            generic = true;
+        }
+        put_u8(static_cast<uint8_t>(PackedKind::NONE));
+        return true;
+    }
+
+    // Write the header of a standard library value or container (see
+    // std_types.h) and set up `frame` for its element records. `written` is
+    // false, with nothing written, for values that do not fit their native
+    // layout; those take the generic path.
+    bool WireEncoder::write_std(PyObject *obj, StdKind kind, Frame &frame, bool &written) {
+        written = false;
+        if (is_std_value(kind)) {
+            std_value_.clear();
+            if (!pack_std_value(kind, obj, std_value_, written)) return false;
+            if (!written) return true;
+            put_tag(std_tag(kind));
+            put_varint(std_value_.size());
+            put_raw(std_value_.data(), std_value_.size());
+            return true;
+        }
+        frame.kind = std_tag(kind);
+        switch (kind) {
+            case StdKind::ENUM:
+                // The class goes by name and the member is looked up by value
+                // on load, as pickle does.
+                frame.owned = PyObject_GetAttrString(obj, "_value_");
+                if (!frame.owned) return false;
+                put_tag(frame.kind);
+                break;
+            case StdKind::DEQUE: {
+                PyObject *maxlen = PyObject_GetAttrString(obj, "maxlen");
+                if (!maxlen) return false;
+                Py_ssize_t bound = maxlen == Py_None ? -1 : PyLong_AsSsize_t(maxlen);
+                Py_DECREF(maxlen);
+                if (bound == -1 && PyErr_Occurred()) return false;
+                frame.owned = PySequence_List(obj);
+                if (!frame.owned) return false;
+                frame.remaining = PyList_GET_SIZE(frame.owned);
+                put_tag(frame.kind);
+                put_varint(static_cast<uint64_t>(bound + 1));
+                put_varint(frame.remaining);
+                break;
+            }
+            case StdKind::ORDERED_DICT:
+                // The items in OrderedDict order (move_to_end() does not change
+                // the order of the underlying dict).
+                frame.owned = PyObject_CallOneArg(reinterpret_cast<PyObject *>(&PyDict_Type), obj);
+                if (!frame.owned) return false;
+                frame.remaining = PyDict_GET_SIZE(frame.owned);
+                put_tag(frame.kind);
+                put_varint(frame.remaining);
+                break;
+            case StdKind::DEFAULT_DICT:
+                frame.owned = PyObject_GetAttrString(obj, "default_factory");
+                if (!frame.owned) return false;
+                [[fallthrough]];
+            default:
+                frame.remaining = PyDict_GET_SIZE(obj);
+                put_tag(frame.kind);
+                put_varint(frame.remaining);
+                break;
+        }
+        written = true;
+        return true;
+    }
+
+    // Bytes-like object: offered to the buffer callback, then written as a
+    // `tag` record unless it went out of band. The export is held across the
+    // callback so the data cannot move under it.
+    bool WireEncoder::write_buffer(PyObject *obj, WireTag tag) {
+        Py_buffer view;
+        if (PyObject_GetBuffer(obj, &view, PyBUF_CONTIG_RO) != 0) {
+            PyErr_SetString(PyExc_TypeError, "Failed to get buffer from object");
+            return false;
+        }
+        auto size = static_cast<size_t>(view.len);
+        bool out_of_band;
+        uint64_t index;
+        bool ok = buffer_callback_.offer(obj, size, out_of_band, index);
+        try {
+            if (ok && out_of_band) {
+                put_tag(WireTag::OUT_OF_BAND);
+                put_u8(static_cast<uint8_t>(buffer_kind(obj)));
+                put_varint(index);
+                put_varint(size);
+            } else if (ok) {
+                put_tag(tag);
+                put_bytes(view.buf, size, !view.readonly);
+            }
+        } catch (...) {
+            PyBuffer_Release(&view);
+            throw;
+        }
+        PyBuffer_Release(&view);
+        return ok;
+    }
+
+    // numpy array with a native dtype (ndarray.h); `written` is false for the
+    // others, which take the generic path.
+    bool WireEncoder::write_ndarray(PyObject *obj, bool &written) {
+        ArrayData array;
+        bool native;
+        if (!ndarray_data(obj, array, native)) return false;
+        if (!native) return true;
+        bool out_of_band;
+        uint64_t index;
+        if (!buffer_callback_.offer(array.owner, array.header.size, out_of_band, index)) return false;
+        std::vector<uint8_t> header;
+        append_ndarray_header(header, array.header);
+        put_tag(WireTag::NDARRAY);
+        put_varint(header.size());
+        put_raw(header.data(), header.size());
+        put_u8(out_of_band ? 1 : 0);
+        if (out_of_band) {
+            put_varint(index);
+        } else {
+            put_data(array.data, array.header.size, array.writable);
+        }
+        written = true;
+        return true;
+    }
+
+    bool WireEncoder::write_object(PyObject *obj, std::vector<Frame> &stack, size_t depth, bool by_name) {
+        if (max_depth_ != 0 && depth > max_depth_) {
+            PyErr_SetString(PyExc_ValueError, "Object nesting too deep");
+            return false;
+        }
+        if (IdentityTable::needs_identity(obj)) {
+            auto [memo_id, inserted] = memo_.try_emplace(obj, next_memo_);
+            if (!inserted) {
+                put_tag(WireTag::REF);
+                put_varint(memo_id);
+                return true;
+            }
+            next_memo_++;
+        }
+        TypeDispatch dispatch = type_dispatch(obj);
+        if (dispatch.kind == TypeKind::GLOBAL || (by_name && dispatch.kind == TypeKind::FUNCTION)) {
+            // Classes, built-in functions and reduce callables are stored by
+            // reference, like pickle does. Bound built-in methods that are not
+            // importable fall through to their own __reduce_ex__.
+            bool found;
+            if (!write_global(obj, found)) return false;
+            if (found) return true;
+            if (PyType_Check(obj)) {
+                PyErr_Format(PyExc_TypeError, "Cannot serialize class '%s': it is not importable by name",
+                             reinterpret_cast<PyTypeObject *>(obj)->tp_name);
+                return false;
+            }
+        }
+        if (dispatch.kind == TypeKind::NDARRAY) {
+            bool written = false;
+            if (!write_ndarray(obj, written)) return false;
+            if (written) return true;
+            dispatch.kind = TypeKind::CUSTOM;
+        }
+        Frame frame;
+        switch (dispatch.kind) {
+            case TypeKind::NONE:
+                put_tag(WireTag::NONE);
+                return true;
+            case TypeKind::BOOL:
+                put_tag(obj == Py_True ? WireTag::TRUE_ : WireTag::FALSE_);
+                return true;
+            case TypeKind::INT: {
+                int overflow;
+                long long value = PyLong_AsLongLongAndOverflow(obj, &overflow);
+                if (overflow == 0) {
+                    if (value == -1 && PyErr_Occurred()) return false;
+                    put_tag(WireTag::INT);
+                    put_varint(zigzag(value));
+                    return true;
+                }
+                // One extra bit for the sign of the two's complement encoding.
+                size_t n_bytes = _PyLong_NumBits(obj) / 8 + 1;
+                std::vector<uint8_t> raw(n_bytes);
+                auto *long_obj = reinterpret_cast<PyLongObject *>(obj);
+#if PY_VERSION_HEX >= 0x030D0000
+                if (_PyLong_AsByteArray(long_obj, raw.data(), n_bytes, 1, 1, 1) < 0) return false;
+#else
+                if (_PyLong_AsByteArray(long_obj, raw.data(), n_bytes, 1, 1) < 0) return false;
+#endif
+                put_tag(WireTag::BIGINT);
+                put_varint(n_bytes);
+                put_raw(raw.data(), n_bytes);
+                return true;
+            }
+            case TypeKind::FLOAT: {
+                double value = PyFloat_AS_DOUBLE(obj);
+                uint64_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                uint8_t le[8];
+                for (int i = 0; i < 8; i++) le[i] = static_cast<uint8_t>(bits >> (8 * i));
+                put_tag(WireTag::FLOAT);
+                put_raw(le, sizeof(le));
+                return true;
+            }
+            case TypeKind::STR: {
+                StrUnits units;
+                if (!str_units(obj, units)) return false;
+                if (units.width == StrWidth::ASCII) {
+                    put_tag(WireTag::STRING);
+                    put_str({static_cast<const char *>(units.data), units.length});
+                    return true;
+                }
+                put_tag(WireTag::STR_UNITS);
+                put_varint(units.header());
+                append_str_units(buf_, units);
+                return true;
+            }
+            case TypeKind::BYTES:
+            case TypeKind::BUFFER:
+                // Other buffer exporters come back as bytes, as in the graph format.
+                return write_buffer(obj, WireTag::BYTES);
+            case TypeKind::BYTEARRAY:
+                return write_buffer(obj, WireTag::BYTEARRAY);
+            case TypeKind::LIST:
+            case TypeKind::TUPLE: {
+                bool packed;
+                if (!write_packed(obj, packed)) return false;
+                if (packed) return true;
+                frame.kind = dispatch.kind == TypeKind::LIST ? WireTag::LIST : WireTag::TUPLE;
+                frame.remaining = PySequence_Fast_GET_SIZE(obj);
+                if (frame.remaining >= ROWS_MIN_RUN) {
+                    put_tag(WireTag::ROWS);
+                    put_u8(dispatch.kind == TypeKind::TUPLE ? 1 : 0);
+                    put_varint(frame.remaining);
+                    frame.kind = WireTag::ROWS;
+                    frame.count = frame.remaining;
+                    frame.obj = obj;
+                    frame.depth = depth;
+                    stack.push_back(frame);
+                    return true;
+                }
+                break;
+            }
+            case TypeKind::DICT: {
+                frame.kind = WireTag::DICT;
+                frame.remaining = PyDict_GET_SIZE(obj);
+                bool written;
+                if (dispatch.std != StdKind::NONE && !write_std(obj, dispatch.std, frame, written)) {
+                    release(frame);
+                    return false;
+                }
+                break;
+            }
+            case TypeKind::SET:
+                frame.kind = WireTag::SET;
+                frame.remaining = PySet_GET_SIZE(obj);
+                break;
+            case TypeKind::FROZENSET:
+                frame.kind = WireTag::FROZENSET;
+                frame.remaining = PySet_GET_SIZE(obj);
+                break;
+            case TypeKind::FUNCTION:
+                frame.kind = WireTag::FUNCTION;
+                if (!write_function(obj, frame)) {
+                    release(frame);
+                    return false;
+                }
+                break;
+            case TypeKind::MODULE: {
+                const char *name = PyModule_GetName(obj);
+                if (!name) return false;
+                put_tag(WireTag::MODULE);
+                put_str(name);
+                return true;
+            }
+            case TypeKind::FILE:
+                PyErr_SetString(PyExc_TypeError,
+                                "Cannot serialize file objects. Extract file descriptor manually.");
+                return false;
+            case TypeKind::STD: {
+                bool written = false;
+                if (!write_std(obj, dispatch.std, frame, written)) {
+                    release(frame);
+                    return false;
+                }
+                if (written) {
+                    if (is_std_value(dispatch.std)) return true;
+                    break;
+                }
+                // A value that does not fit its native layout takes the
+                // generic path below.
+                [[fallthrough]];
+            }
+            case TypeKind::GLOBAL:
+            case TypeKind::NDARRAY:
+            case TypeKind::CUSTOM:
+                frame.kind = WireTag::CUSTOM;
+                if (!write_custom(obj, frame)) {
+                    release(frame);
+                    return false;
+                }
+                if (frame.kind == WireTag::GLOBAL) return true;
+                break;
+        }
+        if (frame.kind >= WireTag::LIST && frame.kind <= WireTag::FROZENSET) {
+            put_tag(frame.kind);
+            put_varint(frame.remaining);
+            // Empty containers are complete once their header is written.
+            if (frame.remaining == 0) return true;
+        }
+        frame.obj = obj;
+        frame.depth = depth;
+        stack.push_back(frame);
+        return true;
+    }
+} // namespace pyser
@@ -0,0 +1,350 @@
+// pyser_wire.hpp
+// Compact binary "wire" format written straight from the Python object walk.
+//
+// Layout: "PYSW" magic, one version byte, then a single zstd frame (with
+// content checksum) holding one record for the root object. A record is a tag
+// byte followed by its payload; containers carry a varint element count and
+// their element records follow inline (pre-order), so no node table, pointer
+// list or JSON tree is ever built.
+//
+// Every non-atom object gets the next memo id when its record is written (see
+// IdentityTable::needs_identity for what counts as an atom). A later
+// occurrence of the same object is written as REF <memo id>, which preserves
+// shared references and cycles.
+
+#pragma once
+#include <Python.h>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "pyser.hpp"
+#include "identity_table.h"
+#include "type_plan.h"
+#include "code_codec.h"
+#include "packed_array.h"
+#include "str_units.h"
+#include "out_of_band.h"
+#include "ndarray.h"
+#include "allow_threads.h"
+#include "std_types.h"
+#include "type_dispatch.h"
+
+namespace pyser {
+    constexpr char WIRE_MAGIC[4] = {'P', 'Y', 'S', 'W'};
+    constexpr uint8_t WIRE_VERSION = 1;
+    constexpr size_t WIRE_HEADER_SIZE = sizeof(WIRE_MAGIC) + 1;
+    // Encoded bytes are handed to the compressor in batches of this size.
+    constexpr size_t WIRE_FLUSH_SIZE = 128 * 1024;
+    constexpr int WIRE_COMPRESSION_LEVEL = 3;
+    // Output storage an encoder keeps between calls (WireEncoder::trim).
+    constexpr size_t WIRE_KEEP_BUFFER_SIZE = 1024 * 1024;
+
+    enum class WireTag : uint8_t {
+        NONE = 0x00,
+        TRUE_ = 0x01,
+        FALSE_ = 0x02,
+        INT = 0x03,         // int64 as zigzag varint
+        BIGINT = 0x04,      // varint byte count, signed little-endian bytes
+        FLOAT = 0x05,       // IEEE 754 double, little endian
+        STRING = 0x06,      // varint length, UTF-8
+        BYTES = 0x07,       // varint length, raw bytes
+        BYTEARRAY = 0x08,   // varint length, raw bytes
+        STR_UNITS = 0x09,   // non-ASCII str: varint header, code units (str_units.h)
+        OUT_OF_BAND = 0x0A, // u8 BufferKind, varint buffer index, varint size (out_of_band.h)
+        NDARRAY = 0x0B,     // varint header size, array header (ndarray.h), then u8 0 and the
+                            // data, or u8 1 and the varint index of an out-of-band buffer
+        LIST = 0x10,        // varint count, records
+        TUPLE = 0x11,       // varint count, records
+        DICT = 0x12,        // varint count, key/value record pairs
+        SET = 0x13,         // varint count, records
+        FROZENSET = 0x14,   // varint count, records
+        PACKED = 0x15,      // u8 container (0 list, 1 tuple), u8 PackedKind, varint count, then
+                            // ints: frame-of-reference blocks (packed_array.h);
+                            // floats: blocks in byte planes or XOR-delta coded;
+                            // strings: count varint entries, varint text size, code units
+        ROWS = 0x16,        // u8 container (0 list, 1 tuple), varint count, segments (see below)
+        REF = 0x20,         // varint memo id
+        FUNCTION = 0x30,    // name, varint code id (0: code encoding follows), defaults,
+                            // kwdefaults, closure cells
+        MODULE = 0x31,      // module name
+        CUSTOM = 0x32,      // varint schema id (0: new schema follows), value records
+        GLOBAL = 0x33,      // module name, qualified name (class or function by reference)
+        REDUCE = 0x34,      // callable, args, state, listitems, dictitems, state setter
+        // Standard library types (std_types.h), in StdKind order.
+        DATETIME = 0x40,    // varint size, payload; likewise DATE to UUID
+        DATE = 0x41,
+        TIME = 0x42,
+        TIMEDELTA = 0x43,
+        DECIMAL = 0x44,
+        COMPLEX = 0x45,
+        RANGE = 0x46,
+        UUID = 0x47,
+        ENUM = 0x48,        // class record, value record
+        DEQUE = 0x49,       // varint maxlen + 1 (0: unbounded), varint count, records
+        ORDERED_DICT = 0x4A,  // varint count, key/value record pairs
+        DEFAULT_DICT = 0x4B,  // varint count, default_factory record, key/value record pairs
+        COUNTER = 0x4C,     // varint count, key/value record pairs
+    };
+
+    inline WireTag std_tag(StdKind kind) {
+        return static_cast<WireTag>(static_cast<uint8_t>(WireTag::DATETIME) + static_cast<uint8_t>(kind) -
+                                    static_cast<uint8_t>(StdKind::DATETIME));
+    }
+
+    inline StdKind std_tag_kind(WireTag tag) {
+        return static_cast<StdKind>(static_cast<uint8_t>(tag) - static_cast<uint8_t>(WireTag::DATETIME) +
+                                    static_cast<uint8_t>(StdKind::DATETIME));
+    }
+
+    // Only the most recent layouts of a type are searched before a new one is
+    // defined, so classes used as free-form attribute bags stay linear.
+    constexpr size_t WIRE_SCHEMA_SEARCH = 8;
+
+    // Lists and tuples of at least ROWS_MIN_RUN elements that are not packed
+    // arrays are written as a ROWS record: a sequence of segments covering the
+    // elements in order, each starting with a varint h.
+    // - h = n << 1: n ordinary element records.
+    // - h = n << 1 | 1: a run of n records that share one shape, written
+    //   column-wise. A u8 row kind follows: 0 for plain dicts (varint key
+    //   count, then the str keys), 1 for instances of one class with one
+    //   attribute layout (a schema reference as in CUSTOM). Then one column
+    //   per key: a u8 PackedKind and, for a packed kind, the packed payload
+    //   as in PACKED; for NONE, one record per row.
+    // The rows of a run take memo ids in row order before any of their values.
+    // Runs shorter than ROWS_MIN_RUN are written as ordinary elements, and
+    // runs are split after ROWS_MAX_RUN rows.
+    constexpr Py_ssize_t ROWS_MIN_RUN = 8;
+    constexpr Py_ssize_t ROWS_MAX_RUN = PACKED_BLOCK_ITEMS;
+
+    // Attribute layout shared by instances of one class: the names of the set
+    // __slots__ members followed by the ordered str keys of the instance
+    // __dict__. The first instance with a given layout writes the schema
+    // (module, type name, slot count, attribute names) and gets the next schema
+    // id; later instances write just the id and their values in schema order.
+    struct WireSchema {
+        uint32_t id = 0;
+        size_t n_slots = 0;
+        std::vector<PyObject *> names;  // owned
+    };
+
+    // True if `data` starts with the wire format header.
+    inline bool is_wire_format(const uint8_t *data, size_t size) {
+        return size >= WIRE_HEADER_SIZE &&
+               std::string_view(reinterpret_cast<const char *>(data), sizeof(WIRE_MAGIC)) ==
+               std::string_view(WIRE_MAGIC, sizeof(WIRE_MAGIC));
+    }
+
+    // Single-pass encoder: walks the object with an explicit stack and streams
+    // the records through zstd as it goes. Throws std::runtime_error on failure
+    // with the Python error (if any) left set, like PyObjectSerializer.
+    class WireEncoder {
+    public:
+        explicit WireEncoder(size_t max_depth = DEFAULT_MAX_DEPTH);
+
+        ~WireEncoder();
+
+        WireEncoder(const WireEncoder &) = delete;
+
+        WireEncoder &operator=(const WireEncoder &) = delete;
+
+        // `buffer_callback` (borrowed, may be nullptr) receives the buffers
+        // that may go out of band (out_of_band.h).
+        std::vector<uint8_t> encode(PyObject *obj, PyObject *buffer_callback = nullptr);
+
+        // Like encode(), but the result stays in the encoder (valid until the
+        // next call) so its storage is reused. trim() gives back storage
+        // grown past WIRE_KEEP_BUFFER_SIZE by a large call.
+        std::span<const uint8_t> encode_in_place(PyObject *obj, PyObject *buffer_callback = nullptr);
+
+        void trim();
+
+        // Compress every later call with `dictionary` (borrowed, must outlive
+        // the encoder), or without one for nullptr.
+        void set_dictionary(const ZSTD_CDict *dictionary);
+
+    private:
+        struct Frame;
+
+        void run(PyObject *obj, PyObject *buffer_callback);
+
+        bool write_object(PyObject *obj, std::vector<Frame> &stack, size_t depth, bool by_name = false);
+
+        bool next_child(Frame &frame, PyObject *&child);
+
+        bool write_function(PyObject *obj, Frame &frame);
+
+        bool write_custom(PyObject *obj, Frame &frame);
+
+        bool write_reduce(PyObject *obj, Frame &frame);
+
+        bool write_global(PyObject *obj, bool &found);
+
+        bool write_std(PyObject *obj, StdKind kind, Frame &frame, bool &written);
+
+        bool write_buffer(PyObject *obj, WireTag tag);
+
+        bool write_ndarray(PyObject *obj, bool &written);
+
+        bool write_packed(PyObject *obj, bool &packed);
+
+        bool write_packed_values(PackedKind kind, PyObject *const *items, Py_ssize_t n, bool &packed);
+
+        const WireSchema *write_schema(PyObject *obj, const TypePlan &plan, PyObject *dict);
+
+        Py_ssize_t run_length(PyObject *const *items, Py_ssize_t n);
+
+        bool start_run(Frame &frame, PyObject *const *items, Py_ssize_t rows);
+
+        bool write_column(PyObject *const *values, Py_ssize_t n, bool &generic);
+
+        static void release(Frame &frame);
+
+        void clear_schemas();
+
+        void clear_keep_alive();
+
+        void put_u8(uint8_t value) { buf_.push_back(value); }
+
+        void put_tag(WireTag tag) { buf_.push_back(static_cast<uint8_t>(tag)); }
+
+        void put_varint(uint64_t value);
+
+        void put_raw(const void *data, size_t size);
+
+        void put_str(std::string_view s);
+
+        void put_bytes(const void *data, size_t size, bool writable = false);
+
+        void put_data(const void *data, size_t size, bool writable = false);
+
+        void feed(const void *data, size_t size, bool finish, bool writable = false);
+
+        void compress(bool finish);
+
+        ZSTD_CCtx *cctx_;
+        size_t max_depth_;
+        IdentityTable memo_;
+        uint32_t next_memo_ = 0;
+        // Objects created during the walk (reduce tuples and their list items):
+        // their addresses are in memo_, so they must not be freed and reused
+        // before encode() returns.
+        std::vector<PyObject *> keep_alive_;
+        TypePlanCache plans_;
+        CodeTable codes_;
+        BufferCallback buffer_callback_;
+        std::vector<StrUnits> str_units_;  // code units of the packed strings being written
+        std::vector<uint8_t> std_value_;         // payload of the standard library value being written
+        std::unordered_map<PyTypeObject *, std::vector<WireSchema>> schemas_;
+        uint32_t next_schema_ = 0;
+        std::vector<uint8_t> buf_;
+        std::vector<uint8_t> out_;
+    };
+
+    // Streaming decoder: decompresses into a small window and creates Python
+    // objects as their records are parsed. Back-references resolve through a
+    // vector indexed by memo id; no intermediate graph is built. Returns a new
+    // reference, or nullptr with a Python error set.
+    class WireDecoder {
+    public:
+        WireDecoder();
+
+        ~WireDecoder();
+
+        WireDecoder(const WireDecoder &) = delete;
+
+        WireDecoder &operator=(const WireDecoder &) = delete;
+
+        // `buffers` (borrowed, may be nullptr) are the out-of-band buffers
+        // the data refers to (out_of_band.h).
+        PyObject *decode(const uint8_t *data, size_t size, PyObject *buffers = nullptr);
+
+        // Decompress every later call with `dictionary` (borrowed, must
+        // outlive the decoder), or without one for nullptr. Data written
+        // without a dictionary is still read.
+        void set_dictionary(const ZSTD_DDict *dictionary);
+
+    private:
+        struct Frame;
+
+        bool read_record(PyObject *&value, std::vector<Frame> &stack);
+
+        bool next_child(Frame &frame, bool &more);
+
+        bool attach(Frame &frame, PyObject *value);
+
+        bool finish(Frame &frame, PyObject *&value);
+
+        bool read_function(std::vector<Frame> &stack);
+
+        bool read_custom(std::vector<Frame> &stack);
+
+        bool read_packed(PyObject *&value);
+
+        bool read_packed_values(PackedKind kind, PyObject **items, Py_ssize_t count);
+
+        bool read_packed_ints(PyObject **items, Py_ssize_t count);
+
+        bool read_packed_floats(PyObject **items, Py_ssize_t count);
+
+        bool read_packed_strings(PyObject **items, Py_ssize_t count);
+
+        bool next_row_child(Frame &frame, bool &more);
+
+        bool start_run(Frame &frame);
+
+        bool set_row_value(Frame &frame, Py_ssize_t r, PyObject *value);
+
+        bool read_schema();
+
+        bool read_schema_ref(size_t &index);
+
+        struct Schema;
+
+        PyObject *new_instance(const Schema &schema, PyObject *&dict);
+
+        bool set_field(const Schema &schema, PyObject *obj, PyObject *dict, Py_ssize_t i, PyObject *value);
+
+        bool apply_reduce(Frame &frame);
+
+        void clear_schemas();
+
+        bool push_memo(PyObject *obj);
+
+        static void release(Frame &frame);
+
+        bool fill();
+
+        bool ensure(size_t n);
+
+        bool read_u8(uint8_t &value);
+
+        bool read_varint(uint64_t &value);
+
+        bool read_size(Py_ssize_t &value);
+
+        bool read_into(void *dst, size_t size);
+
+        bool read_view(size_t size, const char *&data);
+
+        bool finish_stream();
+
+        ZSTD_DCtx *dctx_;
+        const uint8_t *src_ = nullptr;
+        size_t src_size_ = 0;
+        size_t src_pos_ = 0;
+        bool frame_done_ = false;
+        std::vector<uint8_t> window_;
+        size_t rpos_ = 0;
+        size_t rend_ = 0;
+        std::vector<char> scratch_;
+        std::vector<uint64_t> entries_;  // entry table of the packed strings being read
+
+        std::vector<PyObject *> memo_;
+        std::vector<Schema> schemas_;
+        std::vector<PyObject *> codes_;  // code objects of this payload by code id - 1 (owned)
+        ClassCache classes_;
+        OutOfBandBuffers buffers_;
+    };
+} // namespace pyser
@@ -0,0 +1,1262 @@
+// pyser_wire_decode.cpp
+// Streaming decoder for the wire format described in pyser_wire.hpp.
+#include "pyser_wire.hpp"
+#include <zstd.h>
+#include <cstring>
+#include <stdexcept>
+
+namespace pyser {
+    // A container whose element records are still being parsed. Lists and
+    // tuples are created at full size up front (None-filled so a back-reference
+    // never sees an empty slot); frozensets collect their members in a tuple and
+    // are built by finish(). A REDUCE record collects its six items in `aux`;
+    // the object is created as soon as the callable and its arguments are in,
+    // so its state may refer back to it.
+    struct WireDecoder::Frame {
+        PyObject *obj = nullptr;    // container under construction (owned)
+        PyObject *aux = nullptr;    // instance __dict__, closure tuple, reduce items, deque items
+                                    // or enum class (owned)
+        PyObject *key = nullptr;    // pending dict key (owned)
+        WireTag kind = WireTag::NONE;
+        Py_ssize_t count = 0;
+        Py_ssize_t index = 0;
+        size_t memo_id = 0;         // frozenset / reduce memo slot, filled in once the object exists
+        size_t schema = 0;          // index into schemas_ for CUSTOM and object rows
+        int stage = 0;              // function: defaults, kwdefaults, cell count, cells;
+                                    // rows: segment header, plain elements, run columns
+        // rows: the current segment covers elements [index, end). A run keeps
+        // its rows in the container; `aux` holds their __dict__s (object rows)
+        // and `names` the keys (dict rows).
+        PyObject *names = nullptr;  // owned
+        Py_ssize_t end = 0;
+        Py_ssize_t run_rows = 0;
+        Py_ssize_t n_columns = 0;
+        Py_ssize_t column = 0;
+        Py_ssize_t row = 0;         // next row of the generic column being read
+        uint8_t row_kind = 0;       // 0: dicts, 1: instances
+        bool generic = false;
+    };
+
+    WireDecoder::WireDecoder() : dctx_(ZSTD_createDCtx()) {
+        if (!dctx_) {
+            throw std::runtime_error("Failed to create zstd decompression context");
+        }
+        window_.resize(ZSTD_DStreamOutSize());
+    }
+
+    WireDecoder::~WireDecoder() {
+        clear_schemas();
+        ZSTD_freeDCtx(dctx_);
+    }
+
+    void WireDecoder::set_dictionary(const ZSTD_DDict *dictionary) {
+        // Sticky: kept by the session resets of later calls.
+        ZSTD_DCtx_refDDict(dctx_, dictionary);
+    }
+
+    // Decompress more input into the window after rend_. Fails (with a Python
+    // error set) on corrupt input or when the frame has no more output.
+    bool WireDecoder::fill() {
+        while (true) {
+            if (frame_done_) {
+                PyErr_SetString(PyExc_ValueError, "Truncated wire data");
+                return false;
+            }
+            ZSTD_inBuffer in{src_, src_size_, src_pos_};
+            ZSTD_outBuffer out{window_.data(), window_.size(), rend_};
+            size_t rc;
+            {
+                // Small inputs keep the GIL (see allow_threads.h).
+                AllowThreads nogil(src_size_ >= ALLOW_THREADS_MIN_SIZE);
+                rc = ZSTD_decompressStream(dctx_, &out, &in);
+            }
+            src_pos_ = in.pos;
+            if (ZSTD_isError(rc)) {
+                PyErr_Format(PyExc_ValueError, "Corrupted wire data: %s", ZSTD_getErrorName(rc));
+                return false;
+            }
+            frame_done_ = rc == 0;
+            bool progress = out.pos > rend_;
+            rend_ = out.pos;
+            if (progress) return true;
+            if (!frame_done_ && src_pos_ == src_size_) {
+                PyErr_SetString(PyExc_ValueError, "Truncated wire data");
+                return false;
+            }
+        }
+    }
+
+    // Make `n` (<= window size) contiguous bytes available at rpos_.
+    bool WireDecoder::ensure(size_t n) {
+        if (rend_ - rpos_ >= n) return true;
+        if (rpos_ > 0) {
+            std::memmove(window_.data(), window_.data() + rpos_, rend_ - rpos_);
+            rend_ -= rpos_;
+            rpos_ = 0;
+        }
+        while (rend_ < n) {
+            if (!fill()) return false;
+        }
+        return true;
+    }
+
+    bool WireDecoder::read_u8(uint8_t &value) {
+        if (!ensure(1)) return false;
+        value = window_[rpos_++];
+        return true;
+    }
+
+    bool WireDecoder::read_varint(uint64_t &value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte;
+            if (!read_u8(byte)) return false;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        PyErr_SetString(PyExc_ValueError, "Malformed varint in wire data");
+        return false;
+    }
+
+    bool WireDecoder::read_size(Py_ssize_t &value) {
+        uint64_t raw;
+        if (!read_varint(raw)) return false;
+        if (raw > static_cast<uint64_t>(PY_SSIZE_T_MAX)) {
+            PyErr_SetString(PyExc_ValueError, "Length out of range in wire data");
+            return false;
+        }
+        value = static_cast<Py_ssize_t>(raw);
+        return true;
+    }
+
+    // Copy `size` bytes straight into `dst`, refilling the window as needed.
+    bool WireDecoder::read_into(void *dst, size_t size) {
+        auto *out = static_cast<uint8_t *>(dst);
+        while (size > 0) {
+            if (rpos_ == rend_) {
+                rpos_ = rend_ = 0;
+                if (!fill()) return false;
+            }
+            size_t n = std::min(size, rend_ - rpos_);
+            std::memcpy(out, window_.data() + rpos_, n);
+            rpos_ += n;
+            out += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    // Contiguous view of the next `size` bytes, valid until the next read.
+    bool WireDecoder::read_view(size_t size, const char *&data) {
+        if (size <= window_.size()) {
+            if (!ensure(size)) return false;
+            data = reinterpret_cast<const char *>(window_.data() + rpos_);
+            rpos_ += size;
+            return true;
+        }
+        scratch_.resize(size);
+        if (!read_into(scratch_.data(), size)) return false;
+        data = scratch_.data();
+        return true;
+    }
+
+    // The root record is complete; drain the frame so zstd verifies the
+    // content checksum, and reject anything after it.
+    bool WireDecoder::finish_stream() {
+        while (rpos_ == rend_ && !frame_done_) {
+            rpos_ = rend_ = 0;
+            ZSTD_inBuffer in{src_, src_size_, src_pos_};
+            ZSTD_outBuffer out{window_.data(), window_.size(), 0};
+            size_t rc = ZSTD_decompressStream(dctx_, &out, &in);
+            src_pos_ = in.pos;
+            if (ZSTD_isError(rc)) {
+                PyErr_Format(PyExc_ValueError, "Corrupted wire data: %s", ZSTD_getErrorName(rc));
+                return false;
+            }
+            frame_done_ = rc == 0;
+            rend_ = out.pos;
+            if (!frame_done_ && rend_ == 0 && src_pos_ == src_size_) {
+                PyErr_SetString(PyExc_ValueError, "Truncated wire data");
+                return false;
+            }
+        }
+        if (rpos_ != rend_ || src_pos_ != src_size_) {
+            PyErr_SetString(PyExc_ValueError, "Trailing data after wire frame");
+            return false;
+        }
+        return true;
+    }
+
+    bool WireDecoder::push_memo(PyObject *obj) {
+        Py_XINCREF(obj);
+        memo_.push_back(obj);
+        return true;
+    }
+
+    void WireDecoder::release(Frame &frame) {
+        Py_CLEAR(frame.obj);
+        Py_CLEAR(frame.aux);
+        Py_CLEAR(frame.key);
+        Py_CLEAR(frame.names);
+    }
+
+    // Decoder side of a WireSchema: the resolved class plus the interned names.
+    struct WireDecoder::Schema {
+        PyObject *cls = nullptr;        // owned; nullptr for the SimpleNamespace fallback
+        std::vector<PyObject *> names;  // owned, interned; slot names first
+        std::vector<Py_ssize_t> slot_offsets;  // per slot name; -1 assigns through setattr
+        bool setattr = false;           // fill via generic setattr instead of __dict__
+        std::string type_name;
+    };
+
+    void WireDecoder::clear_schemas() {
+        for (PyObject *code: codes_) Py_DECREF(code);
+        codes_.clear();
+        for (auto &schema: schemas_) {
+            Py_XDECREF(schema.cls);
+            for (PyObject *name: schema.names) Py_DECREF(name);
+        }
+        schemas_.clear();
+    }
+
+    bool WireDecoder::read_schema() {
+        Py_ssize_t size;
+        const char *data;
+        if (!read_size(size) || !read_view(size, data)) return false;
+        std::string module_name(data, size);
+        if (!read_size(size) || !read_view(size, data)) return false;
+        Schema schema;
+        schema.type_name.assign(data, size);
+        Py_ssize_t n_slots, count;
+        if (!read_size(n_slots) || !read_size(count)) return false;
+        if (n_slots > count) {
+            PyErr_SetString(PyExc_ValueError, "Invalid schema slot count in wire data");
+            return false;
+        }
+        schemas_.push_back(std::move(schema));
+        Schema &added = schemas_.back();
+        for (Py_ssize_t i = 0; i < count; i++) {
+            if (!read_size(size) || !read_view(size, data)) return false;
+            PyObject *name = PyUnicode_DecodeUTF8(data, size, "strict");
+            if (!name) return false;
+            PyUnicode_InternInPlace(&name);
+            added.names.push_back(name);
+        }
+        added.cls = classes_.lookup_class(module_name, added.type_name);
+        Py_XINCREF(added.cls);
+        // Slots are stored straight into the instance when the class still has
+        // a plain member for them; otherwise they go through setattr.
+        auto *type = reinterpret_cast<PyTypeObject *>(added.cls);
+        for (Py_ssize_t i = 0; i < n_slots; i++) {
+            added.slot_offsets.push_back(type ? TypePlanCache::slot_offset(type, added.names[i]) : -1);
+        }
+        // Generic setattr on a fresh instance keeps the class's shared-key
+        // (split) dict layout. It is only safe when the class does not customise
+        // attribute assignment and no name hits a data descriptor.
+        if (type) {
+            added.setattr = type->tp_setattro == PyObject_GenericSetAttr;
+            for (size_t i = n_slots; i < added.names.size(); i++) {
+                if (!added.setattr) break;
+                PyObject *descr = _PyType_Lookup(type, added.names[i]);
+                added.setattr = !descr || !Py_TYPE(descr)->tp_descr_set;
+            }
+        }
+        return true;
+    }
+
+    // Resolve a schema reference (0: a new schema follows) to its index.
+    bool WireDecoder::read_schema_ref(size_t &index) {
+        uint64_t schema_id;
+        if (!read_varint(schema_id)) return false;
+        if (schema_id == 0) {
+            if (!read_schema()) return false;
+            schema_id = schemas_.size();
+        } else if (schema_id > schemas_.size()) {
+            PyErr_Format(PyExc_ValueError, "Invalid schema id %llu in wire data",
+                         static_cast<unsigned long long>(schema_id));
+            return false;
+        }
+        index = schema_id - 1;
+        return true;
+    }
+
+    // A new, empty instance for `schema`, and the dict its attributes go
+    // into (nullptr when they are set on the object instead).
+    PyObject *WireDecoder::new_instance(const Schema &schema, PyObject *&dict) {
+        PyObject *obj;
+        dict = nullptr;
+        if (schema.cls) {
+            // Allocate without running __new__/__init__; attributes are restored
+            // from the record.
+            auto *type = reinterpret_cast<PyTypeObject *>(schema.cls);
+            obj = type->tp_alloc(type, 0);
+        } else {
+            // Local classes are not importable; keep the attributes on a
+            // SimpleNamespace like the graph deserializer does.
+            PyObject *ns = classes_.lookup_class("types", "SimpleNamespace");
+            obj = ns ? PyObject_CallNoArgs(ns) : nullptr;
+        }
+        if (!obj) {
+            if (!PyErr_Occurred()) {
+                PyErr_Format(PyExc_TypeError, "Cannot find class '%s'", schema.type_name.c_str());
+            }
+            return nullptr;
+        }
+        if (schema.names.size() > schema.slot_offsets.size() && !schema.setattr) {
+            // Install a dict presized for the schema, or fall back to whatever
+            // __dict__ the object exposes.
+            dict = _PyDict_NewPresized(static_cast<Py_ssize_t>(schema.names.size()));
+            if (dict && PyObject_GenericSetDict(obj, dict, nullptr) < 0) {
+                Py_CLEAR(dict);
+            }
+            if (!dict) {
+                PyErr_Clear();
+                dict = PyObject_GetAttrString(obj, "__dict__");
+                if (dict && !PyDict_Check(dict)) {
+                    Py_CLEAR(dict);
+                }
+                PyErr_Clear();
+            }
+        }
+        return obj;
+    }
+
+    // Set attribute `i` of `schema` on a fresh instance. Steals `value`.
+    bool WireDecoder::set_field(const Schema &schema, PyObject *obj, PyObject *dict, Py_ssize_t i, PyObject *value) {
+        PyObject *name = schema.names[i];
+        int rc;
+        if (i < static_cast<Py_ssize_t>(schema.slot_offsets.size())) {
+            if (schema.slot_offsets[i] >= 0) {
+                // Fresh instance: the slot is empty, so the value is stolen
+                // straight into it.
+                auto **slot = reinterpret_cast<PyObject **>(reinterpret_cast<char *>(obj) + schema.slot_offsets[i]);
+                Py_XSETREF(*slot, value);
+                return true;
+            }
+            rc = PyObject_SetAttr(obj, name, value);
+        } else {
+            rc = dict ? PyDict_SetItem(dict, name, value) : PyObject_GenericSetAttr(obj, name, value);
+        }
+        Py_DECREF(value);
+        return rc == 0;
+    }
+
+    bool WireDecoder::read_custom(std::vector<Frame> &stack) {
+        Frame frame;
+        frame.kind = WireTag::CUSTOM;
+        if (!read_schema_ref(frame.schema)) return false;
+        const Schema &schema = schemas_[frame.schema];
+        frame.count = static_cast<Py_ssize_t>(schema.names.size());
+        frame.obj = new_instance(schema, frame.aux);
+        if (!frame.obj) return false;
+        push_memo(frame.obj);
+        stack.push_back(frame);
+        return true;
+    }
+
+    bool WireDecoder::read_function(std::vector<Frame> &stack) {
+        Py_ssize_t size;
+        const char *data;
+        if (!read_size(size) || !read_view(size, data)) return false;
+        PyObject *name = PyUnicode_DecodeUTF8(data, size, "strict");
+        if (!name) return false;
+        uint64_t code_id;
+        PyObject *code = nullptr;
+        if (read_varint(code_id)) {
+            if (code_id == 0) {
+                if (read_size(size) && read_view(size, data)) {
+                    code = load_code({data, static_cast<size_t>(size)});
+                }
+                if (code) codes_.push_back(code);
+            } else if (code_id > codes_.size()) {
+                PyErr_Format(PyExc_ValueError, "Invalid code id %llu in wire data",
+                             static_cast<unsigned long long>(code_id));
+            } else {
+                code = codes_[code_id - 1];
+            }
+        }
+        if (!code) {
+            Py_DECREF(name);
+            return false;
+        }
+        PyObject *globals = PyDict_New();
+        PyObject *function = globals ? PyFunction_New(code, globals) : nullptr;
+        Py_XDECREF(globals);
+        if (function && PyUnicode_GET_LENGTH(name) > 0 && PyObject_SetAttrString(function, "__name__", name) < 0) {
+            Py_CLEAR(function);
+        }
+        Py_DECREF(name);
+        if (!function) return false;
+        push_memo(function);
+        Frame frame;
+        frame.kind = WireTag::FUNCTION;
+        frame.obj = function;
+        stack.push_back(frame);
+        return true;
+    }
+
+    // A PACKED record. The list or tuple is created at full size and takes
+    // its memo id before any packed string does.
+    bool WireDecoder::read_packed(PyObject *&value) {
+        uint8_t container, kind;
+        Py_ssize_t count;
+        if (!read_u8(container) || !read_u8(kind) || !read_size(count)) return false;
+        if (container > 1 || kind == static_cast<uint8_t>(PackedKind::NONE) ||
+            kind > static_cast<uint8_t>(PackedKind::STR_UNITS)) {
+            PyErr_SetString(PyExc_ValueError, "Invalid packed array header in wire data");
+            return false;
+        }
+        if (count > PY_SSIZE_T_MAX / 8) {
+            PyErr_SetString(PyExc_ValueError, "Length out of range in wire data");
+            return false;
+        }
+        PyObject *seq = container == 0 ? PyList_New(count) : PyTuple_New(count);
+        if (!seq) return false;
+        push_memo(seq);
+        if (!read_packed_values(static_cast<PackedKind>(kind), PySequence_Fast_ITEMS(seq), count)) {
+            Py_DECREF(seq);
+            return false;
+        }
+        value = seq;
+        return true;
+    }
+
+    // Payload of a packed array of `kind`, stored into the `count` empty
+    // slots `items` of a fresh list or tuple. Numbers are filled straight from
+    // the window, one block of values (32 KiB) at a time.
+    bool WireDecoder::read_packed_values(PackedKind kind, PyObject **items, Py_ssize_t count) {
+        if (kind == PackedKind::STR_UNITS) return read_packed_strings(items, count);
+        if (kind == PackedKind::INT_FOR) return read_packed_ints(items, count);
+        return read_packed_floats(items, count);
+    }
+
+    // Frame-of-reference blocks of a packed int array.
+    bool WireDecoder::read_packed_ints(PyObject **items, Py_ssize_t count) {
+        uint64_t values[PACKED_BLOCK_ITEMS];
+        for (Py_ssize_t done = 0; done < count;) {
+            Py_ssize_t n = std::min(PACKED_BLOCK_ITEMS, count - done);
+            IntBlockHeader header;
+            uint64_t reference, first = 0;
+            if (!read_u8(header.mode) || !read_u8(header.width)) return false;
+            if (!header.valid()) {
+                PyErr_SetString(PyExc_ValueError, "Invalid packed int block in wire data");
+                return false;
+            }
+            if (!read_varint(reference)) return false;
+            if (header.mode == INT_BLOCK_DELTA && !read_varint(first)) return false;
+            header.reference = static_cast<uint64_t>(unzigzag(reference));
+            header.first = static_cast<uint64_t>(unzigzag(first));
+            size_t size = header.data_size(n);
+            if (!ensure(size)) return false;
+            unpack_int_block(header, window_.data() + rpos_, n, values);
+            rpos_ += size;
+            if (!make_ints(values, n, items + done)) return false;
+            done += n;
+        }
+        return true;
+    }
+
+    // Blocks of a packed float array, each in byte planes or XOR-delta coded.
+    bool WireDecoder::read_packed_floats(PyObject **items, Py_ssize_t count) {
+        uint64_t values[PACKED_BLOCK_ITEMS];
+        for (Py_ssize_t done = 0; done < count;) {
+            Py_ssize_t n = std::min(PACKED_BLOCK_ITEMS, count - done);
+            uint8_t mode;
+            if (!read_u8(mode)) return false;
+            if (mode == FLOAT_BLOCK_PLANES) {
+                if (!ensure(8 * static_cast<size_t>(n)) ||
+                    !unpack_float_planes(window_.data() + rpos_, n, items + done)) {
+                    return false;
+                }
+                rpos_ += 8 * static_cast<size_t>(n);
+                done += n;
+                continue;
+            }
+            uint64_t size;
+            if (mode != FLOAT_BLOCK_XOR || !read_varint(size) || size > xor_max_size(n)) {
+                if (!PyErr_Occurred()) PyErr_SetString(PyExc_ValueError, "Invalid packed float block in wire data");
+                return false;
+            }
+            if (!ensure(size)) return false;
+            if (!xor_decode(window_.data() + rpos_, size, n, values)) {
+                PyErr_SetString(PyExc_ValueError, "Invalid packed float block in wire data");
+                return false;
+            }
+            rpos_ += size;
+            if (!make_floats(values, n, items + done)) return false;
+            done += n;
+        }
+        return true;
+    }
+
+    // Byte size and width of the code units behind a packed string entry.
+    static uint64_t packed_str_size(uint64_t entry, StrWidth &width) {
+        uint64_t header = entry >> 1;
+        width = static_cast<StrWidth>(header & 3);
+        return (header >> 2) * unit_size(width);
+    }
+
+    // Entry table and text of a packed string array.
+    bool WireDecoder::read_packed_strings(PyObject **items, Py_ssize_t count) {
+        entries_.resize(count);
+        uint64_t expected = 0;
+        StrWidth width;
+        for (Py_ssize_t i = 0; i < count; i++) {
+            if (!read_varint(entries_[i])) return false;
+            if (!(entries_[i] & 1)) expected += packed_str_size(entries_[i], width);
+        }
+        Py_ssize_t text_size;
+        const char *text;
+        if (!read_size(text_size)) return false;
+        if (static_cast<uint64_t>(text_size) != expected) {
+            PyErr_SetString(PyExc_ValueError, "Packed string lengths do not match their text in wire data");
+            return false;
+        }
+        if (!read_view(text_size, text)) return false;
+        const char *text_end = text + text_size;
+        for (Py_ssize_t i = 0; i < count; i++) {
+            uint64_t entry = entries_[i];
+            if (entry & 1) {
+                uint64_t memo_id = entry >> 1;
+                if (memo_id >= memo_.size() || !memo_[memo_id]) {
+                    PyErr_Format(PyExc_ValueError, "Invalid back-reference %llu in wire data",
+                                 static_cast<unsigned long long>(memo_id));
+                    return false;
+                }
+                items[i] = memo_[memo_id];
+                Py_INCREF(items[i]);
+                continue;
+            }
+            uint64_t size = packed_str_size(entry, width);
+            if (size > static_cast<uint64_t>(text_end - text)) {
+                PyErr_SetString(PyExc_ValueError, "Packed string lengths do not match their text in wire data");
+                return false;
+            }
+            items[i] = make_str_units(width, reinterpret_cast<const uint8_t *>(text), size / unit_size(width));
+            if (!items[i]) return false;
+            text += size;
+            push_memo(items[i]);
+        }
+        return true;
+    }
+
+    bool WireDecoder::read_record(PyObject *&value, std::vector<Frame> &stack) {
+        uint8_t tag;
+        if (!read_u8(tag)) return false;
+        Py_ssize_t size;
+        const char *data;
+        Frame frame;
+        frame.kind = static_cast<WireTag>(tag);
+        switch (frame.kind) {
+            case WireTag::NONE:
+                Py_INCREF(Py_None);
+                value = Py_None;
+                return true;
+            case WireTag::TRUE_:
+                Py_INCREF(Py_True);
+                value = Py_True;
+                return true;
+            case WireTag::FALSE_:
+                Py_INCREF(Py_False);
+                value = Py_False;
+                return true;
+            case WireTag::INT: {
+                uint64_t raw;
+                if (!read_varint(raw)) return false;
+                value = PyLong_FromLongLong(unzigzag(raw));
+                return value != nullptr;
+            }
+            case WireTag::BIGINT:
+                if (!read_size(size) || !read_view(size, data)) return false;
+                value = _PyLong_FromByteArray(reinterpret_cast<const unsigned char *>(data), size, 1, 1);
+                return value != nullptr;
+            case WireTag::FLOAT: {
+                uint8_t le[8];
+                if (!read_into(le, sizeof(le))) return false;
+                uint64_t bits = 0;
+                for (int i = 0; i < 8; i++) bits |= static_cast<uint64_t>(le[i]) << (8 * i);
+                double d;
+                std::memcpy(&d, &bits, sizeof(d));
+                value = PyFloat_FromDouble(d);
+                return value != nullptr;
+            }
+            case WireTag::STRING:
+                if (!read_size(size) || !read_view(size, data)) return false;
+                value = PyUnicode_DecodeUTF8(data, size, "strict");
+                return value && push_memo(value);
+            case WireTag::STR_UNITS: {
+                uint64_t header;
+                if (!read_varint(header)) return false;
+                auto width = static_cast<StrWidth>(header & 3);
+                uint64_t length = header >> 2;
+                if (length > static_cast<uint64_t>(PY_SSIZE_T_MAX) / 4) {
+                    PyErr_SetString(PyExc_ValueError, "Length out of range in wire data");
+                    return false;
+                }
+                size = static_cast<Py_ssize_t>(length * unit_size(width));
+                if (!read_view(size, data)) return false;
+                value = make_str_units(width, reinterpret_cast<const uint8_t *>(data), length);
+                return value && push_memo(value);
+            }
+            case WireTag::BYTES:
+                if (!read_size(size)) return false;
+                value = PyBytes_FromStringAndSize(nullptr, size);
+                if (!value || !read_into(PyBytes_AS_STRING(value), size)) return false;
+                return push_memo(value);
+            case WireTag::BYTEARRAY:
+                if (!read_size(size)) return false;
+                value = PyByteArray_FromStringAndSize(nullptr, size);
+                if (!value || !read_into(PyByteArray_AS_STRING(value), size)) return false;
+                return push_memo(value);
+            case WireTag::OUT_OF_BAND: {
+                uint8_t kind;
+                uint64_t index, length;
+                if (!read_u8(kind) || !read_varint(index) || !read_varint(length)) return false;
+                if (kind > static_cast<uint8_t>(BufferKind::BUFFER)) {
+                    PyErr_SetString(PyExc_ValueError, "Invalid out-of-band buffer record");
+                    return false;
+                }
+                value = buffers_.take(static_cast<BufferKind>(kind), index, length);
+                return value && push_memo(value);
+            }
+            case WireTag::NDARRAY: {
+                ArrayHeader header;
+                uint8_t placement;
+                if (!read_size(size) || !read_view(size, data)) return false;
+                const auto *pos = reinterpret_cast<const uint8_t *>(data);
+                if (!parse_ndarray_header(pos, pos + size, header)) return false;
+                if (pos != reinterpret_cast<const uint8_t *>(data) + size || !read_u8(placement) || placement > 1) {
+                    if (!PyErr_Occurred()) PyErr_SetString(PyExc_ValueError, "Invalid numpy array record");
+                    return false;
+                }
+                PyObject *buffer;
+                if (placement == 1) {
+                    uint64_t index;
+                    if (!read_varint(index)) return false;
+                    buffer = buffers_.take(BufferKind::BUFFER, index, header.size);
+                    if (!buffer) return false;
+                } else {
+                    buffer = PyByteArray_FromStringAndSize(nullptr, static_cast<Py_ssize_t>(header.size));
+                    if (!buffer) return false;
+                    if (!read_into(PyByteArray_AS_STRING(buffer), header.size)) {
+                        Py_DECREF(buffer);
+                        return false;
+                    }
+                }
+                value = make_ndarray(header, buffer);
+                Py_DECREF(buffer);
+                return value && push_memo(value);
+            }
+            case WireTag::LIST:
+            case WireTag::TUPLE:
+            case WireTag::FROZENSET:
+                if (!read_size(frame.count)) return false;
+                frame.obj = frame.kind == WireTag::LIST ? PyList_New(frame.count) : PyTuple_New(frame.count);
+                if (!frame.obj) return false;
+                for (Py_ssize_t i = 0; i < frame.count; i++) {
+                    Py_INCREF(Py_None);
+                    if (frame.kind == WireTag::LIST) {
+                        PyList_SET_ITEM(frame.obj, i, Py_None);
+                    } else {
+                        PyTuple_SET_ITEM(frame.obj, i, Py_None);
+                    }
+                }
+                // The frozenset does not exist until all members are read; a
+                // back-reference to it before then is rejected.
+                frame.memo_id = memo_.size();
+                push_memo(frame.kind == WireTag::FROZENSET ? nullptr : frame.obj);
+                stack.push_back(frame);
+                return true;
+            case WireTag::PACKED:
+                return read_packed(value);
+            case WireTag::ROWS: {
+                uint8_t container;
+                if (!read_u8(container) || !read_size(frame.count)) return false;
+                if (container > 1) {
+                    PyErr_SetString(PyExc_ValueError, "Invalid rows header in wire data");
+                    return false;
+                }
+                frame.obj = container == 0 ? PyList_New(frame.count) : PyTuple_New(frame.count);
+                if (!frame.obj) return false;
+                PyObject **items = PySequence_Fast_ITEMS(frame.obj);
+                for (Py_ssize_t i = 0; i < frame.count; i++) {
+                    Py_INCREF(Py_None);
+                    items[i] = Py_None;
+                }
+                push_memo(frame.obj);
+                stack.push_back(frame);
+                return true;
+            }
+            case WireTag::DICT:
+            case WireTag::SET:
+                if (!read_size(frame.count)) return false;
+                frame.obj = frame.kind == WireTag::DICT ? PyDict_New() : PySet_New(nullptr);
+                if (!frame.obj) return false;
+                push_memo(frame.obj);
+                stack.push_back(frame);
+                return true;
+            case WireTag::REF: {
+                uint64_t memo_id;
+                if (!read_varint(memo_id)) return false;
+                if (memo_id >= memo_.size() || !memo_[memo_id]) {
+                    PyErr_Format(PyExc_ValueError, "Invalid back-reference %llu in wire data",
+                                 static_cast<unsigned long long>(memo_id));
+                    return false;
+                }
+                value = memo_[memo_id];
+                Py_INCREF(value);
+                return true;
+            }
+            case WireTag::FUNCTION:
+                return read_function(stack);
+            case WireTag::MODULE: {
+                if (!read_size(size) || !read_view(size, data)) return false;
+                value = classes_.lookup_module({data, static_cast<size_t>(size)});
+                Py_XINCREF(value);
+                return value && push_memo(value);
+            }
+            case WireTag::CUSTOM:
+                return read_custom(stack);
+            case WireTag::GLOBAL: {
+                if (!read_size(size) || !read_view(size, data)) return false;
+                std::string module_name(data, size);
+                if (!read_size(size) || !read_view(size, data)) return false;
+                value = classes_.lookup_global(module_name, {data, static_cast<size_t>(size)});
+                Py_XINCREF(value);
+                return value && push_memo(value);
+            }
+            case WireTag::REDUCE:
+                frame.count = 6;
+                frame.aux = PyTuple_New(frame.count);
+                if (!frame.aux) return false;
+                for (Py_ssize_t i = 0; i < frame.count; i++) {
+                    Py_INCREF(Py_None);
+                    PyTuple_SET_ITEM(frame.aux, i, Py_None);
+                }
+                frame.memo_id = memo_.size();
+                push_memo(nullptr);
+                stack.push_back(frame);
+                return true;
+            case WireTag::DATETIME:
+            case WireTag::DATE:
+            case WireTag::TIME:
+            case WireTag::TIMEDELTA:
+            case WireTag::DECIMAL:
+            case WireTag::COMPLEX:
+            case WireTag::RANGE:
+            case WireTag::UUID:
+                if (!read_size(size) || !read_view(size, data)) return false;
+                value = unpack_std_value(std_tag_kind(frame.kind), reinterpret_cast<const uint8_t *>(data), size);
+                return value && push_memo(value);
+            case WireTag::ENUM:
+                // The member is looked up once its class and value are in.
+                frame.count = 2;
+                frame.memo_id = memo_.size();
+                push_memo(nullptr);
+                stack.push_back(frame);
+                return true;
+            case WireTag::DEQUE: {
+                uint64_t bound;
+                if (!read_varint(bound) || !read_size(frame.count)) return false;
+                if (bound > static_cast<uint64_t>(PY_SSIZE_T_MAX)) {
+                    PyErr_SetString(PyExc_ValueError, "Invalid deque bound in wire data");
+                    return false;
+                }
+                // Elements are collected in `aux` and added by finish().
+                frame.obj = new_std_container(StdKind::DEQUE, static_cast<Py_ssize_t>(bound) - 1);
+                frame.aux = frame.obj ? PyList_New(0) : nullptr;
+                if (!frame.aux) {
+                    release(frame);
+                    return false;
+                }
+                push_memo(frame.obj);
+                stack.push_back(frame);
+                return true;
+            }
+            case WireTag::ORDERED_DICT:
+            case WireTag::DEFAULT_DICT:
+            case WireTag::COUNTER:
+                if (!read_size(frame.count)) return false;
+                frame.obj = new_std_container(std_tag_kind(frame.kind));
+                if (!frame.obj) return false;
+                push_memo(frame.obj);
+                stack.push_back(frame);
+                return true;
+            default:
+                PyErr_Format(PyExc_ValueError, "Unknown wire record tag 0x%02x", tag);
+                return false;
+        }
+    }
+
+    // Read whatever sits between two element records (attribute names, closure
+    // cell flags) and report whether another element record follows.
+    bool WireDecoder::next_child(Frame &frame, bool &more) {
+        switch (frame.kind) {
+            case WireTag::DICT:
+            case WireTag::ORDERED_DICT:
+            case WireTag::COUNTER:
+                more = frame.key != nullptr || frame.index < frame.count;
+                return true;
+            case WireTag::DEFAULT_DICT:
+                more = frame.stage == 0 || frame.key != nullptr || frame.index < frame.count;
+                return true;
+            case WireTag::FUNCTION:
+                if (frame.stage < 2) {
+                    more = true;
+                    return true;
+                }
+                if (frame.stage == 2) {
+                    frame.stage = 3;
+                    if (!read_size(frame.count)) return false;
+                    if (frame.count > 0) {
+                        frame.aux = PyTuple_New(frame.count);
+                        if (!frame.aux) return false;
+                        for (Py_ssize_t i = 0; i < frame.count; i++) {
+                            PyObject *cell = PyCell_New(nullptr);
+                            if (!cell) return false;
+                            PyTuple_SET_ITEM(frame.aux, i, cell);
+                        }
+                    }
+                }
+                while (frame.index < frame.count) {
+                    uint8_t flag;
+                    if (!read_u8(flag)) return false;
+                    frame.index++;
+                    if (flag == 1) {
+                        more = true;
+                        return true;
+                    }
+                    if (flag != 0) {
+                        PyErr_SetString(PyExc_ValueError, "Invalid closure cell flag in wire data");
+                        return false;
+                    }
+                }
+                more = false;
+                return true;
+            case WireTag::ROWS:
+                return next_row_child(frame, more);
+            default:
+                more = frame.index < frame.count;
+                return true;
+        }
+    }
+
+    // Segment headers and packed columns of a ROWS record, up to the next
+    // element record.
+    bool WireDecoder::next_row_child(Frame &frame, bool &more) {
+        more = true;
+        while (true) {
+            if (frame.stage == 1) {
+                if (frame.index < frame.end) return true;
+                frame.stage = 0;
+            } else if (frame.stage == 2) {
+                if (frame.generic) {
+                    if (frame.row < frame.run_rows) return true;
+                    frame.generic = false;
+                    frame.column++;
+                }
+                if (frame.column < frame.n_columns) {
+                    uint8_t kind;
+                    if (!read_u8(kind)) return false;
+                    if (kind > static_cast<uint8_t>(PackedKind::STR_UNITS)) {
+                        PyErr_SetString(PyExc_ValueError, "Invalid column kind in wire data");
+                        return false;
+                    }
+                    if (kind == static_cast<uint8_t>(PackedKind::NONE)) {
+                        frame.generic = true;
+                        frame.row = 0;
+                        continue;
+                    }
+                    // Values are decoded into a scratch tuple, then handed to
+                    // their rows.
+                    PyObject *values = PyTuple_New(frame.run_rows);
+                    if (!values) return false;
+                    bool ok = read_packed_values(static_cast<PackedKind>(kind), PySequence_Fast_ITEMS(values),
+                                                 frame.run_rows);
+                    for (Py_ssize_t r = 0; ok && r < frame.run_rows; r++) {
+                        PyObject *value = PyTuple_GET_ITEM(values, r);
+                        Py_INCREF(value);
+                        ok = set_row_value(frame, r, value);
+                    }
+                    Py_DECREF(values);
+                    if (!ok) return false;
+                    frame.column++;
+                    continue;
+                }
+                Py_CLEAR(frame.aux);
+                Py_CLEAR(frame.names);
+                frame.index = frame.end;
+                frame.stage = 0;
+            } else {
+                if (frame.index == frame.count) {
+                    more = false;
+                    return true;
+                }
+                uint64_t header;
+                if (!read_varint(header)) return false;
+                uint64_t n = header >> 1;
+                if (n == 0 || n > static_cast<uint64_t>(frame.count - frame.index)) {
+                    PyErr_SetString(PyExc_ValueError, "Invalid rows segment in wire data");
+                    return false;
+                }
+                frame.end = frame.index + static_cast<Py_ssize_t>(n);
+                if (!(header & 1)) {
+                    frame.stage = 1;
+                    continue;
+                }
+                if (!start_run(frame)) return false;
+                frame.stage = 2;
+            }
+        }
+    }
+
+    // Create the rows of a run in place of their elements, each taking its
+    // memo id, after reading the row kind and its keys or schema.
+    bool WireDecoder::start_run(Frame &frame) {
+        frame.run_rows = frame.end - frame.index;
+        frame.column = 0;
+        frame.generic = false;
+        if (!read_u8(frame.row_kind)) return false;
+        if (frame.row_kind == 0) {
+            if (!read_size(frame.n_columns)) return false;
+            frame.names = PyTuple_New(frame.n_columns);
+            if (!frame.names) return false;
+            for (Py_ssize_t c = 0; c < frame.n_columns; c++) {
+                Py_ssize_t size;
+                const char *data;
+                if (!read_size(size) || !read_view(size, data)) return false;
+                PyObject *name = PyUnicode_DecodeUTF8(data, size, "strict");
+                if (!name) return false;
+                PyUnicode_InternInPlace(&name);
+                PyTuple_SET_ITEM(frame.names, c, name);
+            }
+        } else if (frame.row_kind == 1) {
+            if (!read_schema_ref(frame.schema)) return false;
+            frame.n_columns = static_cast<Py_ssize_t>(schemas_[frame.schema].names.size());
+            frame.aux = PyTuple_New(frame.run_rows);
+            if (!frame.aux) return false;
+        } else {
+            PyErr_SetString(PyExc_ValueError, "Invalid row kind in wire data");
+            return false;
+        }
+        PyObject **items = PySequence_Fast_ITEMS(frame.obj) + frame.index;
+        for (Py_ssize_t r = 0; r < frame.run_rows; r++) {
+            PyObject *row;
+            if (frame.row_kind == 0) {
+                row = _PyDict_NewPresized(frame.n_columns);
+            } else {
+                PyObject *dict;
+                row = new_instance(schemas_[frame.schema], dict);
+                if (row && !dict) {
+                    Py_INCREF(Py_None);
+                    dict = Py_None;
+                }
+                if (row) PyTuple_SET_ITEM(frame.aux, r, dict);
+            }
+            if (!row) return false;
+            Py_SETREF(items[r], row);
+            push_memo(row);
+        }
+        return true;
+    }
+
+    // Store the current column's value for row `r` of the run. Steals `value`.
+    bool WireDecoder::set_row_value(Frame &frame, Py_ssize_t r, PyObject *value) {
+        PyObject *row = PySequence_Fast_ITEMS(frame.obj)[frame.index + r];
+        if (frame.row_kind == 0) {
+            int rc = PyDict_SetItem(row, PyTuple_GET_ITEM(frame.names, frame.column), value);
+            Py_DECREF(value);
+            return rc == 0;
+        }
+        PyObject *dict = PyTuple_GET_ITEM(frame.aux, r);
+        return set_field(schemas_[frame.schema], row, dict == Py_None ? nullptr : dict, frame.column, value);
+    }
+
+    // Store a finished element in its container. Steals `value`.
+    bool WireDecoder::attach(Frame &frame, PyObject *value) {
+        int rc = 0;
+        switch (frame.kind) {
+            case WireTag::LIST:
+                Py_DECREF(PyList_GET_ITEM(frame.obj, frame.index));
+                PyList_SET_ITEM(frame.obj, frame.index++, value);
+                return true;
+            case WireTag::TUPLE:
+            case WireTag::FROZENSET:
+                Py_DECREF(PyTuple_GET_ITEM(frame.obj, frame.index));
+                PyTuple_SET_ITEM(frame.obj, frame.index++, value);
+                return true;
+            case WireTag::SET:
+                rc = PySet_Add(frame.obj, value);
+                frame.index++;
+                break;
+            case WireTag::DEFAULT_DICT:
+                if (frame.stage == 0) {
+                    frame.stage = 1;
+                    rc = PyObject_SetAttrString(frame.obj, "default_factory", value);
+                    break;
+                }
+                [[fallthrough]];
+            case WireTag::DICT:
+            case WireTag::ORDERED_DICT:
+            case WireTag::COUNTER:
+                if (!frame.key) {
+                    frame.key = value;
+                    return true;
+                }
+                // OrderedDict keeps its own order next to the dict storage.
+                rc = frame.kind == WireTag::ORDERED_DICT ? PyObject_SetItem(frame.obj, frame.key, value)
+                                                         : PyDict_SetItem(frame.obj, frame.key, value);
+                Py_CLEAR(frame.key);
+                frame.index++;
+                break;
+            case WireTag::DEQUE:
+                rc = PyList_Append(frame.aux, value);
+                frame.index++;
+                break;
+            case WireTag::ENUM:
+                if (frame.index++ == 0) {
+                    frame.aux = value;
+                    return true;
+                }
+                frame.obj = PyObject_CallOneArg(frame.aux, value);
+                Py_DECREF(value);
+                if (!frame.obj) return false;
+                Py_INCREF(frame.obj);
+                memo_[frame.memo_id] = frame.obj;
+                return true;
+            case WireTag::CUSTOM:
+                return set_field(schemas_[frame.schema], frame.obj, frame.aux, frame.index++, value);
+            case WireTag::ROWS:
+                if (frame.stage == 2) return set_row_value(frame, frame.row++, value);
+                Py_SETREF(PySequence_Fast_ITEMS(frame.obj)[frame.index], value);
+                frame.index++;
+                return true;
+            case WireTag::REDUCE:
+                Py_DECREF(PyTuple_GET_ITEM(frame.aux, frame.index));
+                PyTuple_SET_ITEM(frame.aux, frame.index++, value);
+                if (frame.index != 2) return true;
+                {
+                    // Callable and arguments are in: create the object now so that
+                    // back-references inside its state resolve to it.
+                    PyObject *args = PyTuple_GET_ITEM(frame.aux, 1);
+                    if (!PyTuple_Check(args)) {
+                        PyErr_SetString(PyExc_ValueError, "Reduce arguments must be a tuple in wire data");
+                        return false;
+                    }
+                    frame.obj = PyObject_Call(PyTuple_GET_ITEM(frame.aux, 0), args, nullptr);
+                    if (!frame.obj) return false;
+                    Py_INCREF(frame.obj);
+                    memo_[frame.memo_id] = frame.obj;
+                }
+                return true;
+            case WireTag::FUNCTION:
+                if (frame.stage == 0) {
+                    frame.stage = 1;
+                    if (PyTuple_Check(value)) rc = PyFunction_SetDefaults(frame.obj, value);
+                } else if (frame.stage == 1) {
+                    frame.stage = 2;
+                    if (PyDict_Check(value)) rc = PyFunction_SetKwDefaults(frame.obj, value);
+                } else {
+                    rc = PyCell_Set(PyTuple_GET_ITEM(frame.aux, frame.index - 1), value);
+                }
+                break;
+            default:
+                break;
+        }
+        Py_DECREF(value);
+        return rc == 0;
+    }
+
+    // Restore the state, list items and dict items of a REDUCE record the way
+    // pickle's BUILD, APPENDS and SETITEMS do.
+    bool WireDecoder::apply_reduce(Frame &frame) {
+        PyObject *obj = frame.obj;
+        PyObject *state = PyTuple_GET_ITEM(frame.aux, 2);
+        PyObject *listitems = PyTuple_GET_ITEM(frame.aux, 3);
+        PyObject *dictitems = PyTuple_GET_ITEM(frame.aux, 4);
+        PyObject *setter = PyTuple_GET_ITEM(frame.aux, 5);
+        if (listitems != Py_None) {
+            PyObject *extend = PyObject_GetAttrString(obj, "extend");
+            if (extend) {
+                PyObject *rv = PyObject_CallOneArg(extend, listitems);
+                Py_DECREF(extend);
+                if (!rv) return false;
+                Py_DECREF(rv);
+            } else {
+                PyErr_Clear();
+                PyObject *iter = PyObject_GetIter(listitems);
+                if (!iter) return false;
+                PyObject *item;
+                while ((item = PyIter_Next(iter))) {
+                    PyObject *rv = PyObject_CallMethod(obj, "append", "O", item);
+                    Py_DECREF(item);
+                    if (!rv) break;
+                    Py_DECREF(rv);
+                }
+                Py_DECREF(iter);
+                if (PyErr_Occurred()) return false;
+            }
+        }
+        if (dictitems != Py_None) {
+            PyObject *iter = PyObject_GetIter(dictitems);
+            if (!iter) return false;
+            PyObject *pair;
+            while ((pair = PyIter_Next(iter))) {
+                int rc = PyTuple_Check(pair) && PyTuple_GET_SIZE(pair) == 2
+                             ? PyObject_SetItem(obj, PyTuple_GET_ITEM(pair, 0), PyTuple_GET_ITEM(pair, 1))
+                             : (PyErr_SetString(PyExc_ValueError, "Invalid reduce dict item in wire data"), -1);
+                Py_DECREF(pair);
+                if (rc < 0) break;
+            }
+            Py_DECREF(iter);
+            if (PyErr_Occurred()) return false;
+        }
+        if (state == Py_None) return true;
+        if (setter != Py_None) {
+            PyObject *rv = PyObject_CallFunctionObjArgs(setter, obj, state, nullptr);
+            Py_XDECREF(rv);
+            return rv != nullptr;
+        }
+        PyObject *setstate = PyObject_GetAttrString(obj, "__setstate__");
+        if (setstate) {
+            PyObject *rv = PyObject_CallOneArg(setstate, state);
+            Py_DECREF(setstate);
+            Py_XDECREF(rv);
+            return rv != nullptr;
+        }
+        if (!PyErr_ExceptionMatches(PyExc_AttributeError)) return false;
+        PyErr_Clear();
+        // Default state: a __dict__ update, optionally paired with slot values.
+        PyObject *slotstate = nullptr;
+        if (PyTuple_Check(state) && PyTuple_GET_SIZE(state) == 2) {
+            slotstate = PyTuple_GET_ITEM(state, 1);
+            state = PyTuple_GET_ITEM(state, 0);
+        }
+        PyObject *key, *item;
+        Py_ssize_t pos = 0;
+        if (state != Py_None) {
+            if (!PyDict_Check(state)) {
+                PyErr_SetString(PyExc_ValueError, "Reduce state must be a dict in wire data");
+                return false;
+            }
+            PyObject *dict = PyObject_GetAttrString(obj, "__dict__");
+            if (!dict) return false;
+            while (PyDict_Next(state, &pos, &key, &item)) {
+                if (PyDict_SetItem(dict, key, item) < 0) break;
+            }
+            Py_DECREF(dict);
+            if (PyErr_Occurred()) return false;
+        }
+        if (slotstate && slotstate != Py_None) {
+            if (!PyDict_Check(slotstate)) {
+                PyErr_SetString(PyExc_ValueError, "Reduce slot state must be a dict in wire data");
+                return false;
+            }
+            pos = 0;
+            while (PyDict_Next(slotstate, &pos, &key, &item)) {
+                if (PyObject_SetAttr(obj, key, item) < 0) return false;
+            }
+        }
+        return true;
+    }
+
+    // All elements are in place: hand the finished object to `value`.
+    bool WireDecoder::finish(Frame &frame, PyObject *&value) {
+        if (frame.kind == WireTag::REDUCE && (!frame.obj || !apply_reduce(frame))) {
+            if (!frame.obj && !PyErr_Occurred()) {
+                PyErr_SetString(PyExc_ValueError, "Truncated reduce record in wire data");
+            }
+            return false;
+        }
+        if (frame.kind == WireTag::ENUM && !frame.obj) {
+            PyErr_SetString(PyExc_ValueError, "Truncated enum record in wire data");
+            return false;
+        }
+        if (frame.kind == WireTag::DEQUE) {
+            PyObject *rv = PyObject_CallMethod(frame.obj, "extend", "O", frame.aux);
+            if (!rv) return false;
+            Py_DECREF(rv);
+        }
+        if (frame.kind == WireTag::FROZENSET) {
+            value = PyFrozenSet_New(frame.obj);
+            if (!value) return false;
+            Py_INCREF(value);
+            memo_[frame.memo_id] = value;
+        } else {
+            if (frame.kind == WireTag::FUNCTION && frame.aux &&
+                PyFunction_SetClosure(frame.obj, frame.aux) < 0) {
+                return false;
+            }
+            value = frame.obj;
+            frame.obj = nullptr;
+        }
+        release(frame);
+        return true;
+    }
+
+    PyObject *WireDecoder::decode(const uint8_t *data, size_t size, PyObject *buffers) {
+        if (!is_wire_format(data, size)) {
+            PyErr_SetString(PyExc_ValueError, "Not wire format data");
+            return nullptr;
+        }
+        if (!buffers_.reset(buffers)) return nullptr;
+        if (data[sizeof(WIRE_MAGIC)] != WIRE_VERSION) {
+            PyErr_Format(PyExc_ValueError, "Unsupported wire format version %u",
+                         static_cast<unsigned>(data[sizeof(WIRE_MAGIC)]));
+            return nullptr;
+        }
+        src_ = data + WIRE_HEADER_SIZE;
+        src_size_ = size - WIRE_HEADER_SIZE;
+        src_pos_ = 0;
+        frame_done_ = false;
+        rpos_ = rend_ = 0;
+        memo_.clear();
+        clear_schemas();
+        classes_.new_epoch();
+        ZSTD_DCtx_reset(dctx_, ZSTD_reset_session_only);
+
+        std::vector<Frame> stack;
+        PyObject *value = nullptr;
+        PyObject *result = nullptr;
+        bool ok = read_record(value, stack);
+        while (ok) {
+            if (value) {
+                if (stack.empty()) {
+                    result = value;
+                    value = nullptr;
+                    break;
+                }
+                ok = attach(stack.back(), value);
+                value = nullptr;
+                if (!ok) break;
+            }
+            bool more;
+            ok = next_child(stack.back(), more);
+            if (!ok) break;
+            if (!more) {
+                ok = finish(stack.back(), value);
+                if (ok) stack.pop_back();
+                continue;
+            }
+            ok = read_record(value, stack);
+        }
+        if (ok) {
+            ok = finish_stream();
+        }
+        Py_XDECREF(value);
+        for (auto &frame: stack) {
+            release(frame);
+        }
+        for (PyObject *obj: memo_) {
+            Py_XDECREF(obj);
+        }
+        memo_.clear();
+        clear_schemas();
+        buffers_.reset(nullptr);
+        if (!ok) {
+            Py_XDECREF(result);
+            return nullptr;
+        }
+        return result;
+    }
+} // namespace pyser
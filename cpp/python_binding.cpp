@@ -1,39 +1,157 @@
 // python_binding.cpp
 // Small C API wrappers to expose serialize/deserialize to Python.
 // This file defines four functions exposed to Python:
-// - serialize(obj) -> bytes
-// - deserialize(bytes) -> object
-// - serialize_to_file(obj, filename) -> None
+// - serialize(obj, max_depth=0, format="wire", buffer_callback=None) -> bytes
+// - deserialize(bytes, buffers=None) -> object
+// - serialize_to_file(obj, filename, max_depth=0, format="wire") -> None
 // - deserialize_from_file(filename) -> object
+// and two classes keeping state across calls:
+// - Serializer(max_depth=0, format="wire", dictionary=None).serialize(obj, buffer_callback=None)
+// - Deserializer(dictionary=None).deserialize(bytes, buffers=None)
 // The module name is 'pyser' and is registered via PyModuleDef.
+// Work that touches no Python objects (compression, JSON encoding and parsing,
+// file I/O) runs with the GIL released (allow_threads.h), so other threads
+// keep running during large calls.
 
 #include <Python.h>
 #include "pyser.hpp"
+#include "pyser_wire.hpp"
+#include "allow_threads.h"
+#include <zstd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <optional>
 
-static PyObject *py_serialize(PyObject *self, PyObject *args) {
+// Report a C++ exception unless a more specific Python error is already set
+// (e.g. the ValueError raised when max_depth is exceeded).
+static void set_error_from_exception(const std::exception &e) {
+    if (!PyErr_Occurred()) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+    }
+}
+
+// Validate the max_depth/format keywords shared by serialize and
+// serialize_to_file. "wire" is the compact single-pass format from
+// pyser_wire.hpp; "graph" is the chunked JSON graph, kept for tooling that
+// inspects SerializedGraph.
+static bool check_serialize_args(Py_ssize_t max_depth, const char *format, bool &wire) {
+    if (max_depth < 0) {
+        PyErr_SetString(PyExc_ValueError, "max_depth must be >= 0");
+        return false;
+    }
+    if (std::strcmp(format, "graph") == 0) {
+        wire = false;
+    } else if (std::strcmp(format, "wire") == 0) {
+        wire = true;
+    } else {
+        PyErr_Format(PyExc_ValueError, "Unknown format '%s' (expected 'graph' or 'wire')", format);
+        return false;
+    }
+    return true;
+}
+
+// Encode `obj` as a graph. Serialization runs in two phases: the walk, which
+// reads Python objects and holds the GIL, and the encoding of its result
+// (JSON, compression), which does not. `cctx` and `dictionary` are those of a
+// Serializer, if any.
+static std::vector<uint8_t> serialize_graph(pyser::PyObjectSerializer &serializer, PyObject *obj,
+                                            PyObject *buffer_callback, ZSTD_CCtx *cctx = nullptr,
+                                            const ZSTD_CDict *dictionary = nullptr) {
+    pyser::SerializedGraph graph = serializer.serialize(obj, buffer_callback);
+    // The graph holds Python buffers, so it must outlive this scope and be
+    // destroyed with the GIL held. A node encodes to a few dozen bytes at
+    // least, so small graphs keep the GIL.
+    pyser::AllowThreads nogil(graph.nodes.size() * 64 >= pyser::ALLOW_THREADS_MIN_SIZE || !graph.buffers.empty());
+    return graph.to_bytes(cctx, dictionary);
+}
+
+// The wire format interleaves the two phases and releases the GIL inside the
+// encoder for each large batch it compresses.
+static std::vector<uint8_t> serialize_to_bytes(PyObject *obj, Py_ssize_t max_depth, bool wire,
+                                               PyObject *buffer_callback = nullptr) {
+    if (wire) {
+        pyser::WireEncoder encoder(static_cast<size_t>(max_depth));
+        return encoder.encode(obj, buffer_callback);
+    }
+    pyser::PyObjectSerializer serializer(static_cast<size_t>(max_depth));
+    return serialize_graph(serializer, obj, buffer_callback);
+}
+
+// Decode a zstd-compressed JSON graph. `data` belongs to an object the caller
+// holds. The graph is decompressed, parsed and checked without the GIL, then
+// built into objects with it.
+static PyObject *deserialize_graph(pyser::PyObjectSerializer &serializer, const uint8_t *data, size_t size,
+                                   PyObject *buffers, ZSTD_DCtx *dctx = nullptr,
+                                   const ZSTD_DDict *dictionary = nullptr) {
+    std::optional<pyser::SerializedGraph> graph;
+    {
+        pyser::AllowThreads nogil(size >= pyser::ALLOW_THREADS_MIN_SIZE);
+        graph.emplace(pyser::SerializedGraph::from_bytes(data, size, dctx, dictionary));
+    }
+    PyObject *res = serializer.deserialize(*graph, buffers);
+    if (PyErr_Occurred()) {
+        Py_XDECREF(res);
+        return nullptr;
+    }
+    return res;
+}
+
+// Decode either format; wire data is recognised by its magic, anything else
+// is treated as a graph.
+static PyObject *deserialize_from_bytes(const uint8_t *data, size_t size, PyObject *buffers = nullptr) {
+    if (pyser::is_wire_format(data, size)) {
+        pyser::WireDecoder decoder;
+        return decoder.decode(data, size, buffers);
+    }
+    pyser::PyObjectSerializer serializer;
+    return deserialize_graph(serializer, data, size, buffers);
+}
+
+static bool check_buffer_callback(PyObject *buffer_callback) {
+    if (buffer_callback != Py_None && !PyCallable_Check(buffer_callback)) {
+        PyErr_SetString(PyExc_TypeError, "buffer_callback must be callable or None");
+        return false;
+    }
+    return true;
+}
+
+static PyObject *py_serialize(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *kwlist[] = {"obj", "max_depth", "format", "buffer_callback", nullptr};
     PyObject *obj;
-    if (!PyArg_ParseTuple(args, "O", &obj)) {
+    Py_ssize_t max_depth = static_cast<Py_ssize_t>(pyser::DEFAULT_MAX_DEPTH);
+    const char *format = "wire";
+    PyObject *buffer_callback = Py_None;
+    bool wire;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|nsO", const_cast<char **>(kwlist), &obj, &max_depth,
+                                     &format, &buffer_callback)) {
+        return nullptr;
+    }
+    if (!check_serialize_args(max_depth, format, wire)) {
+        return nullptr;
+    }
+    if (!check_buffer_callback(buffer_callback)) {
         return nullptr;
     }
     try {
-        pyser::PyObjectSerializer serializer;
-        pyser::SerializedGraph graph = serializer.serialize(obj);
-
-        std::vector<uint8_t> bytes = graph.to_bytes();
+        std::vector<uint8_t> bytes = serialize_to_bytes(obj, max_depth, wire, buffer_callback);
 
         return PyBytes_FromStringAndSize(
             reinterpret_cast<const char *>(bytes.data()),
             bytes.size()
         );
     } catch (const std::exception &e) {
-        PyErr_SetString(PyExc_RuntimeError, e.what());
+        set_error_from_exception(e);
         return nullptr;
     }
 }
 
-static PyObject *py_deserialize(PyObject *self, PyObject *args) {
+static PyObject *py_deserialize(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *kwlist[] = {"data", "buffers", nullptr};
     PyObject *py_bytes;
-    if (!PyArg_ParseTuple(args, "O", &py_bytes)) {
+    PyObject *buffers = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", const_cast<char **>(kwlist), &py_bytes, &buffers)) {
         return nullptr;
     }
     if (!PyBytes_Check(py_bytes)) {
@@ -44,48 +162,55 @@ static PyObject *py_deserialize(PyObject *self, PyObject *args) {
         const char *data = PyBytes_AsString(py_bytes);
         Py_ssize_t size = PyBytes_Size(py_bytes);
 
-        std::vector<uint8_t> bytes(data, data + size);
-        pyser::SerializedGraph graph = pyser::SerializedGraph::from_bytes(bytes);
-
-        pyser::PyObjectSerializer serializer;
-        PyObject *res = serializer.deserialize(graph);
-        if (PyErr_Occurred()) {
-            Py_XDECREF(res);
-            return nullptr;
-        }
-        return res;
+        return deserialize_from_bytes(reinterpret_cast<const uint8_t *>(data), size, buffers);
     } catch (const std::exception &e) {
-        PyErr_SetString(PyExc_RuntimeError, e.what());
+        set_error_from_exception(e);
         return nullptr;
     }
 }
 
-static PyObject *py_serialize_to_file(PyObject *self, PyObject *args) {
+static PyObject *py_serialize_to_file(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *kwlist[] = {"obj", "filename", "max_depth", "format", nullptr};
     PyObject *obj;
     const char *filename;
+    Py_ssize_t max_depth = static_cast<Py_ssize_t>(pyser::DEFAULT_MAX_DEPTH);
+    const char *format = "wire";
+    bool wire;
 
-    if (!PyArg_ParseTuple(args, "Os", &obj, &filename)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Os|ns", const_cast<char **>(kwlist), &obj, &filename,
+                                     &max_depth, &format)) {
+        return nullptr;
+    }
+    if (!check_serialize_args(max_depth, format, wire)) {
         return nullptr;
     }
     try {
-        pyser::PyObjectSerializer serializer;
-        pyser::SerializedGraph graph = serializer.serialize(obj);
-
-        std::vector<uint8_t> bytes = graph.to_bytes();
-        FILE *fp = fopen(filename, "wb");
+        std::vector<uint8_t> bytes = serialize_to_bytes(obj, max_depth, wire);
+        FILE *fp;
+        size_t written = 0;
+        int error = 0;
+        {
+            pyser::AllowThreads nogil;
+            fp = fopen(filename, "wb");
+            if (fp) {
+                written = fwrite(bytes.data(), 1, bytes.size(), fp);
+                fclose(fp);
+            } else {
+                error = errno;
+            }
+        }
         if (!fp) {
+            errno = error;
             PyErr_SetFromErrno(PyExc_OSError);
             return nullptr;
         }
-        size_t written = fwrite(bytes.data(), 1, bytes.size(), fp);
-        fclose(fp);
         if (written != bytes.size()) {
             PyErr_SetString(PyExc_IOError, "Failed to write all data");
             return nullptr;
         }
         Py_RETURN_NONE;
     } catch (const std::exception &e) {
-        PyErr_SetString(PyExc_RuntimeError, e.what());
+        set_error_from_exception(e);
         return nullptr;
     }
 }
@@ -96,46 +221,339 @@ static PyObject *py_deserialize_from_file(PyObject *self, PyObject *args) {
         return nullptr;
     }
     try {
-        FILE *fp = fopen(filename, "rb");
-        if (!fp) {
+        bool opened;
+        long file_size = 0;
+        size_t read_size = 0;
+        int error = 0;
+        std::vector<uint8_t> bytes;
+        {
+            pyser::AllowThreads nogil;
+            // Closed on every way out, the resize below throwing included.
+            std::unique_ptr<FILE, decltype(&fclose)> fp(fopen(filename, "rb"), &fclose);
+            opened = fp != nullptr;
+            if (!fp || fseek(fp.get(), 0, SEEK_END) != 0 || (file_size = ftell(fp.get())) < 0 ||
+                fseek(fp.get(), 0, SEEK_SET) != 0) {
+                error = errno;
+            } else {
+                bytes.resize(file_size);
+                read_size = fread(bytes.data(), 1, file_size, fp.get());
+            }
+        }
+        if (!opened || error) {
+            errno = error;
             PyErr_SetFromErrno(PyExc_OSError);
             return nullptr;
         }
-        fseek(fp, 0, SEEK_END);
-        long file_size = ftell(fp);
-        fseek(fp, 0, SEEK_SET);
-        std::vector<uint8_t> bytes(file_size);
-        size_t read_size = fread(bytes.data(), 1, file_size, fp);
-        fclose(fp);
         if (read_size != static_cast<size_t>(file_size)) {
             PyErr_SetString(PyExc_IOError, "Failed to read all data");
             return nullptr;
         }
-        pyser::SerializedGraph graph = pyser::SerializedGraph::from_bytes(bytes);
-        pyser::PyObjectSerializer serializer;
-        return serializer.deserialize(graph);
+        return deserialize_from_bytes(bytes.data(), bytes.size());
     } catch (const std::exception &e) {
-        PyErr_SetString(PyExc_RuntimeError, e.what());
+        set_error_from_exception(e);
         return nullptr;
     }
 }
 
+// Serializer and Deserializer: the state of serialize/deserialize kept across
+// calls. Each owns its zstd context, output buffer, type plans, schema and
+// class caches and optional zstd dictionary, so a stream of small messages
+// does not pay to rebuild them on every call. An instance is used by one
+// thread at a time; a second call while one is running (from another thread
+// while the GIL is released, or from a callback) raises RuntimeError.
+
+// Marks an instance busy for the duration of one call.
+class InUse {
+public:
+    InUse(bool &busy, const char *type_name) : busy_(busy), entered_(!busy) {
+        if (entered_) {
+            busy_ = true;
+        } else {
+            PyErr_Format(PyExc_RuntimeError, "%s is already in use; use one instance per thread", type_name);
+        }
+    }
+
+    InUse(const InUse &) = delete;
+
+    InUse &operator=(const InUse &) = delete;
+
+    ~InUse() {
+        if (entered_) busy_ = false;
+    }
+
+    explicit operator bool() const { return entered_; }
+
+private:
+    bool &busy_;
+    bool entered_;
+};
+
+// Copy of the zstd dictionary given as `dictionary`, or nullptr for None.
+// Returns false with a Python error set.
+template<typename Dict, typename Create>
+static bool make_dictionary(PyObject *dictionary, Dict *&out, Create create) {
+    if (dictionary == Py_None) return true;
+    Py_buffer view;
+    if (PyObject_GetBuffer(dictionary, &view, PyBUF_SIMPLE) != 0) return false;
+    out = create(view.buf, static_cast<size_t>(view.len));
+    PyBuffer_Release(&view);
+    if (!out) {
+        PyErr_SetString(PyExc_ValueError, "Invalid zstd dictionary");
+        return false;
+    }
+    return true;
+}
+
+struct SerializerObject {
+    PyObject_HEAD
+    bool wire;
+    bool busy;
+    pyser::WireEncoder *encoder;            // "wire" format
+    pyser::PyObjectSerializer *serializer;  // "graph" format
+    ZSTD_CCtx *cctx;                        // "graph" format
+    ZSTD_CDict *dictionary;
+};
+
+static void serializer_release(SerializerObject *self) {
+    delete self->encoder;
+    delete self->serializer;
+    ZSTD_freeCCtx(self->cctx);
+    ZSTD_freeCDict(self->dictionary);
+    self->encoder = nullptr;
+    self->serializer = nullptr;
+    self->cctx = nullptr;
+    self->dictionary = nullptr;
+}
+
+static int Serializer_init(SerializerObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *kwlist[] = {"max_depth", "format", "dictionary", nullptr};
+    Py_ssize_t max_depth = static_cast<Py_ssize_t>(pyser::DEFAULT_MAX_DEPTH);
+    const char *format = "wire";
+    PyObject *dictionary = Py_None;
+    bool wire;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|nsO", const_cast<char **>(kwlist), &max_depth, &format,
+                                     &dictionary)) {
+        return -1;
+    }
+    if (!check_serialize_args(max_depth, format, wire)) {
+        return -1;
+    }
+    InUse in_use(self->busy, "Serializer");
+    if (!in_use) return -1;
+    serializer_release(self);
+    self->wire = wire;
+    if (!make_dictionary(dictionary, self->dictionary, [](const void *data, size_t size) {
+        return ZSTD_createCDict(data, size, pyser::WIRE_COMPRESSION_LEVEL);
+    })) {
+        return -1;
+    }
+    try {
+        if (wire) {
+            self->encoder = new pyser::WireEncoder(static_cast<size_t>(max_depth));
+            if (self->dictionary) self->encoder->set_dictionary(self->dictionary);
+        } else {
+            self->serializer = new pyser::PyObjectSerializer(static_cast<size_t>(max_depth));
+            self->cctx = ZSTD_createCCtx();
+            if (!self->cctx) throw std::runtime_error("Failed to create zstd compression context");
+        }
+    } catch (const std::exception &e) {
+        serializer_release(self);
+        set_error_from_exception(e);
+        return -1;
+    }
+    return 0;
+}
+
+static void Serializer_dealloc(SerializerObject *self) {
+    serializer_release(self);
+    PyTypeObject *type = Py_TYPE(self);
+    type->tp_free(self);
+    Py_DECREF(type);
+}
+
+static PyObject *Serializer_serialize(SerializerObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *kwlist[] = {"obj", "buffer_callback", nullptr};
+    PyObject *obj;
+    PyObject *buffer_callback = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", const_cast<char **>(kwlist), &obj, &buffer_callback)) {
+        return nullptr;
+    }
+    if (!check_buffer_callback(buffer_callback)) {
+        return nullptr;
+    }
+    if (!self->encoder && !self->serializer) {
+        PyErr_SetString(PyExc_RuntimeError, "Serializer was not initialized");
+        return nullptr;
+    }
+    InUse in_use(self->busy, "Serializer");
+    if (!in_use) return nullptr;
+    try {
+        if (self->wire) {
+            std::span<const uint8_t> bytes = self->encoder->encode_in_place(obj, buffer_callback);
+            PyObject *res = PyBytes_FromStringAndSize(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+            self->encoder->trim();
+            return res;
+        }
+        std::vector<uint8_t> bytes = serialize_graph(*self->serializer, obj, buffer_callback, self->cctx,
+                                                     self->dictionary);
+        return PyBytes_FromStringAndSize(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    } catch (const std::exception &e) {
+        set_error_from_exception(e);
+        return nullptr;
+    }
+}
+
+static PyMethodDef serializer_methods[] = {
+    {
+        "serialize", reinterpret_cast<PyCFunction>(Serializer_serialize), METH_VARARGS | METH_KEYWORDS,
+        "Serialize Python object to bytes, as the module-level serialize() with this "
+        "serializer's max_depth, format and dictionary"
+    },
+    {nullptr, nullptr, 0, nullptr}
+};
+
+static PyType_Slot serializer_slots[] = {
+    {
+        Py_tp_doc, const_cast<char *>(
+            "Serializer(max_depth=0, format='wire', dictionary=None)\n\n"
+            "Reusable serializer: keeps its zstd context, buffers and caches between calls. "
+            "dictionary is an optional zstd dictionary; the data can then only be read by a "
+            "Deserializer given the same dictionary. Use one instance per thread.")
+    },
+    {Py_tp_new, reinterpret_cast<void *>(PyType_GenericNew)},
+    {Py_tp_init, reinterpret_cast<void *>(Serializer_init)},
+    {Py_tp_dealloc, reinterpret_cast<void *>(Serializer_dealloc)},
+    {Py_tp_methods, serializer_methods},
+    {0, nullptr}
+};
+
+static PyType_Spec serializer_spec = {
+    "pyser.Serializer", sizeof(SerializerObject), 0, Py_TPFLAGS_DEFAULT, serializer_slots
+};
+
+// Contexts are created on first use, since most callers only read one of the
+// two formats.
+struct DeserializerObject {
+    PyObject_HEAD
+    bool busy;
+    pyser::WireDecoder *decoder;            // "wire" format
+    pyser::PyObjectSerializer *serializer;  // "graph" format
+    ZSTD_DCtx *dctx;                        // "graph" format
+    ZSTD_DDict *dictionary;
+};
+
+static void deserializer_release(DeserializerObject *self) {
+    delete self->decoder;
+    delete self->serializer;
+    ZSTD_freeDCtx(self->dctx);
+    ZSTD_freeDDict(self->dictionary);
+    self->decoder = nullptr;
+    self->serializer = nullptr;
+    self->dctx = nullptr;
+    self->dictionary = nullptr;
+}
+
+static int Deserializer_init(DeserializerObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *kwlist[] = {"dictionary", nullptr};
+    PyObject *dictionary = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", const_cast<char **>(kwlist), &dictionary)) {
+        return -1;
+    }
+    InUse in_use(self->busy, "Deserializer");
+    if (!in_use) return -1;
+    deserializer_release(self);
+    return make_dictionary(dictionary, self->dictionary, ZSTD_createDDict) ? 0 : -1;
+}
+
+static void Deserializer_dealloc(DeserializerObject *self) {
+    deserializer_release(self);
+    PyTypeObject *type = Py_TYPE(self);
+    type->tp_free(self);
+    Py_DECREF(type);
+}
+
+static PyObject *Deserializer_deserialize(DeserializerObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *kwlist[] = {"data", "buffers", nullptr};
+    PyObject *py_bytes;
+    PyObject *buffers = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", const_cast<char **>(kwlist), &py_bytes, &buffers)) {
+        return nullptr;
+    }
+    if (!PyBytes_Check(py_bytes)) {
+        PyErr_SetString(PyExc_TypeError, "Expected bytes");
+        return nullptr;
+    }
+    InUse in_use(self->busy, "Deserializer");
+    if (!in_use) return nullptr;
+    const auto *data = reinterpret_cast<const uint8_t *>(PyBytes_AS_STRING(py_bytes));
+    auto size = static_cast<size_t>(PyBytes_GET_SIZE(py_bytes));
+    try {
+        if (pyser::is_wire_format(data, size)) {
+            if (!self->decoder) {
+                self->decoder = new pyser::WireDecoder();
+                if (self->dictionary) self->decoder->set_dictionary(self->dictionary);
+            }
+            return self->decoder->decode(data, size, buffers);
+        }
+        if (!self->serializer) {
+            self->dctx = ZSTD_createDCtx();
+            if (!self->dctx) throw std::runtime_error("Failed to create zstd decompression context");
+            self->serializer = new pyser::PyObjectSerializer();
+        }
+        return deserialize_graph(*self->serializer, data, size, buffers, self->dctx, self->dictionary);
+    } catch (const std::exception &e) {
+        set_error_from_exception(e);
+        return nullptr;
+    }
+}
+
+static PyMethodDef deserializer_methods[] = {
+    {
+        "deserialize", reinterpret_cast<PyCFunction>(Deserializer_deserialize), METH_VARARGS | METH_KEYWORDS,
+        "Deserialize Python object from bytes (either format), as the module-level deserialize()"
+    },
+    {nullptr, nullptr, 0, nullptr}
+};
+
+static PyType_Slot deserializer_slots[] = {
+    {
+        Py_tp_doc, const_cast<char *>(
+            "Deserializer(dictionary=None)\n\n"
+            "Reusable deserializer: keeps its zstd contexts, buffers and class cache between "
+            "calls. dictionary is the zstd dictionary the data was written with, if any; data "
+            "written without one is read either way. Use one instance per thread.")
+    },
+    {Py_tp_new, reinterpret_cast<void *>(PyType_GenericNew)},
+    {Py_tp_init, reinterpret_cast<void *>(Deserializer_init)},
+    {Py_tp_dealloc, reinterpret_cast<void *>(Deserializer_dealloc)},
+    {Py_tp_methods, deserializer_methods},
+    {0, nullptr}
+};
+
+static PyType_Spec deserializer_spec = {
+    "pyser.Deserializer", sizeof(DeserializerObject), 0, Py_TPFLAGS_DEFAULT, deserializer_slots
+};
+
 static PyMethodDef methods[] = {
     {
-        "serialize", py_serialize, METH_VARARGS,
-        "Serialize Python object to bytes"
+        "serialize", reinterpret_cast<PyCFunction>(py_serialize), METH_VARARGS | METH_KEYWORDS,
+        "Serialize Python object to bytes. max_depth limits nesting (0 = unlimited); "
+        "format is 'wire' (default) or 'graph'; buffer_callback receives large buffers "
+        "as PickleBuffer and leaves them out of band when it returns a false value"
     },
     {
-        "deserialize", py_deserialize, METH_VARARGS,
-        "Deserialize Python object from bytes"
+        "deserialize", reinterpret_cast<PyCFunction>(py_deserialize), METH_VARARGS | METH_KEYWORDS,
+        "Deserialize Python object from bytes (either format); buffers are the out-of-band "
+        "buffers, in the order buffer_callback received them"
     },
     {
-        "serialize_to_file", py_serialize_to_file, METH_VARARGS,
-        "Serialize Python object and save to file"
+        "serialize_to_file", reinterpret_cast<PyCFunction>(py_serialize_to_file), METH_VARARGS | METH_KEYWORDS,
+        "Serialize Python object and save to file. max_depth limits nesting (0 = unlimited); "
+        "format is 'wire' (default) or 'graph'"
     },
     {
         "deserialize_from_file", py_deserialize_from_file, METH_VARARGS,
-        "Deserialize Python object from file"
+        "Deserialize Python object from file (either format)"
     },
     {nullptr, nullptr, 0, nullptr}
 };
@@ -148,6 +566,23 @@ static struct PyModuleDef module = {
     methods
 };
 
+// Add the type built from `spec` to `module` under `name`.
+static bool add_type(PyObject *module, PyType_Spec *spec, const char *name) {
+    PyObject *type = PyType_FromSpec(spec);
+    if (!type) return false;
+    if (PyModule_AddObject(module, name, type) != 0) {
+        Py_DECREF(type);
+        return false;
+    }
+    return true;
+}
+
 PyMODINIT_FUNC PyInit_pyser(void) {
-    return PyModule_Create(&module);
+    PyObject *m = PyModule_Create(&module);
+    if (!m) return nullptr;
+    if (!add_type(m, &serializer_spec, "Serializer") || !add_type(m, &deserializer_spec, "Deserializer")) {
+        Py_DECREF(m);
+        return nullptr;
+    }
+    return m;
 }
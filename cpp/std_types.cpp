@@ -0,0 +1,487 @@
+// std_types.cpp
+// Classification and payload encoding of the standard library types handled
+// natively by both formats (see std_types.h).
+#include "std_types.h"
+#include "packed_array.h"
+#include <datetime.h>
+#include <cstring>
+
+namespace pyser {
+    namespace {
+        // Classes resolved once per process; nullptr where the module could not
+        // be imported.
+        struct StdTypes {
+            PyTypeObject *timezone = nullptr;
+            PyObject *decimal = nullptr;
+            PyObject *uuid = nullptr;
+            PyObject *safe_uuid[3] = {};  // SafeUUID.unknown, safe, unsafe
+            PyObject *enum_meta = nullptr;
+            PyObject *deque = nullptr;
+            PyObject *ordered_dict = nullptr;
+            PyObject *default_dict = nullptr;
+            PyObject *counter = nullptr;
+            PyObject *int_name = nullptr;
+            PyObject *is_safe_name = nullptr;
+        };
+
+        StdTypes types;
+        bool loaded = false;
+
+        PyObject *import_attr(const char *module_name, const char *name) {
+            PyObject *module = PyImport_ImportModule(module_name);
+            PyObject *attr = module ? PyObject_GetAttrString(module, name) : nullptr;
+            Py_XDECREF(module);
+            if (!attr) PyErr_Clear();
+            return attr;
+        }
+
+        // Import the stdlib classes the first time they are needed. Imports can
+        // run other threads, so the results are only published once complete.
+        void load() {
+            if (loaded) return;
+            PyObject *type, *value, *traceback;
+            PyErr_Fetch(&type, &value, &traceback);
+            StdTypes found;
+            if (!PyDateTimeAPI) PyDateTime_IMPORT;
+            if (PyDateTimeAPI) {
+                found.timezone = Py_TYPE(PyDateTimeAPI->TimeZone_UTC);
+            } else {
+                PyErr_Clear();
+            }
+            found.decimal = import_attr("decimal", "Decimal");
+            found.uuid = import_attr("uuid", "UUID");
+            PyObject *safe = import_attr("uuid", "SafeUUID");
+            if (safe) {
+                const char *names[3] = {"unknown", "safe", "unsafe"};
+                for (int i = 0; i < 3; i++) {
+                    found.safe_uuid[i] = PyObject_GetAttrString(safe, names[i]);
+                    if (!found.safe_uuid[i]) PyErr_Clear();
+                }
+                Py_DECREF(safe);
+            }
+            found.enum_meta = import_attr("enum", "EnumMeta");
+            found.deque = import_attr("collections", "deque");
+            found.ordered_dict = import_attr("collections", "OrderedDict");
+            found.default_dict = import_attr("collections", "defaultdict");
+            found.counter = import_attr("collections", "Counter");
+            found.int_name = PyUnicode_InternFromString("int");
+            found.is_safe_name = PyUnicode_InternFromString("is_safe");
+            PyErr_Clear();
+            if (!loaded) {
+                types = found;
+                loaded = true;
+            }
+            PyErr_Restore(type, value, traceback);
+        }
+
+        bool is(PyTypeObject *type, PyObject *cls) {
+            return cls && reinterpret_cast<PyObject *>(type) == cls;
+        }
+
+        void put_u8(std::vector<uint8_t> &out, uint64_t value) { out.push_back(static_cast<uint8_t>(value)); }
+
+        void put_le(std::vector<uint8_t> &out, uint64_t value, int size) {
+            for (int i = 0; i < size; i++) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+
+        // Bounds-checked cursor over a payload; any overrun fails the read.
+        struct Reader {
+            const uint8_t *data;
+            size_t size;
+            size_t pos = 0;
+            bool ok = true;
+
+            uint64_t le(int n) {
+                if (size - pos < static_cast<size_t>(n)) {
+                    ok = false;
+                    return 0;
+                }
+                uint64_t value = 0;
+                for (int i = 0; i < n; i++) value |= static_cast<uint64_t>(data[pos++]) << (8 * i);
+                return value;
+            }
+
+            uint64_t varint() {
+                const uint8_t *p = data + pos;
+                uint64_t value = 0;
+                if (!ok || !parse_varint(p, data + size, value)) ok = false;
+                pos = p - data;
+                return value;
+            }
+
+            [[nodiscard]] bool done() const { return ok && pos == size; }
+        };
+
+        // Fixed-offset timezone of a time or datetime; `native` is false for
+        // any other tzinfo.
+        bool pack_tz(PyObject *tz, std::vector<uint8_t> &out, bool &native) {
+            if (tz == Py_None) {
+                put_u8(out, 0);
+                return true;
+            }
+            if (Py_TYPE(tz) != types.timezone) {
+                native = false;
+                return true;
+            }
+            // (offset,) or (offset, name), as pickle stores a timezone.
+            PyObject *args = PyObject_CallMethod(tz, "__getinitargs__", nullptr);
+            if (!args) return false;
+            bool ok = PyTuple_Check(args) && PyTuple_GET_SIZE(args) >= 1 && PyTuple_GET_SIZE(args) <= 2 &&
+                      PyDelta_Check(PyTuple_GET_ITEM(args, 0));
+            if (!ok) {
+                native = false;
+                Py_DECREF(args);
+                return true;
+            }
+            PyObject *offset = PyTuple_GET_ITEM(args, 0);
+            int64_t micros = (static_cast<int64_t>(PyDateTime_DELTA_GET_DAYS(offset)) * 86400 +
+                              PyDateTime_DELTA_GET_SECONDS(offset)) * 1000000 +
+                             PyDateTime_DELTA_GET_MICROSECONDS(offset);
+            bool named = PyTuple_GET_SIZE(args) == 2;
+            Py_ssize_t name_size = 0;
+            const char *name = named ? PyUnicode_AsUTF8AndSize(PyTuple_GET_ITEM(args, 1), &name_size) : nullptr;
+            if (named && !name) {
+                Py_DECREF(args);
+                return false;
+            }
+            put_u8(out, named ? 2 : 1);
+            append_varint(out, zigzag(micros));
+            if (named) {
+                append_varint(out, name_size);
+                out.insert(out.end(), name, name + name_size);
+            }
+            Py_DECREF(args);
+            return true;
+        }
+
+        // New reference to the tzinfo read from `in`: None or a timezone.
+        PyObject *unpack_tz(Reader &in) {
+            uint64_t flag = in.le(1);
+            if (in.ok && flag == 0) Py_RETURN_NONE;
+            int64_t micros = unzigzag(in.varint());
+            PyObject *name = nullptr;
+            if (in.ok && flag == 2) {
+                uint64_t size = in.varint();
+                if (in.ok && size <= in.size - in.pos) {
+                    name = PyUnicode_DecodeUTF8(reinterpret_cast<const char *>(in.data + in.pos), size, "strict");
+                    if (!name) return nullptr;
+                    in.pos += size;
+                } else {
+                    in.ok = false;
+                }
+            }
+            // Timezone offsets are strictly within one day.
+            if (!in.ok || flag > 2 || micros <= -86400000000LL || micros >= 86400000000LL) {
+                Py_XDECREF(name);
+                PyErr_SetString(PyExc_ValueError, "Invalid timezone in serialized data");
+                return nullptr;
+            }
+            PyObject *offset = PyDateTimeAPI->Delta_FromDelta(0, static_cast<int>(micros / 1000000),
+                                                              static_cast<int>(micros % 1000000), 1,
+                                                              PyDateTimeAPI->DeltaType);
+            PyObject *tz = offset ? PyDateTimeAPI->TimeZone_FromTimeZone(offset, name) : nullptr;
+            Py_XDECREF(offset);
+            Py_XDECREF(name);
+            return tz;
+        }
+
+        bool pack_uuid(PyObject *obj, std::vector<uint8_t> &out, bool &native) {
+            PyObject *value = PyObject_GetAttr(obj, types.int_name);
+            if (!value) return false;
+            uint8_t raw[16];
+            auto *long_obj = reinterpret_cast<PyLongObject *>(value);
+#if PY_VERSION_HEX >= 0x030D0000
+            int rc = PyLong_Check(value) ? _PyLong_AsByteArray(long_obj, raw, 16, 0, 0, 1) : -1;
+#else
+            int rc = PyLong_Check(value) ? _PyLong_AsByteArray(long_obj, raw, 16, 0, 0) : -1;
+#endif
+            Py_DECREF(value);
+            if (rc < 0) {
+                PyErr_Clear();
+                native = false;
+                return true;
+            }
+            PyObject *safe = PyObject_GetAttr(obj, types.is_safe_name);
+            if (!safe) return false;
+            int index = -1;
+            for (int i = 0; i < 3; i++) {
+                if (safe == types.safe_uuid[i]) index = i;
+            }
+            Py_DECREF(safe);
+            if (index < 0) {
+                native = false;
+                return true;
+            }
+            out.insert(out.end(), raw, raw + 16);
+            put_u8(out, index);
+            return true;
+        }
+
+        PyObject *unpack_uuid(Reader &in) {
+            if (in.size != 17 || in.data[16] > 2 || !types.safe_uuid[in.data[16]]) {
+                PyErr_SetString(PyExc_ValueError, "Invalid UUID in serialized data");
+                return nullptr;
+            }
+            PyObject *value = _PyLong_FromByteArray(in.data, 16, 0, 0);
+            if (!value) return nullptr;
+            // Built the way UUID.__setstate__ does it: UUID.__setattr__ refuses
+            // all assignments.
+            auto *type = reinterpret_cast<PyTypeObject *>(types.uuid);
+            PyObject *obj = type->tp_alloc(type, 0);
+            if (obj && (PyObject_GenericSetAttr(obj, types.int_name, value) < 0 ||
+                        PyObject_GenericSetAttr(obj, types.is_safe_name, types.safe_uuid[in.data[16]]) < 0)) {
+                Py_CLEAR(obj);
+            }
+            Py_DECREF(value);
+            return obj;
+        }
+
+        bool pack_range(PyObject *obj, std::vector<uint8_t> &out) {
+            const char *names[3] = {"start", "stop", "step"};
+            for (const char *name: names) {
+                PyObject *value = PyObject_GetAttrString(obj, name);
+                if (!value) return false;
+                // One extra bit for the sign of the two's complement encoding.
+                size_t n_bytes = _PyLong_NumBits(value) / 8 + 1;
+                append_varint(out, n_bytes);
+                size_t pos = out.size();
+                out.resize(pos + n_bytes);
+                auto *long_obj = reinterpret_cast<PyLongObject *>(value);
+#if PY_VERSION_HEX >= 0x030D0000
+                int rc = _PyLong_AsByteArray(long_obj, out.data() + pos, n_bytes, 1, 1, 1);
+#else
+                int rc = _PyLong_AsByteArray(long_obj, out.data() + pos, n_bytes, 1, 1);
+#endif
+                Py_DECREF(value);
+                if (rc < 0) return false;
+            }
+            return true;
+        }
+    } // namespace
+
+    StdKind std_type_kind(PyTypeObject *type) {
+        if (type == &PyComplex_Type) return StdKind::COMPLEX;
+        if (type == &PyRange_Type) return StdKind::RANGE;
+        load();
+        if (PyDateTimeAPI) {
+            if (type == PyDateTimeAPI->DateTimeType) return StdKind::DATETIME;
+            if (type == PyDateTimeAPI->DateType) return StdKind::DATE;
+            if (type == PyDateTimeAPI->TimeType) return StdKind::TIME;
+            if (type == PyDateTimeAPI->DeltaType) return StdKind::TIMEDELTA;
+        }
+        if (is(type, types.decimal)) return StdKind::DECIMAL;
+        if (is(type, types.uuid)) return StdKind::UUID;
+        if (is(type, types.deque)) return StdKind::DEQUE;
+        if (is(type, types.ordered_dict)) return StdKind::ORDERED_DICT;
+        if (is(type, types.default_dict)) return StdKind::DEFAULT_DICT;
+        if (is(type, types.counter)) return StdKind::COUNTER;
+        if (is_enum_type(type)) return StdKind::ENUM;
+        return StdKind::NONE;
+    }
+
+    bool is_enum_type(PyTypeObject *type) {
+        load();
+        return types.enum_meta &&
+               PyType_IsSubtype(Py_TYPE(type), reinterpret_cast<PyTypeObject *>(types.enum_meta));
+    }
+
+    PyObject *std_type(StdKind kind) {
+        load();
+        PyObject *cls = nullptr;
+        switch (kind) {
+            case StdKind::DECIMAL: cls = types.decimal; break;
+            case StdKind::UUID: cls = types.uuid; break;
+            case StdKind::DEQUE: cls = types.deque; break;
+            case StdKind::ORDERED_DICT: cls = types.ordered_dict; break;
+            case StdKind::DEFAULT_DICT: cls = types.default_dict; break;
+            case StdKind::COUNTER: cls = types.counter; break;
+            case StdKind::COMPLEX: cls = reinterpret_cast<PyObject *>(&PyComplex_Type); break;
+            case StdKind::RANGE: cls = reinterpret_cast<PyObject *>(&PyRange_Type); break;
+            case StdKind::DATETIME:
+            case StdKind::DATE:
+            case StdKind::TIME:
+            case StdKind::TIMEDELTA:
+                if (!PyDateTimeAPI) break;
+                cls = reinterpret_cast<PyObject *>(
+                    kind == StdKind::DATETIME ? PyDateTimeAPI->DateTimeType
+                    : kind == StdKind::DATE ? PyDateTimeAPI->DateType
+                    : kind == StdKind::TIME ? PyDateTimeAPI->TimeType
+                    : PyDateTimeAPI->DeltaType);
+                break;
+            default:
+                break;
+        }
+        if (!cls) {
+            PyErr_Format(PyExc_ImportError, "Standard library type %d is not available",
+                         static_cast<int>(kind));
+        }
+        return cls;
+    }
+
+    bool pack_std_value(StdKind kind, PyObject *obj, std::vector<uint8_t> &out, bool &native) {
+        native = true;
+        size_t start = out.size();
+        bool ok = true;
+        switch (kind) {
+            case StdKind::DATE:
+            case StdKind::DATETIME:
+                put_le(out, PyDateTime_GET_YEAR(obj), 2);
+                put_u8(out, PyDateTime_GET_MONTH(obj));
+                put_u8(out, PyDateTime_GET_DAY(obj));
+                if (kind == StdKind::DATE) break;
+                put_u8(out, PyDateTime_DATE_GET_HOUR(obj));
+                put_u8(out, PyDateTime_DATE_GET_MINUTE(obj));
+                put_u8(out, PyDateTime_DATE_GET_SECOND(obj));
+                put_le(out, PyDateTime_DATE_GET_MICROSECOND(obj), 3);
+                put_u8(out, PyDateTime_DATE_GET_FOLD(obj));
+                ok = pack_tz(PyDateTime_DATE_GET_TZINFO(obj), out, native);
+                break;
+            case StdKind::TIME:
+                put_u8(out, PyDateTime_TIME_GET_HOUR(obj));
+                put_u8(out, PyDateTime_TIME_GET_MINUTE(obj));
+                put_u8(out, PyDateTime_TIME_GET_SECOND(obj));
+                put_le(out, PyDateTime_TIME_GET_MICROSECOND(obj), 3);
+                put_u8(out, PyDateTime_TIME_GET_FOLD(obj));
+                ok = pack_tz(PyDateTime_TIME_GET_TZINFO(obj), out, native);
+                break;
+            case StdKind::TIMEDELTA:
+                put_le(out, static_cast<uint32_t>(PyDateTime_DELTA_GET_DAYS(obj)), 4);
+                put_le(out, PyDateTime_DELTA_GET_SECONDS(obj), 4);
+                put_le(out, PyDateTime_DELTA_GET_MICROSECONDS(obj), 4);
+                break;
+            case StdKind::DECIMAL: {
+                PyObject *text = PyObject_Str(obj);
+                Py_ssize_t size;
+                const char *data = text ? PyUnicode_AsUTF8AndSize(text, &size) : nullptr;
+                if (data) out.insert(out.end(), data, data + size);
+                ok = data != nullptr;
+                Py_XDECREF(text);
+                break;
+            }
+            case StdKind::COMPLEX: {
+                Py_complex value = PyComplex_AsCComplex(obj);
+                uint64_t bits[2];
+                std::memcpy(&bits[0], &value.real, sizeof(double));
+                std::memcpy(&bits[1], &value.imag, sizeof(double));
+                put_le(out, bits[0], 8);
+                put_le(out, bits[1], 8);
+                break;
+            }
+            case StdKind::RANGE:
+                ok = pack_range(obj, out);
+                break;
+            case StdKind::UUID:
+                ok = pack_uuid(obj, out, native);
+                break;
+            default:
+                native = false;
+                break;
+        }
+        if (!ok || !native) out.resize(start);
+        return ok;
+    }
+
+    PyObject *unpack_std_value(StdKind kind, const uint8_t *data, size_t size) {
+        if (!std_type(kind)) return nullptr;
+        Reader in{data, size};
+        PyObject *value = nullptr;
+        switch (kind) {
+            case StdKind::DATE:
+            case StdKind::DATETIME: {
+                auto year = static_cast<int>(in.le(2));
+                auto month = static_cast<int>(in.le(1));
+                auto day = static_cast<int>(in.le(1));
+                if (kind == StdKind::DATE) {
+                    if (!in.done()) break;
+                    return PyDateTimeAPI->Date_FromDate(year, month, day, PyDateTimeAPI->DateType);
+                }
+                auto hour = static_cast<int>(in.le(1));
+                auto minute = static_cast<int>(in.le(1));
+                auto second = static_cast<int>(in.le(1));
+                auto micro = static_cast<int>(in.le(3));
+                auto fold = static_cast<int>(in.le(1));
+                if (!in.ok) break;
+                PyObject *tz = unpack_tz(in);
+                if (!tz) return nullptr;
+                if (in.done()) {
+                    value = PyDateTimeAPI->DateTime_FromDateAndTimeAndFold(
+                        year, month, day, hour, minute, second, micro, tz, fold, PyDateTimeAPI->DateTimeType);
+                }
+                Py_DECREF(tz);
+                if (value || PyErr_Occurred()) return value;
+                break;
+            }
+            case StdKind::TIME: {
+                auto hour = static_cast<int>(in.le(1));
+                auto minute = static_cast<int>(in.le(1));
+                auto second = static_cast<int>(in.le(1));
+                auto micro = static_cast<int>(in.le(3));
+                auto fold = static_cast<int>(in.le(1));
+                if (!in.ok) break;
+                PyObject *tz = unpack_tz(in);
+                if (!tz) return nullptr;
+                if (in.done()) {
+                    value = PyDateTimeAPI->Time_FromTimeAndFold(hour, minute, second, micro, tz, fold,
+                                                                PyDateTimeAPI->TimeType);
+                }
+                Py_DECREF(tz);
+                if (value || PyErr_Occurred()) return value;
+                break;
+            }
+            case StdKind::TIMEDELTA: {
+                auto days = static_cast<int32_t>(in.le(4));
+                auto seconds = static_cast<int>(in.le(4));
+                auto micro = static_cast<int>(in.le(4));
+                if (!in.done()) break;
+                return PyDateTimeAPI->Delta_FromDelta(days, seconds, micro, 1, PyDateTimeAPI->DeltaType);
+            }
+            case StdKind::DECIMAL: {
+                PyObject *text = PyUnicode_DecodeASCII(reinterpret_cast<const char *>(data), size, "strict");
+                if (!text) return nullptr;
+                value = PyObject_CallOneArg(types.decimal, text);
+                Py_DECREF(text);
+                return value;
+            }
+            case StdKind::COMPLEX: {
+                uint64_t bits[2] = {in.le(8), in.le(8)};
+                if (!in.done()) break;
+                Py_complex c;
+                std::memcpy(&c.real, &bits[0], sizeof(double));
+                std::memcpy(&c.imag, &bits[1], sizeof(double));
+                return PyComplex_FromCComplex(c);
+            }
+            case StdKind::RANGE: {
+                PyObject *bounds[3] = {};
+                for (auto &bound: bounds) {
+                    uint64_t n_bytes = in.varint();
+                    if (!in.ok || n_bytes == 0 || n_bytes > in.size - in.pos) break;
+                    bound = _PyLong_FromByteArray(in.data + in.pos, n_bytes, 1, 1);
+                    if (!bound) break;
+                    in.pos += n_bytes;
+                }
+                if (bounds[2] && in.done()) {
+                    value = PyObject_CallFunctionObjArgs(reinterpret_cast<PyObject *>(&PyRange_Type),
+                                                         bounds[0], bounds[1], bounds[2], nullptr);
+                }
+                for (PyObject *bound: bounds) Py_XDECREF(bound);
+                if (value || PyErr_Occurred()) return value;
+                break;
+            }
+            case StdKind::UUID:
+                return unpack_uuid(in);
+            default:
+                break;
+        }
+        PyErr_SetString(PyExc_ValueError, "Invalid standard library value in serialized data");
+        return nullptr;
+    }
+
+    PyObject *new_std_container(StdKind kind, Py_ssize_t maxlen) {
+        PyObject *cls = std_type(kind);
+        if (!cls) return nullptr;
+        if (kind == StdKind::DEQUE && maxlen >= 0) {
+            return PyObject_CallFunction(cls, "()n", maxlen);
+        }
+        return PyObject_CallNoArgs(cls);
+    }
+} // namespace pyser
@@ -0,0 +1,86 @@
+// std_types.h
+// Native support for common standard library types, shared by the wire
+// encoder/decoder and the graph serializer: datetime.date, time, datetime and
+// timedelta, decimal.Decimal, complex, range and uuid.UUID ("values", written
+// as one fixed-layout payload each), Enum members, and the collections types
+// deque, OrderedDict, defaultdict and Counter.
+//
+// Notes:
+// - Only exact types are recognised; subclasses may carry extra state and keep
+//   the generic custom-object path. Enum members are the exception: any class
+//   built by EnumMeta counts, int, float and str mixins (IntEnum, IntFlag,
+//   StrEnum) included, so members come back as themselves.
+// - The stdlib classes are imported once per process, on first use.
+// - Value payloads (integers little endian):
+//     DATE       u16 year, u8 month, u8 day
+//     TIME       u8 hour, u8 minute, u8 second, u24 microsecond, u8 fold, tz
+//     DATETIME   the DATE fields, then the TIME fields
+//     tz         u8 0 (naive) | 1 (offset) | 2 (offset and name), then the
+//                offset in microseconds as a zigzag varint and the name as a
+//                varint length plus UTF-8
+//     TIMEDELTA  i32 days, u32 seconds, u32 microseconds
+//     DECIMAL    str() of the value (ASCII)
+//     COMPLEX    two IEEE 754 doubles (real, imaginary)
+//     RANGE      start, stop and step, each as a varint byte count and
+//                signed little-endian bytes
+//     UUID       the 128-bit int big endian, u8 is_safe (0 unknown, 1 safe,
+//                2 unsafe)
+// - A time or datetime whose tzinfo is not a datetime.timezone does not fit
+//   the layout; callers fall back to their generic path for it.
+
+#pragma once
+#include <Python.h>
+#include <cstdint>
+#include <vector>
+
+namespace pyser {
+    enum class StdKind : uint8_t {
+        NONE = 0,
+        DATETIME,
+        DATE,
+        TIME,
+        TIMEDELTA,
+        DECIMAL,
+        COMPLEX,
+        RANGE,
+        UUID,
+        ENUM,           // member of an Enum class, mixins included
+        DEQUE,
+        ORDERED_DICT,
+        DEFAULT_DICT,
+        COUNTER,
+    };
+
+    // True for the kinds written as a single payload by pack_std_value().
+    inline bool is_std_value(StdKind kind) {
+        return kind >= StdKind::DATETIME && kind <= StdKind::UUID;
+    }
+
+    // Kind of the instances of `type`, or NONE if it is not one of the
+    // supported exact types. Never leaves a Python error set.
+    StdKind std_type_kind(PyTypeObject *type);
+
+    inline StdKind std_kind(PyObject *obj) { return std_type_kind(Py_TYPE(obj)); }
+
+    // True if `type` is an Enum class, i.e. its metaclass derives from
+    // enum.EnumMeta. Never leaves a Python error set.
+    bool is_enum_type(PyTypeObject *type);
+
+    // The class behind `kind` (borrowed), or nullptr with a Python error set
+    // if its module cannot be imported.
+    PyObject *std_type(StdKind kind);
+
+    // Append the payload of value `obj` of kind `kind` to `out`. `native` is
+    // false (and nothing is appended) if the value does not fit the layout.
+    // Returns false with a Python error set.
+    bool pack_std_value(StdKind kind, PyObject *obj, std::vector<uint8_t> &out, bool &native);
+
+    // Value of kind `kind` from its payload. Returns a new reference, or
+    // nullptr with a Python error set.
+    PyObject *unpack_std_value(StdKind kind, const uint8_t *data, size_t size);
+
+    // Empty instance of a collections kind (DEQUE, ORDERED_DICT, DEFAULT_DICT,
+    // COUNTER); `maxlen` is the deque bound, or -1 for none. Returns a new
+    // reference, or nullptr with a Python error set.
+    PyObject *new_std_container(StdKind kind, Py_ssize_t maxlen = -1);
+} // namespace pyser
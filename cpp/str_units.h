@@ -0,0 +1,126 @@
+// str_units.h
+// str values stored in their own PEP 393 representation: the Latin-1, UCS-2
+// or UCS-4 code units the string already holds, instead of UTF-8. Shared by
+// the wire encoder/decoder and the graph serializer.
+//
+// Notes:
+// - PyUnicode_AsUTF8AndSize() caches a UTF-8 copy inside every non-ASCII str
+//   it is called on, for the rest of that string's life. Reading the code
+//   units leaves the caller's strings as they were and skips transcoding in
+//   both directions.
+// - ASCII strings are their own UTF-8 and keep their UTF-8 records.
+// - A string is described by a header, its length in code units shifted left
+//   by two with its StrWidth in the low bits, followed by the code units,
+//   little endian.
+// - Decoding goes through PyUnicode_FromKindAndData(), which picks the
+//   narrowest kind itself, so damaged input cannot produce a non-canonical
+//   string. UCS-2/UCS-4 units that are misaligned in the input, or on a big
+//   endian host, are copied out first.
+
+#pragma once
+#include <Python.h>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "packed_array.h"
+
+namespace pyser {
+    enum class StrWidth : uint8_t {
+        ASCII = 0,      // UTF-8 text that is all ASCII
+        LATIN1 = 1,
+        UCS2 = 2,
+        UCS4 = 3,
+    };
+
+    inline size_t unit_size(StrWidth width) {
+        return width == StrWidth::UCS4 ? 4 : width == StrWidth::UCS2 ? 2 : 1;
+    }
+
+    struct StrUnits {
+        const void *data = nullptr;
+        size_t length = 0;      // code units
+        StrWidth width = StrWidth::ASCII;
+
+        [[nodiscard]] size_t size() const { return length * unit_size(width); }
+
+        [[nodiscard]] uint64_t header() const {
+            return static_cast<uint64_t>(length) << 2 | static_cast<uint8_t>(width);
+        }
+    };
+
+    // Code units of an exact or derived str. Returns false with a Python
+    // error set if the string cannot be made ready (3.11 legacy strings).
+    inline bool str_units(PyObject *str, StrUnits &units) {
+#if PY_VERSION_HEX < 0x030C0000
+        if (PyUnicode_READY(str) < 0) return false;
+#endif
+        units.data = PyUnicode_DATA(str);
+        units.length = static_cast<size_t>(PyUnicode_GET_LENGTH(str));
+        switch (PyUnicode_KIND(str)) {
+            case PyUnicode_1BYTE_KIND:
+                units.width = PyUnicode_IS_ASCII(str) ? StrWidth::ASCII : StrWidth::LATIN1;
+                break;
+            case PyUnicode_2BYTE_KIND:
+                units.width = StrWidth::UCS2;
+                break;
+            default:
+                units.width = StrWidth::UCS4;
+                break;
+        }
+        return true;
+    }
+
+    // Append the code units of `units`, little endian.
+    inline void append_str_units(std::vector<uint8_t> &out, const StrUnits &units) {
+        size_t at = out.size();
+        out.resize(at + units.size());
+        std::memcpy(out.data() + at, units.data, units.size());
+        if constexpr (std::endian::native == std::endian::big) {
+            size_t unit = unit_size(units.width);
+            for (uint8_t *p = out.data() + at; unit > 1 && p < out.data() + out.size(); p += unit) {
+                std::reverse(p, p + unit);
+            }
+        }
+    }
+
+    namespace detail {
+        template<typename Unit>
+        PyObject *make_wide_str(int kind, const uint8_t *data, size_t length) {
+            if (std::endian::native == std::endian::little &&
+                reinterpret_cast<uintptr_t>(data) % alignof(Unit) == 0) {
+                return PyUnicode_FromKindAndData(kind, data, static_cast<Py_ssize_t>(length));
+            }
+            std::vector<Unit> units(length);
+            for (size_t i = 0; i < length; i++) {
+                const uint8_t *unit = data + i * sizeof(Unit);
+                Unit value = 0;
+                for (size_t b = 0; b < sizeof(Unit); b++) value |= static_cast<Unit>(unit[b]) << (8 * b);
+                units[i] = value;
+            }
+            return PyUnicode_FromKindAndData(kind, units.data(), static_cast<Py_ssize_t>(length));
+        }
+    } // namespace detail
+
+    // str from `length` code units of `width` at `data` (length * unit_size
+    // bytes). Returns a new reference, or nullptr with a Python error set.
+    inline PyObject *make_str_units(StrWidth width, const uint8_t *data, size_t length) {
+        switch (width) {
+            case StrWidth::ASCII:
+                return make_str(reinterpret_cast<const char *>(data), length);
+            case StrWidth::LATIN1:
+                return PyUnicode_FromKindAndData(PyUnicode_1BYTE_KIND, data, static_cast<Py_ssize_t>(length));
+            case StrWidth::UCS2:
+                return detail::make_wide_str<Py_UCS2>(PyUnicode_2BYTE_KIND, data, length);
+            default: {
+                PyObject *str = detail::make_wide_str<Py_UCS4>(PyUnicode_4BYTE_KIND, data, length);
+                // CPython reports code points past U+10FFFF as a SystemError.
+                if (!str && PyErr_ExceptionMatches(PyExc_SystemError)) {
+                    PyErr_SetString(PyExc_ValueError, "Invalid code point in str data");
+                }
+                return str;
+            }
+        }
+    }
+} // namespace pyser
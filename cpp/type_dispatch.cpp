@@ -0,0 +1,79 @@
+// type_dispatch.cpp
+// Classification of non-builtin types and its per-process cache (see
+// type_dispatch.h).
+#include "type_dispatch.h"
+#include "ndarray.h"
+#include <unordered_map>
+
+namespace pyser {
+    namespace {
+        struct CachedDispatch {
+            TypeDispatch dispatch;
+            unsigned int version_tag;
+        };
+
+        // Entries for classes that have since been freed are never hit again
+        // (their tag is gone with them); the cap keeps code that creates
+        // classes in a loop from growing the cache without bound.
+        constexpr size_t DISPATCH_CACHE_LIMIT = 4096;
+
+        std::unordered_map<PyTypeObject *, CachedDispatch> cache;
+
+        bool has_buffer(PyTypeObject *type) {
+            return type->tp_as_buffer && type->tp_as_buffer->bf_getbuffer;
+        }
+
+        bool defines_fileno(PyTypeObject *type) {
+            static PyObject *name = PyUnicode_InternFromString("fileno");
+            if (!name) {
+                PyErr_Clear();
+                return false;
+            }
+            return _PyType_Lookup(type, name) != nullptr;
+        }
+
+        TypeDispatch classify(PyTypeObject *type) {
+            // Looked up first: the lookup also assigns the class a version tag.
+            bool file_like = defines_fileno(type);
+            if (type == Py_TYPE(Py_None)) return {TypeKind::NONE};
+            if (type == &PyBool_Type) return {TypeKind::BOOL};
+            if (PyType_FastSubclass(type, Py_TPFLAGS_TYPE_SUBCLASS) || PyType_IsSubtype(type, &PyCFunction_Type)) {
+                return {TypeKind::GLOBAL};
+            }
+            // Before the int, float and str checks: IntEnum and StrEnum members
+            // are ints and strs too, but must come back as members.
+            if (is_enum_type(type)) return {TypeKind::STD, StdKind::ENUM};
+            if (PyType_FastSubclass(type, Py_TPFLAGS_LONG_SUBCLASS)) return {TypeKind::INT};
+            if (PyType_IsSubtype(type, &PyFloat_Type)) return {TypeKind::FLOAT};
+            if (PyType_FastSubclass(type, Py_TPFLAGS_UNICODE_SUBCLASS)) return {TypeKind::STR};
+            if (PyType_FastSubclass(type, Py_TPFLAGS_BYTES_SUBCLASS)) return {TypeKind::BYTES};
+            if (PyType_IsSubtype(type, &PyByteArray_Type)) return {TypeKind::BYTEARRAY};
+            if (is_ndarray_type(type)) return {TypeKind::NDARRAY};
+            if (type == &PyMemoryView_Type || has_buffer(type)) return {TypeKind::BUFFER};
+            if (PyType_FastSubclass(type, Py_TPFLAGS_LIST_SUBCLASS)) return {TypeKind::LIST};
+            if (PyType_FastSubclass(type, Py_TPFLAGS_TUPLE_SUBCLASS)) return {TypeKind::TUPLE};
+            if (PyType_FastSubclass(type, Py_TPFLAGS_DICT_SUBCLASS)) return {TypeKind::DICT, std_type_kind(type)};
+            if (PyType_IsSubtype(type, &PySet_Type)) return {TypeKind::SET};
+            if (PyType_IsSubtype(type, &PyFrozenSet_Type)) return {TypeKind::FROZENSET};
+            if (PyType_IsSubtype(type, &PyModule_Type)) return {TypeKind::MODULE};
+            StdKind std = std_type_kind(type);
+            if (std != StdKind::NONE) return {TypeKind::STD, std};
+            if (file_like) return {TypeKind::FILE};
+            return {TypeKind::CUSTOM};
+        }
+    } // namespace
+
+    TypeDispatch classify_type(PyTypeObject *type) {
+        auto it = cache.find(type);
+        if (it != cache.end() && type->tp_version_tag != 0 && it->second.version_tag == type->tp_version_tag) {
+            return it->second.dispatch;
+        }
+        // classify() can import modules and so run arbitrary code; `it` is
+        // not reused past it.
+        TypeDispatch dispatch = classify(type);
+        if (type->tp_version_tag == 0) return dispatch;
+        if (cache.size() >= DISPATCH_CACHE_LIMIT) cache.clear();
+        cache.insert_or_assign(type, CachedDispatch{dispatch, type->tp_version_tag});
+        return dispatch;
+    }
+} // namespace pyser
@@ -0,0 +1,90 @@
+// type_dispatch.h
+// Maps an object's type to the branch the serializers take for it, so both
+// walkers dispatch with one switch instead of re-running a chain of type
+// checks (and a "fileno" attribute lookup) for every object.
+//
+// Notes:
+// - The exact built-in types are resolved from a fixed table; everything else
+//   (subclasses, extension and user classes) is classified once and kept in a
+//   per-process cache keyed by PyTypeObject*.
+// - Cache entries are keyed by address and validated with the type's version
+//   tag. CPython never reuses a tag and resets it when the class is modified,
+//   so a freed class whose address is reused, or a class that gains or loses
+//   a fileno attribute, is classified again instead of hitting a stale entry.
+//   Types without a valid tag are classified on every call.
+// - Classification follows the order of the former if-chains: bool before
+//   int, classes and built-in functions before everything else, standard
+//   library types and file-like classes (a fileno attribute on the class)
+//   after all built-in kinds. numpy arrays are recognised ahead of the other
+//   buffer exporters.
+
+#pragma once
+#include <Python.h>
+#include <cstdint>
+#include "std_types.h"
+
+namespace pyser {
+    enum class TypeKind : uint8_t {
+        NONE = 0,
+        BOOL,
+        INT,
+        FLOAT,
+        STR,
+        BYTES,
+        BYTEARRAY,
+        BUFFER,         // memoryview and other buffer exporters
+        NDARRAY,        // numpy.ndarray (ndarray.h)
+        LIST,
+        TUPLE,
+        DICT,           // `std` is set for the collections dict subclasses
+        SET,
+        FROZENSET,
+        FUNCTION,       // Python functions (exact type)
+        MODULE,
+        GLOBAL,         // classes and built-in functions, stored by name
+        STD,            // standard library type, see `std`
+        FILE,           // refused: has a fileno attribute
+        CUSTOM,         // anything else: user classes and the reduce protocol
+    };
+
+    struct TypeDispatch {
+        TypeKind kind = TypeKind::CUSTOM;
+        StdKind std = StdKind::NONE;
+    };
+
+    // Classification of a type that is not in the exact table (cached).
+    TypeDispatch classify_type(PyTypeObject *type);
+
+    // How instances of `type` are serialized. Never leaves a Python error set.
+    inline TypeDispatch type_dispatch(PyTypeObject *type) {
+        struct Entry {
+            PyTypeObject *type;
+            TypeKind kind;
+        };
+        // Most frequent first.
+        static const Entry exact[] = {
+            {&PyLong_Type, TypeKind::INT},
+            {&PyUnicode_Type, TypeKind::STR},
+            {&PyFloat_Type, TypeKind::FLOAT},
+            {&PyList_Type, TypeKind::LIST},
+            {&PyDict_Type, TypeKind::DICT},
+            {&PyTuple_Type, TypeKind::TUPLE},
+            {&PyBool_Type, TypeKind::BOOL},
+            {&PyBytes_Type, TypeKind::BYTES},
+            {&PySet_Type, TypeKind::SET},
+            {&PyFrozenSet_Type, TypeKind::FROZENSET},
+            {&PyByteArray_Type, TypeKind::BYTEARRAY},
+            {&PyMemoryView_Type, TypeKind::BUFFER},
+            {&PyFunction_Type, TypeKind::FUNCTION},
+            {&PyType_Type, TypeKind::GLOBAL},
+            {&PyCFunction_Type, TypeKind::GLOBAL},
+            {&PyModule_Type, TypeKind::MODULE},
+        };
+        for (const Entry &entry: exact) {
+            if (entry.type == type) return {entry.kind, StdKind::NONE};
+        }
+        return classify_type(type);
+    }
+
+    inline TypeDispatch type_dispatch(PyObject *obj) { return type_dispatch(Py_TYPE(obj)); }
+} // namespace pyser
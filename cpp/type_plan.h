@@ -0,0 +1,176 @@
+// type_plan.h
+// Per-type decisions for instances of user classes, made once per class
+// instead of once per instance.
+//
+// Notes:
+// - A class takes the native path (attributes read straight from the
+//   instance) when its pickled state would be exactly its __dict__ plus its
+//   __slots__: it does not customise __reduce_ex__, __reduce__, __getstate__,
+//   __setstate__ or __getnewargs(_ex)__, and its instances hold nothing but
+//   __dict__, __weakref__ and __slots__ (the layout test pickle's default
+//   __reduce_ex__ applies). Anything else (extension types, subclasses of
+//   built-in types, classes with custom state hooks) goes through the reduce
+//   protocol like pickle.
+// - Slot values are read from the member offsets recorded by the class's
+//   member descriptors, without a descriptor call per attribute.
+// - Plans hold a strong reference to their type, so a cached address cannot
+//   be reused by a different class while the plan is alive.
+// - A cache kept across calls (Serializer) drops the plans of classes changed
+//   since (tp_version_tag), e.g. given a __reduce__ later, before each call.
+
+#pragma once
+#include <Python.h>
+#include <structmember.h>
+#include <unordered_map>
+#include <vector>
+
+namespace pyser {
+    // One __slots__ entry: the (mangled) attribute name and where the value
+    // lives in the instance.
+    struct SlotMember {
+        PyObject *name;     // owned, interned
+        Py_ssize_t offset;
+    };
+
+    struct TypePlan {
+        bool reduce = false;
+        std::vector<SlotMember> slots;
+        unsigned int version_tag = 0;   // of the type when the plan was made
+    };
+
+    class TypePlanCache {
+    public:
+        TypePlanCache() = default;
+
+        TypePlanCache(const TypePlanCache &) = delete;
+
+        TypePlanCache &operator=(const TypePlanCache &) = delete;
+
+        ~TypePlanCache() { clear(); }
+
+        void clear() {
+            for (auto &[type, plan]: plans_) release(type, plan);
+            plans_.clear();
+        }
+
+        // Drop the plans of types modified since their plan was made. Only
+        // between payloads: it ends the references get() handed out.
+        void drop_stale() {
+            for (auto it = plans_.begin(); it != plans_.end();) {
+                PyTypeObject *type = it->first;
+                if (type->tp_version_tag != 0 && type->tp_version_tag == it->second.version_tag) {
+                    ++it;
+                    continue;
+                }
+                release(type, it->second);
+                it = plans_.erase(it);
+            }
+        }
+
+        // The plan for `type`. The reference stays valid until clear().
+        const TypePlan &get(PyTypeObject *type) {
+            auto it = plans_.find(type);
+            if (it != plans_.end()) return it->second;
+            TypePlan &plan = plans_[type];
+            Py_INCREF(reinterpret_cast<PyObject *>(type));
+            plan.reduce = needs_reduce(type);
+            if (!plan.reduce) {
+                collect_slots(type, plan.slots);
+                if (!plain_layout(type, plan.slots.size())) {
+                    for (SlotMember &slot: plan.slots) Py_DECREF(slot.name);
+                    plan.slots.clear();
+                    plan.reduce = true;
+                }
+            }
+            // The lookups above have assigned the type a version tag, if it
+            // can have one; 0 makes drop_stale() rebuild the plan.
+            plan.version_tag = type->tp_version_tag;
+            return plan;
+        }
+
+        // Current value of a slot (borrowed), or nullptr if it is unset.
+        static PyObject *slot_value(PyObject *obj, const SlotMember &slot) {
+            return *reinterpret_cast<PyObject **>(reinterpret_cast<char *>(obj) + slot.offset);
+        }
+
+        // Offset of the writable object slot `name` of `type`, or -1 if `name`
+        // is not a plain __slots__ member of it.
+        static Py_ssize_t slot_offset(PyTypeObject *type, PyObject *name) {
+            PyObject *descr = _PyType_Lookup(type, name);
+            if (!descr || Py_TYPE(descr) != &PyMemberDescr_Type) return -1;
+            PyMemberDef *member = reinterpret_cast<PyMemberDescrObject *>(descr)->d_member;
+            if (member->type != T_OBJECT_EX || (member->flags & READONLY)) return -1;
+            return member->offset;
+        }
+
+    private:
+        static void release(PyTypeObject *type, TypePlan &plan) {
+            for (SlotMember &slot: plan.slots) Py_DECREF(slot.name);
+            Py_DECREF(reinterpret_cast<PyObject *>(type));
+        }
+
+        // True if `type` resolves `name` to something other than what object
+        // itself provides.
+        static bool overrides(PyTypeObject *type, const char *name) {
+            PyObject *key = PyUnicode_InternFromString(name);
+            if (!key) {
+                PyErr_Clear();
+                return true;
+            }
+            bool result = _PyType_Lookup(type, key) != _PyType_Lookup(&PyBaseObject_Type, key);
+            Py_DECREF(key);
+            return result;
+        }
+
+        static bool needs_reduce(PyTypeObject *type) {
+            PyObject *mro = type->tp_mro;
+            if (!mro || !PyTuple_Check(mro)) return true;
+            for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(mro); i++) {
+                auto *base = reinterpret_cast<PyTypeObject *>(PyTuple_GET_ITEM(mro, i));
+                if (base != &PyBaseObject_Type && !PyType_HasFeature(base, Py_TPFLAGS_HEAPTYPE)) return true;
+            }
+            static const char *const hooks[] = {
+                "__reduce_ex__", "__reduce__", "__getstate__", "__setstate__",
+                "__getnewargs_ex__", "__getnewargs__",
+            };
+            for (const char *hook: hooks) {
+                if (overrides(type, hook)) return true;
+            }
+            return false;
+        }
+
+        // True if an instance is an object header plus the inline __dict__ /
+        // __weakref__ pointers and one pointer per slot, i.e. it carries no C
+        // state that tp_alloc plus attribute assignment could not restore.
+        // Managed dicts and weakrefs (negative offsets) live before the header.
+        static bool plain_layout(PyTypeObject *type, size_t n_slots) {
+            if (type->tp_itemsize != 0) return false;
+            Py_ssize_t expected = PyBaseObject_Type.tp_basicsize +
+                                  static_cast<Py_ssize_t>(n_slots * sizeof(PyObject *));
+            if (type->tp_dictoffset > 0) expected += sizeof(PyObject *);
+            if (type->tp_weaklistoffset > 0) expected += sizeof(PyObject *);
+            return type->tp_basicsize == expected;
+        }
+
+        // __slots__ members from the base-most class down, so instances of a
+        // subclass list their inherited slots first.
+        static void collect_slots(PyTypeObject *type, std::vector<SlotMember> &slots) {
+            PyObject *mro = type->tp_mro;
+            for (Py_ssize_t i = PyTuple_GET_SIZE(mro); i-- > 0;) {
+                auto *base = reinterpret_cast<PyTypeObject *>(PyTuple_GET_ITEM(mro, i));
+                if (!PyType_HasFeature(base, Py_TPFLAGS_HEAPTYPE) || !base->tp_members) continue;
+                for (PyMemberDef *member = base->tp_members; member->name; member++) {
+                    if (member->type != T_OBJECT_EX || (member->flags & READONLY)) continue;
+                    PyObject *name = PyUnicode_InternFromString(member->name);
+                    if (!name) {
+                        PyErr_Clear();
+                        continue;
+                    }
+                    slots.push_back({name, member->offset});
+                }
+            }
+        }
+
+        std::unordered_map<PyTypeObject *, TypePlan> plans_;
+    };
+} // namespace pyser
@@ -21,7 +21,7 @@ import os
 import sys
 import contextlib
 
-__all__ = ["dumps", "loads", "dump", "load", "serialize", "deserialize"]
+__all__ = ["dumps", "loads", "dump", "load", "serialize", "deserialize", "Serializer", "Deserializer"]
 
 
 def _load_native():
@@ -179,38 +179,55 @@ def _temp_clear_reduce(obj):
 # Exposed API (thin wrappers)
 
 
-def serialize(obj: Any) -> bytes:
-    """Serialize a Python object to bytes using the native pyser extension."""
+def serialize(obj: Any, max_depth: int = 0, format: str = "wire", buffer_callback=None) -> bytes:
+    """Serialize a Python object to bytes using the native pyser extension.
+
+    ``max_depth`` limits how deeply containers may be nested; 0 (the default)
+    means no limit. ``format`` selects the encoding: ``"wire"`` (the default;
+    compact single-pass binary records) or ``"graph"`` (chunked, hashed JSON
+    graph, useful for inspecting the node structure). ``deserialize`` reads
+    both.
+
+    ``buffer_callback``, as in pickle protocol 5, is called with a
+    ``pickle.PickleBuffer`` for every bytes-like object of 64 KiB or more.
+    When it returns a false value the buffer is left out of the output and
+    must be passed back to ``deserialize`` through ``buffers``.
+    """
     mod = _ensure_native()
     with _temp_clear_reduce(obj):
-        return mod.serialize(obj)
+        return mod.serialize(obj, max_depth=max_depth, format=format, buffer_callback=buffer_callback)
 
 
-def deserialize(data: bytes) -> Any:
-    """Deserialize bytes into a Python object using the native pyser extension."""
+def deserialize(data: bytes, buffers=None) -> Any:
+    """Deserialize bytes into a Python object using the native pyser extension.
+
+    ``buffers`` are the out-of-band buffers, in the order ``buffer_callback``
+    received them. They are used without copying: a bytes or bytearray is
+    returned as is, any other buffer as a memoryview over it.
+    """
     mod = _ensure_native()
-    return mod.deserialize(data)
+    return mod.deserialize(data, buffers=buffers)
 
 
-def dumps(obj: Any) -> bytes:
+def dumps(obj: Any, max_depth: int = 0, format: str = "wire", buffer_callback=None) -> bytes:
     """Alias for serialize(obj)."""
-    return serialize(obj)
+    return serialize(obj, max_depth=max_depth, format=format, buffer_callback=buffer_callback)
 
 
-def loads(data: bytes) -> Any:
+def loads(data: bytes, buffers=None) -> Any:
     """Alias for deserialize(data)."""
-    return deserialize(data)
+    return deserialize(data, buffers=buffers)
 
 
-def dump(obj: Any, filename: str) -> None:
+def dump(obj: Any, filename: str, max_depth: int = 0, format: str = "wire") -> None:
     """Serialize object and write to file (alias for serialize_to_file)."""
     mod = _ensure_native()
     # Some compiled modules provide serialize_to_file
     if hasattr(mod, "serialize_to_file"):
         with _temp_clear_reduce(obj):
-            return mod.serialize_to_file(obj, filename)
+            return mod.serialize_to_file(obj, filename, max_depth=max_depth, format=format)
     # Fallback: write bytes
-    data = serialize(obj)
+    data = serialize(obj, max_depth=max_depth, format=format)
     with open(filename, "wb") as f:
         f.write(data)
 
@@ -226,6 +243,23 @@ def load(filename: str) -> Any:
     return deserialize(data)
 
 
+# Reusable serializer objects: the native classes themselves, so that each call
+# goes straight to the extension (the reduce sanitizer above does not apply).
+if _native is not None:
+    Serializer = _native.Serializer
+    Deserializer = _native.Deserializer
+else:
+
+    class Serializer:
+        """Unavailable: the native extension failed to load."""
+
+        def __init__(self, *args, **kwargs):
+            raise _import_error
+
+    class Deserializer(Serializer):
+        """Unavailable: the native extension failed to load."""
+
+
 # Provide backwards-compatible names
 serialize_to_file = dump
 deserialize_from_file = load
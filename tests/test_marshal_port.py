@@ -1,7 +1,7 @@
 """Tests specifically for marshal-free code object serialization.
 
 This test file verifies that the pyser library correctly serializes and
-deserializes Python functions using pure C++ JSON serialization instead
+deserializes Python functions using the C++ code encoding (code_codec) instead
 of Python's marshal module.
 """
 
@@ -133,5 +133,32 @@ def test_function_kwargs_only():
     assert out(1, b=2, c=3) == 6
 
 
+def _divider(k):
+    def divide(x):
+        try:
+            return x / k
+        except ZeroDivisionError:
+            return None
+
+    return divide
+
+
+@pytest.mark.parametrize("fmt", ["wire", "graph"])
+def test_shared_code_stored_once(fmt):
+    """Closures made by one factory share a code object in the payload."""
+    funcs = [_divider(k) for k in range(200)]
+    one = dumps(funcs[:1], format=fmt)
+    many = dumps(funcs, format=fmt)
+    # Each extra closure costs its cell and defaults, not another code copy.
+    assert len(many) - len(one) < 200 * 100
+    out = loads(many)
+    assert out[1].__code__ is out[2].__code__
+    assert out[0](1) is None  # exception table survives
+    assert out[4](8) == 2
+    if sys.version_info >= (3, 11):
+        assert out[4].__code__.co_qualname == funcs[4].__code__.co_qualname
+    assert out[4].__code__.co_firstlineno == funcs[4].__code__.co_firstlineno
+
+
 if __name__ == "__main__":
     pytest.main(["-v", __file__])
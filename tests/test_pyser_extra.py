@@ -1,6 +1,8 @@
 import pathlib
 import sys
 
+import pytest
+
 _repo_root = pathlib.Path(__file__).resolve().parent.parent
 if str(_repo_root) not in sys.path:
     sys.path.insert(0, str(_repo_root))
@@ -63,8 +65,156 @@ def test_custom_mixed_class_callable_and_slots():
     m.func = lambda x: x * 2
     data = dumps(m)
     out = loads(data)
-    # slots may not reconstruct __dict__, but ensure basic exposed attrs exist
-    assert hasattr(out, "a") or hasattr(out, "__slots__")
-    # If callable, test behavior
-    if hasattr(out, "func") and callable(out.func):
-        assert out.func(3) == 6
+    assert type(out) is Mixed
+    assert (out.a, out.b) == (1, 2)
+    assert out.add() == 3
+    assert out.func(3) == 6
+
+
+def test_many_instances_and_module_reload(tmp_path, monkeypatch):
+    import importlib
+
+    (tmp_path / "pyser_reload_mod.py").write_text("class Point:\n    pass\n")
+    monkeypatch.syspath_prepend(str(tmp_path))
+    mod = importlib.import_module("pyser_reload_mod")
+    points = []
+    for i in range(2000):
+        p = mod.Point()
+        p.x = i
+        points.append(p)
+    for fmt in ("wire", "graph"):
+        data = dumps(points, format=fmt)
+        out = loads(data)
+        assert all(type(p) is mod.Point for p in out)
+        assert [p.x for p in out] == list(range(2000))
+
+        old_cls = mod.Point
+        importlib.reload(mod)
+        assert mod.Point is not old_cls
+        out = loads(data)
+        assert type(out[0]) is mod.Point
+    del sys.modules["pyser_reload_mod"]
+
+
+class Guarded:
+    def __setattr__(self, name, value):
+        raise AttributeError("read-only")
+
+
+class Varied:
+    pass
+
+
+def test_instances_with_varying_layouts_roundtrip():
+    items = []
+    for i in range(300):
+        v = Varied()
+        v.a = i
+        if i % 3 == 0:
+            v.b = str(i)
+        if i % 7 == 0:
+            setattr(v, "only_%d" % i, i)
+        items.append(v)
+    g = object.__new__(Guarded)
+    object.__setattr__(g, "value", 42)
+    items.append(g)
+    out = loads(dumps(items))
+    for orig, new in zip(items, out):
+        assert type(new) is type(orig)
+        assert new.__dict__ == orig.__dict__
+        assert list(new.__dict__) == list(orig.__dict__)
+
+
+class Point2:
+    __slots__ = ("x", "__y")
+
+    def __init__(self, x, y):
+        self.x = x
+        self.__y = y
+
+    def y(self):
+        return self.__y
+
+
+class Point3(Point2):
+    __slots__ = ("z", "__dict__")
+
+
+class Snapshot:
+    def __init__(self, value):
+        self.value = value
+        self.cache = {"big": value}
+
+    def __getstate__(self):
+        return {"value": self.value}
+
+    def __setstate__(self, state):
+        self.__dict__.update(state)
+        self.cache = None
+
+
+class Pair:
+    def __init__(self, left, right):
+        self.left = left
+        self.right = right
+
+    def __reduce__(self):
+        return (Pair, (self.left, self.right))
+
+
+class Loop:
+    def __reduce__(self):
+        return (Loop.__new__, (Loop,), {"me": self})
+
+
+def test_slots_roundtrip_in_both_formats():
+    p = Point3(1, "y")
+    p.z = [1]
+    p.extra = 4
+    unset = Point2(5, 6)
+    del unset.x
+    for fmt in ("wire", "graph"):
+        out = loads(dumps([p, p, unset], format=fmt))
+        assert out[0] is out[1]
+        assert type(out[0]) is Point3
+        assert (out[0].x, out[0].y(), out[0].z, out[0].extra) == (1, "y", [1], 4)
+        assert not hasattr(out[2], "x") and out[2].y() == 6
+
+
+def test_reduce_protocol_roundtrip():
+    import collections
+    import datetime
+    import decimal
+    import enum
+
+    class Local(enum.Enum):
+        A = 1
+
+    values = [
+        Snapshot(3),
+        Pair("a", [1, 2]),
+        datetime.datetime(2024, 5, 6, 7, 8, 9),
+        decimal.Decimal("1.25"),
+        complex(1, -2),
+        range(2, 10, 3),
+        collections.deque([1, 2, 3]),
+        ValueError("boom"),
+        int,
+        len,
+    ]
+    out = loads(dumps(values))
+    assert out[0].value == 3 and out[0].cache is None
+    assert (out[1].left, out[1].right) == ("a", [1, 2])
+    assert out[2:7] == values[2:7]
+    assert type(out[7]) is ValueError and out[7].args == ("boom",)
+    assert out[8] is int and out[9] is len
+
+    loop = loads(dumps(Loop()))
+    assert loop.me is loop
+
+    import threading
+
+    with pytest.raises(TypeError):
+        dumps(threading.Lock())
+    with pytest.raises(TypeError):
+        dumps(Local)
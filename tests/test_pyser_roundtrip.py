@@ -1,14 +1,24 @@
 import pytest
+import collections
+import datetime
+import decimal
+import enum
+import math
+import pickle
 import random
+import struct
 import sys
+import threading
+import time
 import pathlib
+import uuid
 
 # Ensure repository root is on sys.path so local package `pyserpy` can be imported during tests
 _repo_root = pathlib.Path(__file__).resolve().parent.parent
 if str(_repo_root) not in sys.path:
     sys.path.insert(0, str(_repo_root))
 
-from pyserpy import dumps, loads, dump, load
+from pyserpy import dumps, loads, dump, load, Serializer, Deserializer
 
 
 def test_basic_types_roundtrip():
@@ -36,6 +46,14 @@ def test_bytes_and_large_data():
     assert out["b"] == b
 
 
+def test_graph_bytes_of_every_length_roundtrip():
+    # Graph chunks are base64 text; cover every tail length and the SIMD blocks.
+    rng = random.Random(5)
+    blobs = [bytes(rng.getrandbits(8) for _ in range(n)) for n in range(200)]
+    blobs.append(bytes(rng.getrandbits(8) for _ in range(100003)))
+    assert loads(dumps(blobs, format="graph")) == blobs
+
+
 def test_file_dump_load(tmp_path):
     obj = {"x": [1, 2, 3]}
     f = tmp_path / "data.bin"
@@ -108,6 +126,242 @@ def test_memoryview_and_bytearray_roundtrip():
     assert bytes(ba_out) == b
 
 
+@pytest.mark.parametrize("fmt", ["wire", "graph"])
+def test_large_buffers_roundtrip(fmt):
+    # Sizes around the graph chunk size and the wire flush size.
+    rng = random.Random(7)
+    blob = bytes(rng.getrandbits(8) for _ in range(300001))
+    for n in (0, 1, 65535, 65536, 65537, 131072, 300001):
+        obj = [blob[:n], bytearray(blob[:n]), memoryview(blob[:n])]
+        out = loads(dumps(obj, format=fmt))
+        assert out[0] == blob[:n] and type(out[0]) is bytes
+        assert out[1] == blob[:n] and type(out[1]) is bytearray
+        assert bytes(out[2]) == blob[:n]
+
+
+def test_buffers_are_released_after_serialize():
+    ba = bytearray(b"x" * 200000)
+    for fmt in ("wire", "graph"):
+        dumps([ba, memoryview(ba)], format=fmt)
+        ba.extend(b"y")  # BufferError if an export were still held
+    assert len(ba) == 200002
+
+
+def test_graph_chunks_encode_the_same_on_every_run(monkeypatch):
+    # Enough chunk data to be encoded on several threads.
+    rng = random.Random(11)
+    obj = {"big": rng.randbytes(3 << 20), "parts": [rng.randbytes(70000) for _ in range(40)]}
+    monkeypatch.setenv("PYSER_ENCODE_THREADS", "1")
+    reference = dumps(obj, format="graph")
+    monkeypatch.setenv("PYSER_ENCODE_THREADS", "8")
+    data = dumps(obj, format="graph")
+    assert data == reference
+    assert dumps(obj, format="graph") == data
+    assert loads(data) == obj
+
+
+def test_concurrent_graph_dumps_share_the_encode_pool(monkeypatch):
+    rng = random.Random(12)
+    objs = [[rng.randbytes(1 << 20) for _ in range(3)] for _ in range(4)]
+    monkeypatch.setenv("PYSER_ENCODE_THREADS", "1")
+    expected = [dumps(obj, format="graph") for obj in objs]
+    monkeypatch.setenv("PYSER_ENCODE_THREADS", "8")
+    results = [[] for _ in objs]
+
+    def run(i):
+        for _ in range(5):
+            results[i].append(dumps(objs[i], format="graph"))
+
+    threads = [threading.Thread(target=run, args=(i,)) for i in range(len(objs))]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    for data, runs in zip(expected, results):
+        assert runs == [data] * 5
+
+
+@pytest.mark.parametrize("fmt", ["wire", "graph"])
+def test_reused_serializer_matches_dumps(fmt):
+    ser, de = Serializer(format=fmt), Deserializer()
+    messages = [{"id": i, "name": "user%d" % i, "tags": ["a", "b"] * i} for i in range(5)]
+    messages.append({"blob": bytes(300000)})
+    for message in messages + messages:
+        data = ser.serialize(message)
+        assert data == dumps(message, format=fmt)
+        assert de.deserialize(data) == message
+
+
+class Late:
+    def __init__(self, value):
+        self.value = value
+
+
+def test_reused_serializer_sees_class_changes():
+    # Type plans outlive a call; a state hook added later must still count.
+    ser = Serializer()
+    assert loads(ser.serialize(Late(1))).value == 1
+    Late.__getstate__ = lambda self: {"value": self.value * 10}
+    try:
+        assert loads(ser.serialize(Late(2))).value == 20
+    finally:
+        del Late.__getstate__
+    assert loads(ser.serialize(Late(3))).value == 3
+
+
+@pytest.mark.parametrize("fmt", ["wire", "graph"])
+def test_serializer_dictionary(fmt):
+    dictionary = b'{"id": "name": "user", "tags": ' * 64
+    message = {"id": 7, "name": "user7", "tags": ["a", "b"]}
+    data = Serializer(format=fmt, dictionary=dictionary).serialize(message)
+    de = Deserializer(dictionary=dictionary)
+    assert de.deserialize(data) == message
+    # Data written without the dictionary is still read.
+    assert de.deserialize(dumps(message, format=fmt)) == message
+
+
+def test_serializer_refuses_concurrent_use():
+    ser = Serializer()
+
+    def reenter(buffer):
+        ser.serialize(1)
+
+    with pytest.raises(RuntimeError, match="already in use"):
+        ser.serialize(bytes(1 << 17), buffer_callback=reenter)
+    assert loads(ser.serialize([1, 2])) == [1, 2]
+
+
+@pytest.mark.parametrize("fmt", ["wire", "graph"])
+def test_large_calls_release_the_gil(fmt):
+    # With a long switch interval the other thread only runs while the call
+    # has released the GIL itself.
+    blob = random.Random(3).randbytes(8 << 20)
+    ticks = []
+    started, stop = threading.Event(), threading.Event()
+
+    def spin():
+        started.set()
+        while not stop.is_set():
+            ticks.append(None)
+
+    interval = sys.getswitchinterval()
+    thread = threading.Thread(target=spin)
+    thread.start()
+    started.wait()
+    sys.setswitchinterval(0.2)
+    try:
+        before = len(ticks)
+        data = dumps(blob, format=fmt)
+        during = len(ticks) - before
+    finally:
+        sys.setswitchinterval(interval)
+        stop.set()
+        thread.join()
+    assert during > 0
+    assert loads(data) == blob
+
+
+@pytest.mark.parametrize("fmt", ["wire", "graph"])
+def test_out_of_band_buffers_roundtrip(fmt):
+    big = bytes(range(256)) * 1024
+    ba = bytearray(big)
+    obj = {"b": big, "ba": ba, "mv": memoryview(big), "again": ba, "small": b"abc"}
+    buffers = []
+    data = dumps(obj, format=fmt, buffer_callback=buffers.append)
+    assert len(data) < len(big)
+    assert [type(b) for b in buffers] == [pickle.PickleBuffer] * 3
+
+    raws = [b.raw().obj for b in buffers]
+    out = loads(data, buffers=raws)
+    # bytes and bytearray given back are rebound as they are; other buffers
+    # come back as memoryviews over them.
+    assert out["b"] is big and out["ba"] is ba
+    assert out["again"] is out["ba"]
+    assert isinstance(out["mv"], memoryview) and out["mv"] == big
+    assert out["small"] == b"abc"
+
+    copies = [bytearray(b.raw()) for b in buffers]
+    out = loads(data, buffers=copies)
+    assert out["ba"] is copies[1]
+    assert isinstance(out["b"], memoryview) and out["b"].readonly and out["b"] == big
+
+    with pytest.raises(ValueError):
+        loads(data)
+    with pytest.raises(ValueError):
+        loads(data, buffers=raws[:2])
+    with pytest.raises(ValueError):
+        loads(data, buffers=[b"x", raws[1], raws[2]])
+
+
+@pytest.mark.parametrize("fmt", ["wire", "graph"])
+def test_buffer_callback_can_keep_buffers_in_band(fmt):
+    big = bytearray(200000)
+    seen = []
+    data = dumps([big], format=fmt, buffer_callback=lambda b: seen.append(b) or True)
+    assert len(seen) == 1
+    assert loads(data) == [big]
+    with pytest.raises(TypeError):
+        dumps([big], format=fmt, buffer_callback=42)
+
+
+@pytest.mark.parametrize("fmt", ["wire", "graph"])
+def test_numpy_arrays_roundtrip(fmt):
+    np = pytest.importorskip("numpy")
+    base = np.arange(24, dtype=np.float64).reshape(4, 6)
+    arrays = [
+        base,
+        np.asfortranarray(base.astype(np.int32)),
+        base[:, ::2],
+        base[::-1],
+        np.array(3.5),
+        np.zeros((0, 3), dtype=np.int16),
+        np.array([True, False, True]),
+        np.array(["a", "bcd", "\u00e9t\u00e9"]),
+        np.array([b"x", b"yz"]),
+        np.array(["2020-01-01T12:00", "NaT"], dtype="M8[ns]"),
+        np.arange(5, dtype=">i4"),
+        np.arange(6, dtype=np.complex64).reshape(2, 3),
+        np.arange(4, dtype=np.float16),
+    ]
+    out = loads(dumps(arrays, format=fmt))
+    for a, b in zip(arrays, out):
+        assert type(b) is np.ndarray
+        assert b.dtype == a.dtype and b.shape == a.shape
+        assert np.array_equal(a, b, equal_nan=a.dtype.kind in "fc") or (a.dtype.kind == "M" and
+                                                                         (a.astype("i8") == b.astype("i8")).all())
+        assert b.flags.writeable
+    assert out[1].flags.f_contiguous
+
+    shared = loads(dumps([base, base], format=fmt))
+    assert shared[0] is shared[1]
+
+
+def test_numpy_arrays_without_native_dtype_roundtrip():
+    np = pytest.importorskip("numpy")
+    objects = np.array([1, "two", None], dtype=object)
+    records = np.array([(1, 2.5), (3, 4.5)], dtype=[("a", "i4"), ("b", "f8")])
+    # The wire format stores them through __reduce_ex__.
+    out = loads(dumps([objects, records]))
+    assert out[0].dtype == object and list(out[0]) == [1, "two", None]
+    assert out[1].dtype == records.dtype and (out[1] == records).all()
+    with pytest.raises(TypeError):
+        dumps(objects, format="graph")
+
+
+@pytest.mark.parametrize("fmt", ["wire", "graph"])
+def test_numpy_out_of_band_arrays_are_not_copied(fmt):
+    np = pytest.importorskip("numpy")
+    a = np.arange(100000, dtype=np.float64).reshape(1000, 100)
+    buffers = []
+    data = dumps({"a": a}, format=fmt, buffer_callback=buffers.append)
+    assert len(buffers) == 1 and len(data) < 1000
+    given = bytearray(buffers[0].raw())
+    out = loads(data, buffers=[given])["a"]
+    assert np.array_equal(out, a)
+    out[0, 0] = -1.0
+    assert given[:8] == np.float64(-1.0).tobytes()
+
+
 # New comprehensive custom class test
 class MixedNested:
     def __init__(self, name, value):
@@ -173,6 +427,310 @@ def test_custom_mixed_class_roundtrip():
         assert out.func(5) == obj.func(5)
 
 
+def test_set_and_frozenset_roundtrip():
+    fs = frozenset({(1, 2), "a"})
+    obj = {"s": {1, 2, 3}, "fs": fs, "nested": frozenset({frozenset({1}), (3, 4)}), "shared": [fs, fs]}
+    out = loads(dumps(obj))
+    assert out["s"] == {1, 2, 3}
+    assert type(out["fs"]) is frozenset and out["fs"] == fs
+    assert out["nested"] == obj["nested"]
+    assert out["shared"][0] is out["shared"][1]
+    assert loads(dumps(frozenset())) == frozenset()
+
+
+def test_large_set_serializes_in_linear_time():
+    def roundtrip_time(n):
+        s = set(range(n))
+        best = math.inf
+        for _ in range(5):
+            start = time.perf_counter()
+            assert loads(dumps(s)) == s
+            best = min(best, time.perf_counter() - start)
+        return best
+
+    # Ten times the items: about ten times the time, where quadratic work
+    # would take a hundred.
+    assert roundtrip_time(50_000) < 30 * roundtrip_time(5_000)
+
+
+def test_deeply_nested_containers_roundtrip():
+    depth = 5000
+    obj = leaf = []
+    for i in range(depth):
+        child = {"level": i, "next": []}
+        leaf.append(child)
+        leaf = child["next"]
+    out = loads(dumps(obj))
+    cur = out
+    for i in range(depth):
+        assert len(cur) == 1 and cur[0]["level"] == i
+        cur = cur[0]["next"]
+    assert cur == []
+
+
+def test_shared_references_survive_table_growth():
+    shared = [[i] for i in range(5000)]
+    data = {"a": shared, "b": list(shared), "n": [7] * 100}
+    out = loads(dumps(data))
+    assert out == data
+    assert all(x is y for x, y in zip(out["a"], out["b"]))
+
+
+def test_max_depth_limit():
+    obj = [[[[1]]]]
+    assert loads(dumps(obj, max_depth=4)) == obj
+    with pytest.raises(ValueError):
+        dumps(obj, max_depth=3)
+
+
+def test_wire_format_is_compact_and_rejects_unknown_format():
+    data = {"ints": list(range(10_000)), "name": "x" * 10, "nested": [(1, 2.5), {3}]}
+    wire = dumps(data, format="wire")
+    assert wire[:5] == b"PYSW\x01"
+    assert len(wire) < len(dumps(data, format="graph"))
+    with pytest.raises(ValueError):
+        dumps(data, format="pickle")
+    with pytest.raises(ValueError):
+        dumps([[[1]]], max_depth=1, format="wire")
+
+
+def test_wire_and_graph_formats_both_load():
+    shared = [1, 2]
+    data = {"a": shared, "b": shared, "t": (shared, "x"), "fs": frozenset({1, "y"}), "big": -(2**90)}
+    data["self"] = data
+    for fmt in ("wire", "graph"):
+        out = loads(dumps(data, format=fmt))
+        assert out["a"] is out["b"] is out["t"][0]
+        assert out["self"] is out
+        assert out["fs"] == data["fs"] and out["big"] == data["big"]
+
+
+def test_wire_rejects_trailing_and_corrupted_payload():
+    data = dumps({"k": list(range(1000))})
+    with pytest.raises(Exception):
+        loads(data + b"\x00")
+    with pytest.raises(Exception):
+        loads(data[:5] + b"\x00" * (len(data) - 5))
+    with pytest.raises(Exception):
+        loads(data[:4] + b"\x09" + data[5:])
+
+
+@pytest.mark.parametrize("fmt", ["wire", "graph"])
+def test_homogeneous_numeric_sequences_roundtrip(fmt):
+    ints = [random.randint(-(2**63), 2**63 - 1) for _ in range(5000)] + [2**63 - 1, -(2**63), 0, -1]
+    floats = tuple([random.random() - 0.5 for _ in range(4099)] + [float("inf"), -0.0, 1e-310])
+    shared = list(range(20))
+    data = {
+        "ints": ints,
+        "floats": floats,
+        "shared": [shared, shared],
+        "overflow": [1] * 8 + [2**64],
+        "bools": [1] * 8 + [True],
+        "mixed": [1.0] * 8 + [1],
+    }
+    out = loads(dumps(data, format=fmt))
+    assert out == data
+    assert type(out["floats"]) is tuple and str(out["floats"][-2]) == "-0.0"
+    assert out["shared"][0] is out["shared"][1]
+    assert out["bools"][-1] is True and type(out["mixed"][-1]) is int
+    nan = loads(dumps([float("nan")] * 9, format=fmt))
+    assert all(x != x for x in nan)
+
+
+@pytest.mark.parametrize("fmt", ["wire", "graph"])
+def test_string_lists_roundtrip(fmt):
+    words = ["the", "a", "", "naïve", "日本語", "emoji😀", "x" * 100, "tab\t"]
+    tokens = [random.choice(words) for _ in range(3000)] + [str(i) for i in range(3000)]
+    shared = "shared-token"
+    data = {"tokens": tokens, "row": tuple(words), "repeat": [shared] * 9, shared: [shared] + words}
+    out = loads(dumps(data, format=fmt))
+    assert out == data and type(out["row"]) is tuple
+    assert out["repeat"][0] is out["repeat"][8]
+    if fmt == "wire":
+        assert out[shared][0] is out["repeat"][0] is list(out)[3]
+    # Code units are stored as they are, so lone surrogates survive too.
+    odd = ["ok"] * 8 + ["bad\ud800", "\udfff"]
+    assert loads(dumps(odd, format=fmt)) == odd
+    assert loads(dumps("lone\ud800", format=fmt)) == "lone\ud800"
+
+
+@pytest.mark.parametrize("fmt", ["wire", "graph"])
+def test_strings_keep_their_width(fmt):
+    texts = ["café" * 50, "ÿ", "日本語" * 40, "emoji😀" * 30, "\x00\U0010ffff"]
+    sizes = [sys.getsizeof(t) for t in texts]
+    for value in (texts, texts * 3, tuple(texts[:2]) + ("x",) * 8):
+        out = loads(dumps(value, format=fmt))
+        assert out == value
+        assert [sys.getsizeof(t) for t in out[:5]] == [sys.getsizeof(t) for t in value[:5]]
+    # Writing does not leave a cached UTF-8 copy behind in the caller's strings.
+    assert [sys.getsizeof(t) for t in texts] == sizes
+
+
+def test_packed_ints_are_compact():
+    assert len(dumps(list(range(100_000)))) < 10_000
+
+
+@pytest.mark.parametrize("fmt", ["wire", "graph"])
+def test_int_encodings_roundtrip(fmt):
+    edges = [0, 1, -1, 63, -64, 64, 2**49, -(2**49), 2**56, 2**63 - 1, -(2**63)]
+    data = {"scalars": {str(i): v for i, v in enumerate(edges)}, "edges": edges * 2}
+    for width in (1, 7, 13, 33, 63, 64):
+        data["w%d" % width] = [random.getrandbits(width) - 2 ** (width - 1) for _ in range(4100)]
+    data["sorted"] = sorted(random.randint(0, 10**12) for _ in range(5000))
+    data["step"] = tuple(range(10**15, 10**15 + 7 * 5000, 7))
+    out = loads(dumps(data, format=fmt))
+    assert out == data and type(out["step"]) is tuple
+    assert len(dumps(list(range(0, 3_000_000, 3)), format=fmt)) < 1100
+
+
+@pytest.mark.parametrize("fmt", ["wire", "graph"])
+def test_float_series_roundtrip(fmt):
+    nan_payload = struct.unpack("<d", struct.pack("<Q", 0x7FF8_0000_DEAD_BEEF))[0]
+    specials = [0.0, -0.0, math.inf, -math.inf, math.nan, nan_payload, 5e-324, 1.5] * 3
+    quantized = [round(20 + math.sin(i / 300) * 5, 1) for i in range(5000)]
+    noisy = [random.random() for _ in range(4200)]
+    for series in (specials, quantized, noisy, [2.5] * 4100):
+        out = loads(dumps(series, format=fmt))
+        assert struct.pack("<%dd" % len(out), *out) == struct.pack("<%dd" % len(series), *series)
+    assert len(dumps(quantized, format=fmt)) < 4 * len(quantized)
+
+
+class SlottedPoint:
+    __slots__ = ("x", "y", "label")
+
+    def __init__(self, x, y, label):
+        self.x = x
+        self.y = y
+        self.label = label
+
+
+@pytest.mark.parametrize("fmt", ["wire", "graph"])
+def test_runs_of_records_roundtrip(fmt):
+    rows = [{"id": i, "score": i / 4, "name": "user%d" % (i % 7), "tags": [i, "t"]} for i in range(500)]
+    shared = {"id": -1, "score": 0.0, "name": "", "tags": []}
+    data = [0, "head"] + rows[:50] + [shared, shared, {"other": 1}] + rows[50:] + [{"id": 2**70}] * 9
+    data.append(data)
+    out = loads(dumps(data, format=fmt))
+    assert out[:-1] == data[:-1] and out[-1] is out
+    assert out[52] is out[53] and out[-2] is out[-10]
+    assert list(out[2]) == ["id", "score", "name", "tags"]
+
+    points = tuple(SlottedPoint(i, i * 1.5, "p") for i in range(40))
+    del points[3].label
+    objs = [ComplexData(i) for i in range(40)]
+    objs[7].extra = "x"
+    out_points, out_objs = loads(dumps((points, objs), format=fmt))
+    assert type(out_points) is tuple and type(out_points[0]) is SlottedPoint
+    assert [(p.x, p.y) for p in out_points] == [(p.x, p.y) for p in points]
+    assert not hasattr(out_points[3], "label") and out_points[4].label == "p"
+    assert [vars(o) for o in out_objs] == [vars(o) for o in objs]
+
+
+def test_runs_of_records_are_compact():
+    rows = [{"id": i, "value": i * 0.25, "kind": "k%d" % (i % 3)} for i in range(2000)]
+    assert len(dumps(rows)) * 10 < len(dumps(rows, format="graph"))
+
+
+class Color(enum.Enum):
+    RED = 1
+    GREEN = "g"
+
+
+class Perm(enum.Flag):
+    R = 4
+    W = 2
+
+
+class Level(enum.IntEnum):
+    LOW = 1
+    HIGH = 2
+
+
+class Mode(enum.IntFlag):
+    X = 1
+    Y = 8
+
+
+class Suit(str, enum.Enum):
+    SPADES = "s"
+    HEARTS = "h"
+
+
+@pytest.mark.parametrize("fmt", ["wire", "graph"])
+def test_stdlib_types_roundtrip(fmt):
+    tz = datetime.timezone(datetime.timedelta(hours=-3, minutes=-30), "NST")
+    values = [
+        datetime.datetime(2024, 11, 3, 1, 30, 15, 999999, tzinfo=tz, fold=1),
+        datetime.datetime(1, 1, 1), datetime.datetime.now(datetime.timezone.utc),
+        datetime.date(9999, 12, 31), datetime.time(23, 59, 1, 7, tzinfo=datetime.timezone.utc),
+        datetime.timedelta.min, datetime.timedelta.max, datetime.timedelta(microseconds=-1),
+        complex(1.5, -0.0), range(0), range(-5, 2**70, 3),
+        uuid.uuid4(), uuid.UUID(int=0, is_safe=uuid.SafeUUID.safe),
+        Color.RED, Color.GREEN, Perm.R | Perm.W,
+    ]
+    out = loads(dumps(values, format=fmt))
+    assert out == values
+    assert [type(v) for v in out] == [type(v) for v in values]
+    assert out[0].fold == 1 and out[0].tzname() == "NST"
+    assert out[12].is_safe is uuid.SafeUUID.safe
+    assert out[13] is Color.RED and out[15] is Perm.R | Perm.W
+
+    decimals = [decimal.Decimal(s) for s in ("-0", "1E+400", "3.14159", "sNaN", "-Infinity")]
+    assert [str(d) for d in loads(dumps(decimals, format=fmt))] == [str(d) for d in decimals]
+
+    od = collections.OrderedDict(a=1, b=2, c=3)
+    od.move_to_end("a")
+    od["self"] = od
+    dd = collections.defaultdict(list, x=[1])
+    counts = collections.Counter("abracadabra")
+    dq = collections.deque(range(10), maxlen=5)
+    dq.append(dq)
+    out_od, out_dd, out_counts, out_dq = loads(dumps([od, dd, counts, dq], format=fmt))
+    assert type(out_od) is collections.OrderedDict and list(out_od) == ["b", "c", "a", "self"]
+    assert out_od["self"] is out_od
+    assert type(out_dd) is collections.defaultdict and out_dd.default_factory is list
+    assert out_dd == dd and out_dd["missing"] == []
+    assert type(out_counts) is collections.Counter and out_counts == counts
+    assert type(out_dq) is collections.deque and out_dq.maxlen == 5
+    assert list(out_dq)[:4] == [6, 7, 8, 9] and out_dq[-1] is out_dq
+
+
+@pytest.mark.parametrize("fmt", ["wire", "graph"])
+def test_int_and_str_enum_mixins_roundtrip(fmt):
+    values = [Level.LOW, Level.HIGH, Mode.X | Mode.Y, Suit.SPADES, Suit.HEARTS, Level.LOW, 1, "s"]
+    values += [{"k": Level.HIGH, "x": Suit.HEARTS}, [Level.HIGH] * 20, [Suit.SPADES] * 20]
+    out = loads(dumps(values, format=fmt))
+    assert out == values
+    assert [type(v) for v in out] == [type(v) for v in values]
+    assert out[0] is Level.LOW and out[5] is Level.LOW and out[2] is Mode.X | Mode.Y
+    assert out[3] is Suit.SPADES and type(out[7]) is str and type(out[6]) is int
+    assert out[8]["k"] is Level.HIGH and out[8]["x"] is Suit.HEARTS
+    assert all(v is Level.HIGH for v in out[9]) and all(v is Suit.SPADES for v in out[10])
+    if fmt == "wire":
+        keys = list(loads(dumps({Suit.HEARTS: 1, Level.LOW: 2, "x": 3})))
+        assert keys == [Suit.HEARTS, Level.LOW, "x"] and type(keys[0]) is Suit and type(keys[1]) is Level
+
+
+class Tagged(list):
+    pass
+
+
+@pytest.mark.parametrize("fmt", ["wire", "graph"])
+def test_type_dispatch_follows_class_changes(fmt):
+    class Handle:
+        pass
+
+    items = [Tagged([1, 2]), Handle(), True, 3]
+    out = loads(dumps(items, format=fmt))
+    assert out[0] == [1, 2] and out[2] is True and out[3] == 3
+    with open(__file__, "rb") as f, pytest.raises(TypeError, match="file objects"):
+        dumps(f, format=fmt)
+    # A class that becomes file-like after it was first seen is refused too.
+    Handle.fileno = lambda self: 0
+    with pytest.raises(TypeError, match="file objects"):
+        dumps([Handle()], format=fmt)
+
+
 def test_noising_detection_flip_bytes():
     obj = {"x": list(range(100))}
     data = dumps(obj)